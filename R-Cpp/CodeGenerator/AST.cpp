@@ -22,35 +22,21 @@ llvm::Function* LogErrorF(const std::string& msg) {
     return nullptr;
 }
 
-AllocaInst* CreateEntryBlockAlloca(llvm::Function* TheFunction, Type* Type,
-    const std::string& VarName, CodeGenerator& cg) {
-    IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
-        TheFunction->getEntryBlock().begin());
-    return TmpB.CreateAlloca(Type, 0,
-        VarName.c_str());
-}
-
-AllocaInst* CreateEntryBlockAlloca(llvm::Function* TheFunction,const std::string& TypeName,
-    const std::string& VarName,CodeGenerator& cg) {
-    auto type = cg.symbol().getType(TypeName);
-    return CreateEntryBlockAlloca(TheFunction, type, VarName, cg);
-}
-
-IntegerExprAST::IntegerExprAST(std::int64_t v):ExprAST("i32"), val(v) {
+IntegerExprAST::IntegerExprAST(std::int64_t v, Parse::Type* t):ExprAST(t), val(v) {
 }
 
 Value* IntegerExprAST::generateCode(CodeGenerator& cg) {
     return ConstantInt::get(cg.context(), APInt(32,val,true));
 }
 
-FloatExprAST::FloatExprAST(double v):ExprAST("double"), val(v) {
+FloatExprAST::FloatExprAST(double v, Parse::Type* t):ExprAST(t), val(v) {
 }
 
 Value* FloatExprAST::generateCode(CodeGenerator& cg) {
     return ConstantFP::get(cg.context(), APFloat(val));
 }
 
-VariableExprAST::VariableExprAST(const std::string& n,const std::string& t)
+VariableExprAST::VariableExprAST(const std::string& n,Parse::Type* t)
     :ExprAST(t), name(n) {
 }
 
@@ -65,55 +51,26 @@ llvm::Value* VariableExprAST::generateCode(CodeGenerator& cg) {
 
 }
 
-VariableDefAST::VariableDefAST(const std::string& type, const std::string& var_name,
-                             std::unique_ptr<ExprAST> init_value)
-    :ExprAST("void"), type_(type), varname_(var_name),init_value_(std::move(init_value)) 
+VariableDefAST::VariableDefAST(Parse::Type* type, const std::string& var_name,
+                             std::unique_ptr<ExprAST> init_value, bool inPlace)
+    :ExprAST(nullptr), type_(type), varname_(var_name),init_value_(std::move(init_value)), inPlace_(inPlace)
 {
 }
 
-VariableDefAST::VariableDefAST(const std::string& type, const std::string& var_name)
-    :ExprAST("void"), type_(type),varname_(var_name),init_value_(std::move(nullptr)) 
+VariableDefAST::VariableDefAST(Parse::Type* type, const std::string& var_name)
+    :ExprAST(nullptr), type_(type),varname_(var_name),init_value_(std::move(nullptr)), inPlace_(false)
 {
 }
 llvm::Value* VariableDefAST::generateCode(CodeGenerator& cg) {
-    llvm::AllocaInst* alloc;
-    if(type_=="__arr")
-    {
-        auto elementType = cg.symbol().getType(templateArgs[0]);// get_type(type_.templateArgs[0], cg);
-        auto size = std::stoi(templateArgs[1]);
-        //auto size = template_args_[1]->generateCode(cg);
-        auto type = ArrayType::get(elementType, size);
-        alloc = cg.builder().CreateAlloca(type);
-    }
-    else if(type_=="__ptr")
-    {
-        auto elementType = cg.symbol().getType(templateArgs[0]);
-        auto type = PointerType::get(elementType, 0);
-        alloc = cg.builder().CreateAlloca(type);
-        if(init_value_)
-        {
-            auto InitVal = init_value_->generateCode(cg);
-            if (!InitVal) return nullptr;
-            cg.builder().CreateStore(InitVal, alloc);
-        }
-    }
-    else
-    {
-        auto type = cg.symbol().getType(type_);
-        //if(init_value_&& dynamic_cast<NamelessVarExprAST*>(init_value_.get()))
-        //{
-        //    init_value_->generateCode(cg);
-        //    alloc = dynamic_cast<NamelessVarExprAST*>(init_value_.get())->getAlloc();
-        //}else
-        //{
-            alloc = cg.builder().CreateAlloca(type, nullptr, varname_);
-            if (init_value_) {
-                auto InitVal = init_value_->generateCode(cg);
-                if (!InitVal) return nullptr;
-                cg.builder().CreateStore(InitVal, alloc);
-            }
-        //}
-
+    auto alloc = cg.createLocal(cg.getType(type_), varname_);
+    if (init_value_) {
+        if (inPlace_) dynamic_cast<InPlaceAST*>(init_value_.get())->setDestination(alloc);
+        auto InitVal = init_value_->generateCode(cg);
+        if (!InitVal) return nullptr;
+        if (!inPlace_) cg.builder().CreateStore(InitVal, alloc);
+    } else if (Parse::asRefCounted(type_)) {
+        // released at the end of the scope even if nothing is assigned
+        cg.builder().CreateStore(Constant::getNullValue(alloc->getAllocatedType()), alloc);
     }
     cg.symbol().setAlloc(varname_, alloc);
     return Constant::getNullValue(Type::getDoubleTy(cg.context()));
@@ -121,7 +78,7 @@ llvm::Value* VariableDefAST::generateCode(CodeGenerator& cg) {
 
 BinaryExprAST::BinaryExprAST(OperatorType op,
     std::unique_ptr<ExprAST> lhs,
-    std::unique_ptr<ExprAST> rhs, const std::string& retType)
+    std::unique_ptr<ExprAST> rhs, Parse::Type* retType)
     :ExprAST(retType), Op(op), LHS(std::move(lhs)),RHS(std::move(rhs))
 {
 }
@@ -150,6 +107,13 @@ llvm::Value* BinaryExprAST::generateCode(CodeGenerator& cg) {
             return LogError("destination of '=' must be a variable");
         //auto var = cg.symbol().getValue();
         //if (!var.alloc) return LogError("Unknown variable name.");
+        if (auto rc = Parse::asRefCounted(Ltype)) {
+            // R is retained already, the old value goes
+            auto old = cg.builder().CreateLoad(LHSE->getAlloc());
+            auto store = cg.builder().CreateStore(R, LHSE->getAlloc());
+            cg.release(old, rc);
+            return store;
+        }
         return cg.builder().CreateStore(R, LHSE->getAlloc());;
     }
     else{
@@ -163,21 +127,30 @@ llvm::Value* BinaryExprAST::generateCode(CodeGenerator& cg) {
 }
 
 ReturnAST::ReturnAST(std::unique_ptr<ExprAST> returnValue, std::vector<std::unique_ptr<ExprAST>> destructorExpr)
-    :ExprAST("void"), ret_val_(std::move(returnValue)), destructor_expr_(std::move(destructorExpr))
+    :ExprAST(nullptr), ret_val_(std::move(returnValue)), destructor_expr_(std::move(destructorExpr)), inPlace_(false)
 {
 }
 
 Value* ReturnAST::generateCode(CodeGenerator& cg) {
     Value* retval=nullptr;
+    auto slot = cg.returnSlot();
     if (ret_val_ != nullptr)
     {
+        if (inPlace_) dynamic_cast<InPlaceAST*>(ret_val_.get())->setDestination(slot);
         retval = ret_val_->generateCode(cg);
         if (!retval) 
             return nullptr;
+        if (!move_constructor_.empty()) {
+            auto from = dynamic_cast<AllocAST*>(ret_val_.get())->getAlloc();
+            cg.builder().CreateCall(cg.getFunction(move_constructor_), { slot, from });
+        } else if (slot && !inPlace_) {
+            cg.builder().CreateStore(retval, slot);
+        }
     }
+    // the result is in the slot before the locals go
     for (auto& expr : destructor_expr_)
         expr->generateCode(cg);
-    return cg.builder().CreateRet(retval);
+    return cg.createReturn(retval);
 }
 
 llvm::Value* ForExprAST::generateCode(CodeGenerator& cg) {
@@ -190,7 +163,7 @@ llvm::Value* ForExprAST::generateCode(CodeGenerator& cg) {
     cg.builder().SetInsertPoint(PreHeaderBB);
     auto EndCond = Cond->generateCode(cg);
     EndCond = cg.builder().CreateICmpNE(EndCond,
-        ConstantInt::get(cg.getBuiltinType("bool"), APInt(1, 0)), "loopcond");
+        ConstantInt::get(Type::getInt1Ty(cg.context()), APInt(1, 0)), "loopcond");
     auto LoopBB = BasicBlock::Create(cg.context(), "loop", F);
     auto AfterBB = BasicBlock::Create(cg.context(), "afterloop", F);
     cg.builder().CreateCondBr(EndCond, LoopBB, AfterBB);
@@ -203,7 +176,7 @@ llvm::Value* ForExprAST::generateCode(CodeGenerator& cg) {
 }
 
 CallExprAST::
-CallExprAST(const std::string& callee, std::vector<std::unique_ptr<ExprAST>> args, const std::string& t)
+CallExprAST(const std::string& callee, std::vector<std::unique_ptr<ExprAST>> args, Parse::Type* t)
     :ExprAST(t), Callee(callee),Args(std::move(args)),thisPtr(nullptr)
 {
 }
@@ -291,29 +264,21 @@ llvm::Value* CallExprAST::generateCode(CodeGenerator& cg) {
         Argv.push_back(Args[i]->generateCode(cg));
         if(!Argv.back()) return nullptr;
     }
-    return cg.builder().CreateCall(CalleeF, Argv);
+    if (result_.empty()) return cg.createCall(CalleeF, Argv, nullptr);
+    auto slot = destination_;
+    if (!slot) {
+        alloca_ = cg.createLocal(cg.getType(type), result_);
+        cg.symbol().setAlloc(result_, alloca_);
+        slot = alloca_;
+    }
+    cg.createCall(CalleeF, Argv, slot);
+    return destination_ ? destination_ : cg.builder().CreateLoad(slot);
 }
 
 llvm::Function* PrototypeAST::generateCode(CodeGenerator& cg) {
     auto p = cg.symbol().getFunction(name_);
     if (p) return p;
-    std::vector<llvm::Type*> ArgT;
-    if (class_type_ != "") 
-        ArgT.push_back(PointerType::getUnqual(cg.symbol().getType(class_type_)));
-    for(auto& t: arg_list_) {
-        auto type = cg.symbol().getType(t.first);
-        assert(type != nullptr);
-        ArgT.push_back(type);
-    }
-    auto FT = FunctionType::get(cg.symbol().getType(return_type_), ArgT, false);
-    auto Func = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, name_ , cg.getModule());
-    int i = class_type_ == "" ?0:-1;
-    for (auto& arg : Func->args())
-    {
-        if (i == -1) arg.setName("this");
-        else arg.setName(arg_list_[i].second);
-        ++i;
-    }
+    auto Func = cg.createFunction(name_, arg_list_, return_type_, class_type_);
     cg.symbol().setFunction(name_, Func);
     return Func;
 }
@@ -322,24 +287,18 @@ llvm::Function* FunctionAST::generateCode(CodeGenerator& cg) {
     auto F = cg.symbol().getFunction(function_name_);
     assert(F != nullptr);
     if (body_ == nullptr) return nullptr;
+    TimeReport::Function timer(cg.timeReport(), F->getName());
     BasicBlock* BB = BasicBlock::Create(cg.context(), "entry", F);
     SymbolTable::ScopeGuard sg(cg.symbol());
     cg.builder().SetInsertPoint(BB);
+    cg.beginFunction(F);
     int i = 0;
-    for(auto& Arg:F->args()) {
-        //auto alloc = CreateEntryBlockAlloca(F, Arg.getType(), Arg.getName(), cg);
-        auto alloc = cg.builder().CreateAlloca(Arg.getType(),nullptr,Arg.getName());
-        cg.builder().CreateStore(&Arg, alloc);
-        cg.symbol().setAlloc(Arg.getName(), alloc);
-        i++;
-    }
-    if(class_name_!="")
+    if(class_type_!=nullptr)
     {
-        auto c = cg.symbol().getClass(class_name_);
         Value* data = cg.symbol().getAlloc("this");
         data = cg.builder().CreateLoad(data);
         i = 0;
-        for(auto& v:c.members)
+        for(auto& v:class_type_->getMemberVariables())
         {
             Value* index = ConstantInt::get(cg.context(),APInt(32, i++));
             std::vector<llvm::Value*> indices(2);
@@ -359,70 +318,54 @@ llvm::Function* FunctionAST::generateCode(CodeGenerator& cg) {
     //     // here doesn't need return, but ifexpr will create new branch 
     //     // for the code below. LLVM requires that all blocks mush have
     //     // terminator. Therefore, using 'return void' to make it valid,
-    //     // and optimizer will remove it.
+    //     // and optimizer will remove it. A function returning a value
+    //     // can't get there, so the block is marked unreachable instead.
     //     // This is a temporary method. Maybe ifexpr.generateCode() should
     //     // be refactored.
     // }
     //
-    if (!hasReturn) cg.builder().CreateRet(nullptr);
+    if (!hasReturn) {
+        if (F->getReturnType()->isVoidTy()) cg.builder().CreateRet(nullptr);
+        else cg.builder().CreateUnreachable();
+    }
     if(llvm::verifyFunction(*F,&errs())) {
         std::cout << std::endl << "something bad happened ...\n";
     }
-    //cg.FPM()->run(*F);
+    cg.optimizeFunction(*F);
     return F;
 }
 
 llvm::StructType* ClassAST::generateCode(CodeGenerator& cg)
 {
-    auto type = StructType::create(cg.context(), name_);
-    cg.symbol().setType(name_,type);
-    std::vector<llvm::Type*> members;
-    for(auto m:members_)
-    {
-        members.push_back(cg.symbol().getType(m.first));
-        //auto t = get_builtin_type(m.type, cg);
-        //if (!t)
-        //    members.push_back(cg.symbol().getType(m.type));
-        //else members.push_back(t);
-    }
-    type->setBody(members);
-    ClassSymbol symbol;
-    symbol.type = type;
-    symbol.members = std::move(members_);
-    cg.symbol().setClass(name_, symbol);
-    //for(auto fn:c.memberFunctions)
-    //{
-    //    cg.symbol().getFunction(fn.name)
-    //}
-    //generateFunction_new(cg);
-    return type;
+    return cg.declareClass(type_);
 }
 
 llvm::Value* ClassAST::generateFunction_new(CodeGenerator& cg)
 {
-    Parse::FunctionType fn("new",{},nullptr,nullptr);
-    fn.setNamespaceHierarchy(type_->getNamespaceHierarchy()->nextNS[type_->getTypename()].get());
-    std::string fnname = "new";
-    auto FT = FunctionType::get(cg.getPtrTypeOf(type_->mangledName()), std::vector<Type*>(), false);
-    auto Func = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, fn.mangledName(), cg.getModule());
-    cg.symbol().setFunction(fn.mangledName(), Func);
-    BasicBlock* BB = BasicBlock::Create(cg.context(), "entry", Func);
-    cg.builder().SetInsertPoint(BB);
-    std::vector<Value*> index;
-    index.push_back(ConstantInt::get(cg.context(), APInt(32, 1)));
-    auto size = cg.builder().CreateGEP(Constant::getNullValue(PointerType::get(cg.symbol().getType(name_), 0)), index);
-    size = cg.builder().CreateCast(llvm::Instruction::CastOps::PtrToInt, size, cg.getBuiltinType("i32"));
-    std::vector<Value*> args;
-    args.push_back(size);
-    auto retVal = cg.builder().CreateCall(cg.getFunction("malloc"), args);
-    cg.builder().CreateRet(retVal);
-    cg.FPM()->run(*Func);
+    auto name = cg.newFunctionName(type_);
+    auto FT = FunctionType::get(PointerType::getUnqual(cg.getType(type_)), std::vector<Type*>(), false);
+    auto Func = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, name, cg.getModule());
+    cg.symbol().setFunction(name, Func);
+    // an imported class' new() is in the object file of its module
+    auto compound = dynamic_cast<Parse::CompoundType*>(type_);
+    if (!compound || !compound->isImported()) cg.defineNewFunction(Func, cg.getType(type_));
+    return Func;
+}
+
+llvm::Value* ClassAST::generateFunction_delete(CodeGenerator& cg)
+{
+    auto name = cg.deleteFunctionName(type_);
+    auto FT = FunctionType::get(Type::getVoidTy(cg.context()), { PointerType::getUnqual(cg.getType(type_)) }, false);
+    auto Func = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, name, cg.getModule());
+    Func->arg_begin()->setName("p");
+    cg.symbol().setFunction(name, Func);
+    if (!type_->isImported()) cg.defineDeleteFunction(Func, type_);
     return Func;
 }
 
 
 MemberAccessAST::MemberAccessAST(std::unique_ptr<ExprAST> Var, int index,
-    const std::string& retType): ExprAST(retType), var(std::move(Var)), memberIndex(index)
+    Parse::Type* retType): ExprAST(retType), var(std::move(Var)), memberIndex(index)
 {
 }
 
@@ -494,6 +437,7 @@ llvm::Value* UnaryExprAST::generateCode(CodeGenerator& cg)
         return cg.builder().CreateNot(var);
     }else if(op==OperatorType::Dereference)
     {
+        if (Parse::asRefCounted(expr->getType())) var = cg.refCountedObject(var);
         alloca_ = static_cast<AllocaInst*>(var);
         return cg.builder().CreateLoad(var);
     }else if(op==OperatorType::BitwiseAND) {
@@ -515,6 +459,15 @@ llvm::Value* NonExprAST::generateCode(CG::CodeGenerator& cg)
 
 llvm::Value* NamelessVarExprAST::generateCode(CG::CodeGenerator& cg)
 {
+    if (destination_) {
+        std::vector<Value*> argv{ destination_ };
+        for (auto& a : args) {
+            argv.push_back(a->generateCode(cg));
+            if (!argv.back()) return nullptr;
+        }
+        cg.createCall(cg.getFunction(constructor), argv, nullptr);
+        return destination_;
+    }
     auto allocVar = std::make_unique<VariableDefAST>(type,name);
     allocVar->generateCode(cg);
     alloca_ = cg.symbol().getAlloc(name);
@@ -523,3 +476,44 @@ llvm::Value* NamelessVarExprAST::generateCode(CG::CodeGenerator& cg)
     callConsturutor->generateCode(cg);
     return std::make_unique<VariableExprAST>(name, type)->generateCode(cg);
 }
+
+llvm::Value* RefCountedNewAST::generateCode(CG::CodeGenerator& cg)
+{
+    auto rc = static_cast<Parse::BuiltinType*>(type);
+    auto block = cg.newRefCounted(rc);
+    if (!constructor.empty()) {
+        std::vector<Value*> argv{ cg.refCountedObject(block) };
+        for (auto& a : args) {
+            argv.push_back(a->generateCode(cg));
+            if (!argv.back()) return nullptr;
+        }
+        cg.createCall(cg.getFunction(constructor), argv, nullptr);
+    }
+    return block;
+}
+
+llvm::Value* TemporaryAST::generateCode(CG::CodeGenerator& cg)
+{
+    auto value = expr->generateCode(cg);
+    if (!value) return nullptr;
+    alloca_ = cg.createLocal(value->getType(), name);
+    cg.builder().CreateStore(value, alloca_);
+    cg.symbol().setAlloc(name, alloca_);
+    return value;
+}
+
+llvm::Value* RetainAST::generateCode(CG::CodeGenerator& cg)
+{
+    auto value = expr->generateCode(cg);
+    if (!value) return nullptr;
+    cg.retain(value, static_cast<Parse::BuiltinType*>(type));
+    return value;
+}
+
+llvm::Value* ReleaseAST::generateCode(CG::CodeGenerator& cg)
+{
+    auto value = expr->generateCode(cg);
+    if (!value) return nullptr;
+    cg.release(value, static_cast<Parse::BuiltinType*>(expr->getType()));
+    return value;
+}
@@ -10,18 +10,19 @@
 class ExprAST
 {
 public:
-    ExprAST(const std::string& s) :type(s) {}
-    std::string getType()
+    // nullptr for expressions without a value
+    ExprAST(Parse::Type* t) :type(t) {}
+    Parse::Type* getType()
     {
         return type;
     }
-    void setType(const std::string& t) {
+    void setType(Parse::Type* t) {
         type = t;
     }
     virtual ~ExprAST() = default;
     virtual llvm::Value* generateCode(CG::CodeGenerator& cg) =0;
 protected:
-    std::string type;
+    Parse::Type* type;
 };
 
 class AllocAST
@@ -33,10 +34,23 @@ protected:
     llvm::AllocaInst* alloca_;
 };
 
+// A construction or a call returning a class, which builds the object in
+// memory. Given a destination before generateCode(), such as a variable
+// being initialised or the caller's return slot, it builds it there instead
+// of in a temporary, and returns the destination.
+class InPlaceAST
+{
+public:
+    InPlaceAST():destination_(nullptr){}
+    void setDestination(llvm::Value* destination) { destination_ = destination; }
+protected:
+    llvm::Value* destination_;
+};
+
 class IntegerExprAST:public ExprAST
 {
 public:
-    IntegerExprAST(std::int64_t v);
+    IntegerExprAST(std::int64_t v, Parse::Type* t);
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
     std::int64_t value() { return val; }
 private:
@@ -46,7 +60,7 @@ private:
 class FloatExprAST :public ExprAST
 {
 public:
-    FloatExprAST(double v);
+    FloatExprAST(double v, Parse::Type* t);
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
 
 private:
@@ -56,7 +70,7 @@ private:
 class VariableExprAST:public ExprAST,public AllocAST
 {
 public:
-    VariableExprAST(const std::string& n, const std::string& t);
+    VariableExprAST(const std::string& n, Parse::Type* t);
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
     std::string getName() { return name; }
 
@@ -65,10 +79,10 @@ private:
 
 };
 
-class NamelessVarExprAST:public ExprAST,public AllocAST
+class NamelessVarExprAST:public ExprAST,public AllocAST,public InPlaceAST
 {
 public:
-    NamelessVarExprAST(const std::string Name,const std::string& Type, const std::string& Constructor,std::vector<std::unique_ptr<ExprAST>> Args)
+    NamelessVarExprAST(const std::string Name,Parse::Type* Type, const std::string& Constructor,std::vector<std::unique_ptr<ExprAST>> Args)
         :ExprAST(Type), name(Name),constructor(Constructor),args(std::move(Args))
     { }
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
@@ -78,11 +92,59 @@ private:
     std::vector<std::unique_ptr<ExprAST>> args;
 };
 
+// rc<T>(args) or arc<T>(args): a new block with a count of one, whose T
+// is built by constructor, unless that is empty.
+class RefCountedNewAST:public ExprAST
+{
+public:
+    RefCountedNewAST(Parse::Type* Type, const std::string& Constructor, std::vector<std::unique_ptr<ExprAST>> Args)
+        :ExprAST(Type), constructor(Constructor), args(std::move(Args))
+    { }
+    llvm::Value* generateCode(CG::CodeGenerator& cg) override;
+private:
+    std::string constructor;
+    std::vector<std::unique_ptr<ExprAST>> args;
+};
+
+// Keeps the value of expr in the nameless variable name, for the
+// destructors at the end of the statement.
+class TemporaryAST:public ExprAST,public AllocAST
+{
+public:
+    TemporaryAST(const std::string& Name, std::unique_ptr<ExprAST> Expr)
+        :ExprAST(Expr->getType()), name(Name), expr(std::move(Expr))
+    { }
+    llvm::Value* generateCode(CG::CodeGenerator& cg) override;
+private:
+    std::string name;
+    std::unique_ptr<ExprAST> expr;
+};
+
+// The rc or arc expr evaluates to, retained for a copy.
+class RetainAST:public ExprAST
+{
+public:
+    RetainAST(std::unique_ptr<ExprAST> Expr): ExprAST(Expr->getType()), expr(std::move(Expr)) {}
+    llvm::Value* generateCode(CG::CodeGenerator& cg) override;
+private:
+    std::unique_ptr<ExprAST> expr;
+};
+
+// Releases the rc or arc expr evaluates to.
+class ReleaseAST:public ExprAST
+{
+public:
+    ReleaseAST(std::unique_ptr<ExprAST> Expr): ExprAST(nullptr), expr(std::move(Expr)) {}
+    llvm::Value* generateCode(CG::CodeGenerator& cg) override;
+private:
+    std::unique_ptr<ExprAST> expr;
+};
+
 class BlockExprAST :public ExprAST
 {
 public:
-    BlockExprAST(std::vector<std::unique_ptr<ExprAST>> expr, bool hasReturnStatement ,const std::string& t="void")
-        :ExprAST(t), expr_(std::move(expr)),hasReturn_(hasReturnStatement) {}
+    BlockExprAST(std::vector<std::unique_ptr<ExprAST>> expr, bool hasReturnStatement)
+        :ExprAST(nullptr), expr_(std::move(expr)),hasReturn_(hasReturnStatement) {}
     llvm::Value* generateCode(CG::CodeGenerator& cg);
     std::vector<std::unique_ptr<ExprAST>>& instructions();
     bool hasReturn() { return hasReturn_; }
@@ -98,7 +160,7 @@ class IfExprAST :public ExprAST
 public:
     IfExprAST(std::unique_ptr<ExprAST> condition,
         std::unique_ptr<BlockExprAST> then, std::unique_ptr<BlockExprAST> els)
-        :ExprAST("void"), Cond(std::move(condition)),Then(std::move(then)),
+        :ExprAST(nullptr), Cond(std::move(condition)),Then(std::move(then)),
         /*ElseIf(nullptr),*/ Else(std::move(els))
     { }
     //IfExprAST(std::unique_ptr<ExprAST> condition,
@@ -109,7 +171,7 @@ public:
     //}
     IfExprAST(std::unique_ptr<ExprAST> condition,
         std::unique_ptr<BlockExprAST> then)
-        :ExprAST("void"), Cond(std::move(condition)), Then(std::move(then)),
+        :ExprAST(nullptr), Cond(std::move(condition)), Then(std::move(then)),
         /*ElseIf(nullptr),*/ Else(nullptr) {
     }
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
@@ -124,16 +186,13 @@ private:
 class VariableDefAST:public ExprAST
 {
 public:
-    VariableDefAST(const std::string& type_name, const std::string& var_name,
-        std::unique_ptr<ExprAST> init_value);
+    // with inPlace init_value is an InPlaceAST building the variable itself
+    VariableDefAST(Parse::Type* var_type, const std::string& var_name,
+        std::unique_ptr<ExprAST> init_value, bool inPlace = false);
 
-    VariableDefAST(const std::string& type_name, const std::string& var_name);
+    VariableDefAST(Parse::Type* var_type, const std::string& var_name);
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
     std::string getVarName() { return varname_; }
-    void setTemplateArgs(std::vector<std::string> args)
-    {
-        templateArgs = std::move(args);
-    }
 
     void setInitValue(std::unique_ptr<ExprAST> initVal)
     {
@@ -141,10 +200,10 @@ public:
     }
 
 private:
-    std::string type_;
-    std::vector<std::string> templateArgs;
+    Parse::Type* type_;
     std::string varname_;
     std::unique_ptr<ExprAST> init_value_;
+    bool inPlace_;
 };
 
 class ReturnAST:public ExprAST
@@ -152,16 +211,23 @@ class ReturnAST:public ExprAST
 public:
     ReturnAST(std::unique_ptr<ExprAST> returnValue, std::vector<std::unique_ptr<ExprAST>> destructorExpr);
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
+    // A class is copied to the return slot, unless the value is an
+    // InPlaceAST built there, or a variable that the move constructor
+    // moves there.
+    void setInPlace() { inPlace_ = true; }
+    void setMoveConstructor(const std::string& name) { move_constructor_ = name; }
     
 private:
     std::unique_ptr<ExprAST> ret_val_;
     std::vector<std::unique_ptr<ExprAST>> destructor_expr_;
+    bool inPlace_;
+    std::string move_constructor_;
 };
 
 class BinaryExprAST:public ExprAST
 {
 public:
-    BinaryExprAST(OperatorType op, std::unique_ptr<ExprAST> lhs, std::unique_ptr<ExprAST> rhs,const std::string& retType);
+    BinaryExprAST(OperatorType op, std::unique_ptr<ExprAST> lhs, std::unique_ptr<ExprAST> rhs,Parse::Type* retType);
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
 
 private:
@@ -174,7 +240,7 @@ class ForExprAST:public ExprAST
 public:
     ForExprAST(std::unique_ptr<ExprAST> start, std::unique_ptr<ExprAST> cond,
         std::unique_ptr<ExprAST> end, std::unique_ptr<BlockExprAST> body)
-        :ExprAST("null"), Start(std::move(start)),Cond(std::move(cond)),
+        :ExprAST(nullptr), Start(std::move(start)),Cond(std::move(cond)),
          End(std::move(end)),Body(std::move(body))
     { }
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
@@ -184,41 +250,45 @@ private:
     std::unique_ptr<BlockExprAST> Body;
 };
 
-class CallExprAST:public ExprAST
+class CallExprAST:public ExprAST,public AllocAST,public InPlaceAST
 {
 public:
-    CallExprAST(const std::string& callee, std::vector<std::unique_ptr<ExprAST>> args, const std::string& t);
+    CallExprAST(const std::string& callee, std::vector<std::unique_ptr<ExprAST>> args, Parse::Type* t);
     llvm::Value* generateCode(CG::CodeGenerator& cg) override; 
     void setThis(std::unique_ptr<ExprAST> This);
     const std::string& getName() { return Callee; }
     void setName(const std::string& name) { Callee = name; }
     void setArgs(std::vector<std::unique_ptr<ExprAST>> args) { Args = std::move(args); }
+    // a class returned is kept in the nameless variable name, unless it
+    // has a destination
+    void setResult(const std::string& name) { result_ = name; }
 private:
     std::string Callee;
     std::vector<std::unique_ptr<ExprAST>> Args;
     std::unique_ptr<ExprAST> thisPtr;
+    std::string result_;
 };
 
 class PrototypeAST
 {
     std::string name_;
-    std::vector<std::pair<std::string,std::string>> arg_list_;
-    std::string return_type_;
-    std::string class_type_;
+    std::vector<std::pair<Parse::Type*,std::string>> arg_list_;
+    Parse::Type* return_type_;
+    Parse::Type* class_type_;
 
 public:
-    PrototypeAST(const std::string& name, std::vector<std::pair<std::string, std::string>> argList,std::string returnType,std::string classType="")
+    PrototypeAST(const std::string& name, std::vector<std::pair<Parse::Type*, std::string>> argList,Parse::Type* returnType,Parse::Type* classType=nullptr)
         : name_(name), arg_list_(std::move(argList)),return_type_(returnType),class_type_(classType)
     { }
     ~PrototypeAST() {}
     const std::string& name() const { return name_; }
-    const std::vector<std::pair<std::string, std::string>>& Arg()
+    const std::vector<std::pair<Parse::Type*, std::string>>& Arg()
     {
         return arg_list_;
     }
     llvm::Function* generateCode(CG::CodeGenerator& cg);
-    void setClassType(const std::string& classType) { class_type_ = classType; }
-    std::string getClassType() { return class_type_; }
+    void setClassType(Parse::Type* classType) { class_type_ = classType; }
+    Parse::Type* getClassType() { return class_type_; }
 };
 
 class FunctionAST
@@ -226,13 +296,13 @@ class FunctionAST
     //::Function Proto;
     std::string function_name_;
     std::unique_ptr<BlockExprAST> body_;
-    std::string class_name_;
+    Parse::CompoundType* class_type_;
    // std::vector<std::unique_ptr<ExprAST>> Body;
     
 public:
     FunctionAST(const std::string& name,
-        std::unique_ptr<BlockExprAST> Body,const std::string& className="")
-        : function_name_(name), body_(std::move(Body)),class_name_(className) {
+        std::unique_ptr<BlockExprAST> Body,Parse::CompoundType* classType=nullptr)
+        : function_name_(name), body_(std::move(Body)),class_type_(classType) {
     }
     ~FunctionAST() {}
     llvm::Function* generateCode(CG::CodeGenerator& cg);
@@ -247,19 +317,17 @@ public:
 
 class ClassAST
 {
-    std::string name_;
-    std::vector<std::pair<std::string, std::string>> members_;
-    Parse::Type* type_;
+    Parse::CompoundType* type_;
 
 public:
-    ClassAST(const std::string& name, std::vector<std::pair<std::string, std::string>> members,
-        Parse::Type* type)
-        : name_(name),members_(std::move(members)),type_(type)
+    ClassAST(Parse::CompoundType* type)
+        : type_(type)
     {
     }
 
     llvm::StructType* generateCode(CG::CodeGenerator& cg);
     llvm::Value* generateFunction_new(CG::CodeGenerator& cg);
+    llvm::Value* generateFunction_delete(CG::CodeGenerator& cg);
 };
 
 class MemberAccessAST:public ExprAST,public AllocAST
@@ -269,7 +337,7 @@ class MemberAccessAST:public ExprAST,public AllocAST
 
 public:
     MemberAccessAST(std::unique_ptr<ExprAST> Var, int index,
-                    const std::string& retType);
+                    Parse::Type* retType);
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
 };
 
@@ -280,10 +348,10 @@ class UnaryExprAST:public ExprAST,public AllocAST
     std::vector<std::unique_ptr<ExprAST>> args;
 
 public:
-    UnaryExprAST(std::unique_ptr<ExprAST> var,OperatorType Op, std::vector<std::unique_ptr<ExprAST>> Args, const std::string& type)
+    UnaryExprAST(std::unique_ptr<ExprAST> var,OperatorType Op, std::vector<std::unique_ptr<ExprAST>> Args, Parse::Type* type)
         :ExprAST(type),expr(std::move(var)),op(Op),args(std::move(Args))
     { }
-    UnaryExprAST(std::unique_ptr<ExprAST> var, OperatorType Op,const std::string& type)
+    UnaryExprAST(std::unique_ptr<ExprAST> var, OperatorType Op,Parse::Type* type)
         :ExprAST(type),expr(std::move(var)), op(Op), args()
     { }
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
@@ -293,7 +361,7 @@ class NamespaceExprAST:public ExprAST
 {
     std::string name_;
 public:
-    NamespaceExprAST(std::string name):ExprAST("null"),name_(name){}
+    NamespaceExprAST(std::string name):ExprAST(nullptr),name_(name){}
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
     std::string getName() { return name_; }
 };
@@ -301,6 +369,6 @@ public:
 class NonExprAST :public ExprAST
 {
 public:
-    NonExprAST() :ExprAST("null") {}
+    NonExprAST() :ExprAST(nullptr) {}
     llvm::Value* generateCode(CG::CodeGenerator& cg) override;
 };
@@ -1,42 +1,52 @@
 #include "CodeGenerator.h"
-#include "llvm/Transforms/Utils.h"
+#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/CodeGen.h"
-#include "llvm/Transforms/Utils.h"
+#include "llvm/Support/Host.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Transforms/Utils/Mem2Reg.h"
 #include "llvm/Transforms/InstCombine/InstCombine.h"
-#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Scalar/Reassociate.h"
 #include "llvm/Transforms/Scalar/GVN.h"
+#include "llvm/Transforms/Scalar/SimplifyCFG.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include "../Parser/Parser.h"
+#include "TieredJIT.h"
 
 using namespace CG;
 
-CodeGenerator::CodeGenerator(Parse::Parser& p):context_(p.context()), Builder(TheContext), TheModule(std::make_unique<llvm::Module>("RCpp", context())),
-                                TheFPM(std::make_unique<llvm::legacy::FunctionPassManager>(TheModule.get())),st_(*this)
+CodeGenerator::CodeGenerator(Parse::Parser& p):context_(p.context()), TheContext(std::make_unique<llvm::LLVMContext>()), Builder(*TheContext), TheModule(std::make_unique<llvm::Module>("RCpp", context())),
+                                st_(*this), directLowering_(false), tieredJIT_(false), partitions_(1), output_("output.o"), irStream_(nullptr), report_(nullptr), optLevel_(OptLevel::O0), targetLookedUp_(false)
 {
-    // Promote allocas to registers.
-    TheFPM->add(llvm::createPromoteMemoryToRegisterPass());
-    // Do simple "peephole" optimizations and bit-twiddling optzns.
-    TheFPM->add(llvm::createInstructionCombiningPass());
-    // Reassociate expressions.
-    TheFPM->add(llvm::createReassociatePass());
-    // Eliminate Common SubExpressions.
-    TheFPM->add(llvm::createGVNPass());
-    // Simplify the control flow graph (deleting unreachable blocks, etc).
-    TheFPM->add(llvm::createCFGSimplificationPass());
-
-    TheFPM->doInitialization();
 }
 
 llvm::LLVMContext& CodeGenerator::context()
 {
-    return TheContext;
+    return *TheContext;
 }
 
 llvm::IRBuilder<>& CodeGenerator::builder()
@@ -54,52 +64,474 @@ llvm::Module& CodeGenerator::getModule()
     return *TheModule;
 }
 
-llvm::legacy::FunctionPassManager* CodeGenerator::FPM()
+void CodeGenerator::setOptimizationLevel(OptLevel level)
+{
+    optLevel_ = level;
+}
+
+OptLevel CodeGenerator::optimizationLevel() const
+{
+    return optLevel_;
+}
+
+void CodeGenerator::setTargetConfig(TargetConfig config)
+{
+    if (config.cpu == "native") {
+        config.cpu = llvm::sys::getHostCPUName().str();
+        // the host's features go first so that explicit -mattr ones win
+        std::string features;
+        llvm::StringMap<bool> host;
+        if (llvm::sys::getHostCPUFeatures(host)) {
+            for (auto& f : host) {
+                if (!features.empty()) features += ',';
+                features += (f.getValue() ? "+" : "-") + f.getKey().str();
+            }
+        }
+        if (!config.features.empty()) features += (features.empty() ? "" : ",") + config.features;
+        config.features = std::move(features);
+    }
+    if (config.fastMath) {
+        llvm::FastMathFlags fmf;
+        fmf.setFast();
+        Builder.setFastMathFlags(fmf);
+    }
+    target_ = std::move(config);
+}
+
+const TargetConfig& CodeGenerator::targetConfig() const
 {
-    return TheFPM.get();
+    return target_;
 }
 
-void CodeGenerator::output() {
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
+static llvm::PassBuilder::OptimizationLevel passBuilderLevel(OptLevel level)
+{
+    switch (level) {
+    case OptLevel::O1:
+        return llvm::PassBuilder::OptimizationLevel::O1;
+    case OptLevel::O2:
+        return llvm::PassBuilder::OptimizationLevel::O2;
+    case OptLevel::O3:
+        return llvm::PassBuilder::OptimizationLevel::O3;
+    default:
+        return llvm::PassBuilder::OptimizationLevel::Os;
+    }
+}
+
+static llvm::CodeGenOpt::Level codeGenLevel(OptLevel level)
+{
+    switch (level) {
+    case OptLevel::O0:
+        return llvm::CodeGenOpt::None;
+    case OptLevel::O1:
+        return llvm::CodeGenOpt::Less;
+    case OptLevel::O3:
+        return llvm::CodeGenOpt::Aggressive;
+    default:
+        return llvm::CodeGenOpt::Default;
+    }
+}
+
+static llvm::TargetOptions targetOptions(const TargetConfig& config)
+{
+    llvm::TargetOptions opt;
+    if (config.fastMath) {
+        opt.UnsafeFPMath = true;
+        opt.NoInfsFPMath = true;
+        opt.NoNaNsFPMath = true;
+        opt.NoSignedZerosFPMath = true;
+        opt.AllowFPOpFusion = llvm::FPOpFusion::Fast;
+    }
+    return opt;
+}
+
+std::unique_ptr<llvm::TargetMachine> CodeGenerator::createTargetMachine() const
+{
     auto TargetTriple = llvm::sys::getDefaultTargetTriple();
-    TheModule->setTargetTriple(TargetTriple);
     std::string error;
     auto Target = llvm::TargetRegistry::lookupTarget(TargetTriple, error);
     if (!Target) {
         llvm::errs() << error;
-        return;
+        return nullptr;
     }
-    auto CPU = "generic";
-    auto Features = "";
-    llvm::TargetOptions opt;
-    auto RM = llvm::Optional<llvm::Reloc::Model>();
-    auto TheTargetMachine =
-        Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM);
+    return std::unique_ptr<llvm::TargetMachine>(Target->createTargetMachine(
+        TargetTriple, target_.cpu, target_.features, targetOptions(target_), target_.relocModel, target_.codeModel,
+        codeGenLevel(optLevel_)));
+}
+
+llvm::TargetMachine* CodeGenerator::targetMachine()
+{
+    if (targetLookedUp_) return TheTargetMachine.get();
+    targetLookedUp_ = true;
+    // the registry is global, the driver may run several code generators
+    static std::once_flag initialized;
+    std::call_once(initialized, [] {
+        llvm::InitializeAllTargetInfos();
+        llvm::InitializeAllTargets();
+        llvm::InitializeAllTargetMCs();
+        llvm::InitializeAllAsmParsers();
+        llvm::InitializeAllAsmPrinters();
+    });
+    TheTargetMachine = createTargetMachine();
+    if (!TheTargetMachine) return nullptr;
+    TheModule->setTargetTriple(TheTargetMachine->getTargetTriple().str());
     TheModule->setDataLayout(TheTargetMachine->createDataLayout());
-    auto Filename = "output.o";
+    return TheTargetMachine.get();
+}
+
+static llvm::PipelineTuningOptions pipelineTuning(OptLevel level)
+{
+    llvm::PipelineTuningOptions PTO;
+    bool aggressive = level == OptLevel::O2 || level == OptLevel::O3;
+    PTO.LoopUnrolling = aggressive;
+    PTO.LoopInterleaving = aggressive;
+    PTO.LoopVectorization = aggressive;
+    PTO.SLPVectorization = aggressive;
+    return PTO;
+}
+
+// the module pipeline with analysis managers of its own, for modules that
+// don't live in TheContext
+static void runModulePipeline(llvm::Module& module, llvm::TargetMachine* TM, OptLevel level)
+{
+    llvm::LoopAnalysisManager LAM;
+    llvm::FunctionAnalysisManager FAM;
+    llvm::CGSCCAnalysisManager CGAM;
+    llvm::ModuleAnalysisManager MAM;
+    llvm::PassBuilder PB(TM, pipelineTuning(level));
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+    PB.buildPerModuleDefaultPipeline(passBuilderLevel(level)).run(module, MAM);
+}
+
+void CodeGenerator::setupPasses()
+{
+    if (PB) return;
+    PB = std::make_unique<llvm::PassBuilder>(targetMachine(), pipelineTuning(optLevel_), llvm::None,
+                                             report_ ? report_->passInstrumentation() : nullptr);
+    PB->registerModuleAnalyses(MAM);
+    PB->registerCGSCCAnalyses(CGAM);
+    PB->registerFunctionAnalyses(FAM);
+    PB->registerLoopAnalyses(LAM);
+    PB->crossRegisterProxies(LAM, FAM, CGAM, MAM);
+    // Promote allocas to registers.
+    FPM.addPass(llvm::PromotePass());
+    // Do simple "peephole" optimizations and bit-twiddling optzns.
+    FPM.addPass(llvm::InstCombinePass());
+    // Reassociate expressions.
+    FPM.addPass(llvm::ReassociatePass());
+    // Eliminate Common SubExpressions.
+    FPM.addPass(llvm::GVN());
+    // Simplify the control flow graph (deleting unreachable blocks, etc).
+    FPM.addPass(llvm::SimplifyCFGPass());
+}
+
+void CodeGenerator::optimizeFunction(llvm::Function& func)
+{
+    // Scopes still open in it end without lifetime markers, the passes
+    // may delete the block and the locals.
+    Builder.ClearInsertionPoint();
+    // the inliner only inlines between functions with compatible
+    // attributes and TTI reads the vector widths from them
+    func.addFnAttr("target-cpu", target_.cpu);
+    if (!target_.features.empty()) func.addFnAttr("target-features", target_.features);
+    if (target_.fastMath) {
+        func.addFnAttr("unsafe-fp-math", "true");
+        func.addFnAttr("no-infs-fp-math", "true");
+        func.addFnAttr("no-nans-fp-math", "true");
+        func.addFnAttr("no-signed-zeros-fp-math", "true");
+    }
+    if (optLevel_ == OptLevel::O0 || tieredJIT_) return;
+    setupPasses();
+    FPM.run(func, FAM);
+}
+
+void CodeGenerator::optimize()
+{
+    if (optLevel_ == OptLevel::O0) return;
+    setupPasses();
+    PB->buildPerModuleDefaultPipeline(passBuilderLevel(optLevel_)).run(*TheModule, MAM);
+}
+
+static bool emitFile(llvm::Module& module, llvm::TargetMachine& TM, const std::string& Filename,
+                     llvm::CodeGenFileType FileType = llvm::CGFT_ObjectFile)
+{
     std::error_code EC;
     llvm::raw_fd_ostream dest(Filename, EC, llvm::sys::fs::F_None);
 
     if (EC) {
         llvm::errs() << "Could not open file: " << EC.message();
-        return;
+        return false;
     }
 
     llvm::legacy::PassManager pass;
-    auto FileType = llvm::CGFT_ObjectFile;
-    
-    if (TheTargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType)) {
+    if (TM.addPassesToEmitFile(pass, dest, nullptr, FileType)) {
         llvm::errs() << "TheTargetMachine can't emit a file of this type";
-        return;
+        return false;
     }
 
-    pass.run(*TheModule);
+    pass.run(module);
     dest.flush();
-    std::cout << "output to: " << Filename << std::endl;
+    return true;
+}
+
+bool CodeGenerator::output() {
+    auto TheTargetMachine = targetMachine();
+    if (!TheTargetMachine) return false;
+    if (!emitFile(*TheModule, *TheTargetMachine, output_)) return false;
+    std::cout << "output to: " << output_ << std::endl;
+    return true;
+}
+
+// ld -r the objects into output, false if there is no linker or it failed
+static bool mergeObjects(const std::vector<std::string>& objects, const std::string& output)
+{
+    auto ld = llvm::sys::findProgramByName("ld");
+    if (!ld) {
+        llvm::errs() << "Could not merge the objects: ld not found\n";
+        return false;
+    }
+    std::vector<llvm::StringRef> args{ *ld, "-r", "-o", output };
+    args.insert(args.end(), objects.begin(), objects.end());
+    std::string error;
+    if (llvm::sys::ExecuteAndWait(*ld, args, llvm::None, {}, 0, 0, &error) == 0) return true;
+    llvm::errs() << "Could not merge the objects: " << error << "\n";
+    return false;
+}
+
+bool CodeGenerator::compileParts(const std::vector<llvm::SmallString<0>>& parts,
+                                 const std::vector<std::string>& objects) const
+{
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    auto worker = [&] {
+        for (size_t i; (i = next++) < parts.size();) {
+            llvm::LLVMContext context;
+            auto part = llvm::parseBitcodeFile(llvm::MemoryBufferRef(parts[i].str(), "partition"), context);
+            if (!part) {
+                llvm::logAllUnhandledErrors(part.takeError(), llvm::errs(), "partition: ");
+                failed = true;
+                continue;
+            }
+            // TargetMachines are not thread-safe
+            auto TM = createTargetMachine();
+            if (!TM) {
+                failed = true;
+                continue;
+            }
+            if (optLevel_ != OptLevel::O0) runModulePipeline(**part, TM.get(), optLevel_);
+            if (!emitFile(**part, *TM, objects[i])) failed = true;
+        }
+    };
+    auto threads = std::min<size_t>(parts.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+    return !failed;
+}
+
+bool CodeGenerator::outputPartitioned()
+{
+    if (!targetMachine()) return false;
+    // The partitions move to contexts of their own as bitcode, like in
+    // llvm::splitCodeGen. Functions go to partitions by name, each gets
+    // declarations of what it uses from the others.
+    std::vector<llvm::SmallString<0>> parts;
+    llvm::SplitModule(std::move(TheModule), partitions_, [&](std::unique_ptr<llvm::Module> part) {
+        parts.emplace_back();
+        llvm::raw_svector_ostream os(parts.back());
+        llvm::WriteBitcodeToFile(*part, os);
+    });
+
+    // output.o's partitions are output.0.o, output.1.o, ...
+    std::vector<std::string> objects;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        llvm::SmallString<128> object(output_);
+        llvm::sys::path::replace_extension(object, std::to_string(i) + ".o");
+        objects.push_back(object.str().str());
+    }
+    bool merged = compileParts(parts, objects) && mergeObjects(objects, output_);
+    for (auto& o : objects) llvm::sys::fs::remove(o);
+    if (!merged) return false;
+    // one relocatable object like output() writes
+    std::cout << "output to: " << output_ << std::endl;
+    return true;
+}
+
+// the globals used by func's instructions, in the order they appear
+static void referencedGlobals(llvm::Function& func, llvm::SetVector<llvm::GlobalValue*>& globals)
+{
+    llvm::SmallPtrSet<llvm::Constant*, 32> seen;
+    llvm::SmallVector<llvm::Value*, 32> work;
+    for (auto& I : llvm::instructions(func)) {
+        for (auto& op : I.operands()) {
+            work.push_back(op);
+            while (!work.empty()) {
+                auto v = work.pop_back_val();
+                if (auto gv = llvm::dyn_cast<llvm::GlobalValue>(v)) globals.insert(gv);
+                else if (auto c = llvm::dyn_cast<llvm::Constant>(v)) {
+                    if (!seen.insert(c).second) continue;
+                    for (auto& cop : c->operands()) work.push_back(cop);
+                }
+            }
+        }
+    }
+}
+
+// A module of its own for funcs, with declarations of what they use. With
+// callees, the functions they call, directly or not, come along as
+// available_externally so that they can be inlined.
+static std::unique_ptr<llvm::Module> extractFunctions(llvm::ArrayRef<llvm::Function*> funcs, bool callees)
+{
+    auto& M = *funcs.front()->getParent();
+    llvm::SetVector<llvm::Function*> bodies(funcs.begin(), funcs.end());
+    llvm::SetVector<llvm::GlobalValue*> used(funcs.begin(), funcs.end());
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        llvm::SetVector<llvm::GlobalValue*> refs;
+        referencedGlobals(*bodies[i], refs);
+        for (auto gv : refs) {
+            used.insert(gv);
+            auto f = llvm::dyn_cast<llvm::Function>(gv);
+            if (callees && f && !f->isDeclaration()) bodies.insert(f);
+        }
+    }
+
+    auto unit = std::make_unique<llvm::Module>(funcs.front()->getName(), M.getContext());
+    unit->setTargetTriple(M.getTargetTriple());
+    unit->setDataLayout(M.getDataLayout());
+    llvm::ValueToValueMapTy VMap;
+    for (auto gv : used) {
+        if (auto f = llvm::dyn_cast<llvm::Function>(gv)) {
+            auto decl = llvm::Function::Create(f->getFunctionType(), llvm::Function::ExternalLinkage, f->getName(), *unit);
+            decl->copyAttributesFrom(f);
+            VMap[f] = decl;
+        } else if (auto var = llvm::dyn_cast<llvm::GlobalVariable>(gv)) {
+            VMap[var] = new llvm::GlobalVariable(*unit, var->getValueType(), var->isConstant(),
+                                                 llvm::GlobalValue::ExternalLinkage, nullptr, var->getName());
+        }
+    }
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        auto f = bodies[i];
+        auto clone = llvm::cast<llvm::Function>(VMap[f]);
+        auto arg = clone->arg_begin();
+        for (auto& a : f->args()) VMap[&a] = &*arg++;
+        llvm::SmallVector<llvm::ReturnInst*, 8> returns;
+        llvm::CloneFunctionInto(clone, f, VMap, /*ModuleLevelChanges=*/true, returns);
+        if (i >= funcs.size()) clone->setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+    }
+    return unit;
+}
+
+// Reusing a cached object touches it, objects no build has used for this
+// long are removed.
+static const auto cacheLifetime = std::chrono::hours(24 * 30);
+
+static void touch(const llvm::Twine& path, llvm::sys::TimePoint<> now)
+{
+    int fd;
+    if (llvm::sys::fs::openFileForWrite(path, fd, llvm::sys::fs::CD_OpenExisting, llvm::sys::fs::OF_Append)) return;
+    llvm::sys::fs::setLastAccessAndModificationTime(fd, now);
+    llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+}
+
+static void pruneCache(const std::string& dir, llvm::sys::TimePoint<> now)
+{
+    std::error_code EC;
+    for (llvm::sys::fs::directory_iterator it(dir, EC), end; it != end && !EC; it.increment(EC)) {
+        if (llvm::sys::path::extension(it->path()) != ".o") continue;
+        llvm::sys::fs::file_status status;
+        if (!llvm::sys::fs::status(it->path(), status) && status.getLastModificationTime() < now - cacheLifetime)
+            llvm::sys::fs::remove(it->path());
+    }
+}
+
+bool CodeGenerator::outputCached()
+{
+    if (!targetMachine()) return false;
+    if (auto EC = llvm::sys::fs::create_directories(cacheDir_)) {
+        llvm::errs() << "Could not create " << cacheDir_ << ": " << EC.message() << "\n";
+        return false;
+    }
+    auto now = std::chrono::time_point_cast<llvm::sys::TimePoint<>::duration>(std::chrono::system_clock::now());
+    pruneCache(cacheDir_, now);
+    // everything besides the IR that the object code depends on
+    std::string config;
+    llvm::raw_string_ostream os(config);
+    os << "R-Cpp cache 1\n" << LLVM_VERSION_STRING << "\n" << TheModule->getTargetTriple() << "\n"
+       << target_.cpu << "\n" << target_.features << "\n" << target_.fastMath << "\n"
+       << static_cast<int>(optLevel_) << "\n"
+       << (target_.relocModel ? static_cast<int>(*target_.relocModel) : -1) << "\n"
+       << (target_.codeModel ? static_cast<int>(*target_.codeModel) : -1) << "\n";
+    os.flush();
+    bool callees = optLevel_ != OptLevel::O0;
+
+    // A function's key is the hash of its unit: its IR, the declarations
+    // and struct types it uses and, above O0, the bodies it may inline.
+    // Functions are cached in chunks of consecutive functions, as one
+    // object per function would make the final ld -r the slowest part.
+    // A chunk ends after a function whose key has its low bits clear, so
+    // an edit changes the key of its own chunk only, the other boundaries
+    // depend on the keys of unchanged functions.
+    const unsigned chunkMask = 31, maxChunk = 256;
+    std::vector<llvm::Function*> funcs;
+    std::vector<std::string> keys;
+    std::vector<size_t> chunkEnds;
+    for (auto& F : *TheModule) {
+        if (F.isDeclaration()) continue;
+        std::string text = config;
+        llvm::raw_string_ostream us(text);
+        extractFunctions(&F, callees)->print(us, nullptr);
+        us.flush();
+        auto hash = llvm::SHA1::hash(llvm::arrayRefFromStringRef(text));
+        funcs.push_back(&F);
+        keys.push_back(llvm::toHex(hash, true));
+        auto begin = chunkEnds.empty() ? 0 : chunkEnds.back();
+        if ((hash[19] & chunkMask) == 0 || funcs.size() - begin == maxChunk) chunkEnds.push_back(funcs.size());
+    }
+    if (funcs.empty()) return output();
+    if (chunkEnds.empty() || chunkEnds.back() != funcs.size()) chunkEnds.push_back(funcs.size());
+
+    std::vector<std::string> objects;
+    std::vector<llvm::SmallString<0>> misses;
+    std::vector<std::string> missObjects;
+    std::vector<std::string> missTemps;
+    size_t reused = 0;
+    for (size_t c = 0, begin = 0; c < chunkEnds.size(); begin = chunkEnds[c++]) {
+        std::string chunkKeys;
+        for (auto i = begin; i < chunkEnds[c]; ++i) chunkKeys += keys[i];
+        llvm::SmallString<128> path(cacheDir_);
+        llvm::sys::path::append(path, llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(chunkKeys)), true) + ".o");
+        objects.push_back(path.str().str());
+        if (llvm::sys::fs::exists(path)) {
+            touch(path, now);
+            reused += chunkEnds[c] - begin;
+            continue;
+        }
+        auto chunk = extractFunctions(llvm::makeArrayRef(funcs).slice(begin, chunkEnds[c] - begin), callees);
+        misses.emplace_back();
+        llvm::raw_svector_ostream bs(misses.back());
+        llvm::WriteBitcodeToFile(*chunk, bs);
+        missObjects.push_back(objects.back());
+        // written next to it and renamed, so that concurrent builds never
+        // see half an object
+        missTemps.push_back(objects.back() + "." + std::to_string(llvm::sys::Process::getProcessId()));
+    }
+
+    auto compiled = compileParts(misses, missTemps);
+    for (size_t i = 0; i < missTemps.size(); ++i) {
+        if (!compiled || llvm::sys::fs::rename(missTemps[i], missObjects[i])) llvm::sys::fs::remove(missTemps[i]);
+    }
+    if (!compiled) return false;
+    if (report_) {
+        report_->counter(reportUnit_ + ": functions", funcs.size());
+        report_->counter(reportUnit_ + ": functions from the cache", reused);
+    }
+    if (!mergeObjects(objects, output_)) return false;
+    std::cout << "output to: " << output_ << std::endl;
+    return true;
 }
 
 llvm::Type* CodeGenerator::getBuiltinType(const std::string& s)
@@ -127,27 +559,721 @@ llvm::Value* CodeGenerator::getBuiltinTypeDefaultValue(const std::string& s)
     return nullptr;
 }
 
-void CodeGenerator::generate()
+void CodeGenerator::enableDirectLowering()
+{
+    directLowering_ = true;
+    context_.setCodeGenerator(this);
+}
+
+void CodeGenerator::enableTieredJIT()
+{
+    tieredJIT_ = true;
+}
+
+void CodeGenerator::setCacheDirectory(std::string dir)
+{
+    cacheDir_ = std::move(dir);
+}
+
+void CodeGenerator::setCodegenPartitions(unsigned n)
+{
+    partitions_ = n;
+}
+
+void CodeGenerator::setOutputFile(std::string filename)
+{
+    output_ = std::move(filename);
+}
+
+void CodeGenerator::setIRStream(llvm::raw_ostream* os)
+{
+    irStream_ = os;
+}
+
+void CodeGenerator::setLLVMOutputFile(std::string filename)
+{
+    llvmFile_ = std::move(filename);
+}
+
+void CodeGenerator::setAsmOutputFile(std::string filename)
+{
+    asmFile_ = std::move(filename);
+}
+
+void CodeGenerator::setTimeReport(TimeReport* report, std::string unit)
+{
+    report_ = report;
+    reportUnit_ = std::move(unit);
+}
+
+llvm::Type* CodeGenerator::getType(Parse::Type* type)
+{
+    if (auto t = type->llvmType()) return t;
+    if (auto c = dynamic_cast<Parse::CompoundType*>(type)) return declareClass(c);
+    auto& args = type->getTemplateArgs();
+    llvm::Type* t;
+    switch (static_cast<Parse::BuiltinType*>(type)->getCategory()) {
+    case Parse::BuiltinType::category::Pointer:
+        t = getType(args[0]);
+        // there are no pointers to void in LLVM, __ptr<void> is an i8*
+        if (t->isVoidTy()) t = llvm::Type::getInt8Ty(context());
+        t = llvm::PointerType::getUnqual(t);
+        break;
+    case Parse::BuiltinType::category::Rc:
+    case Parse::BuiltinType::category::Arc:
+        // the count, then the object, see refCountedObject()
+        t = llvm::PointerType::getUnqual(
+            llvm::StructType::get(context(), { llvm::Type::getInt64Ty(context()), getType(args[0]) }));
+        break;
+    case Parse::BuiltinType::category::Array:
+        t = llvm::ArrayType::get(getType(args[0]), std::stoi(args[1]->mangledName()));
+        break;
+    default:
+        t = getBuiltinType(type->getTypename());
+    }
+    type->setLLVMType(t);
+    return t;
+}
+
+llvm::StructType* CodeGenerator::declareClass(Parse::CompoundType* type)
+{
+    auto t = llvm::StructType::create(context(), type->mangledName());
+    type->setLLVMType(t);
+    std::vector<llvm::Type*> members;
+    for (auto& m : type->getMemberVariables()) {
+        members.push_back(getType(m.first));
+    }
+    t->setBody(members);
+    return t;
+}
+
+llvm::Function* CodeGenerator::declareFunction(Parse::FunctionType* fn)
+{
+    auto name = fn->mangledName();
+    if (auto f = TheModule->getFunction(name)) return f;
+    return createFunction(name, fn->args(), fn->returnType(), fn->classType());
+}
+
+// SysV x86-64: an eightbyte of a class that an integer or a pointer
+// overlaps goes in a general purpose register, one with only floats and
+// doubles in an SSE register
+enum class Eightbyte { None, Integer, SSE };
+
+static void classifyEightbytes(const llvm::DataLayout& DL, llvm::Type* type, uint64_t offset, Eightbyte classes[2])
+{
+    if (auto s = llvm::dyn_cast<llvm::StructType>(type)) {
+        auto layout = DL.getStructLayout(s);
+        for (unsigned i = 0; i < s->getNumElements(); ++i)
+            classifyEightbytes(DL, s->getElementType(i), offset + layout->getElementOffset(i), classes);
+    } else if (auto a = llvm::dyn_cast<llvm::ArrayType>(type)) {
+        uint64_t size = DL.getTypeAllocSize(a->getElementType());
+        for (uint64_t i = 0; i < a->getNumElements(); ++i)
+            classifyEightbytes(DL, a->getElementType(), offset + i * size, classes);
+    } else if (type->isFloatingPointTy()) {
+        if (classes[offset / 8] == Eightbyte::None) classes[offset / 8] = Eightbyte::SSE;
+    } else {
+        classes[offset / 8] = Eightbyte::Integer;
+    }
+}
+
+CodeGenerator::ValueABI CodeGenerator::classify(llvm::StructType* type)
+{
+    ValueABI abi;
+    abi.kind = ValueABI::Kind::Memory;
+    abi.type = type;
+    auto TM = targetMachine();
+    if (!TM) return abi;
+    auto& triple = TM->getTargetTriple();
+    if (triple.getArch() != llvm::Triple::x86_64 || triple.isOSWindows()) return abi;
+    auto& DL = TheModule->getDataLayout();
+    uint64_t size = DL.getTypeAllocSize(type);
+    if (size > 16) return abi;
+    if (size == 0) {
+        abi.kind = ValueABI::Kind::Ignore;
+        return abi;
+    }
+    Eightbyte classes[2] = { Eightbyte::None, Eightbyte::None };
+    classifyEightbytes(DL, type, 0, classes);
+    std::vector<llvm::Type*> registers;
+    for (uint64_t offset = 0; offset < size; offset += 8) {
+        // The last register is only as wide as what is left of the class.
+        // Two floats are passed as a double, the bits are the same.
+        auto bytes = std::min<uint64_t>(8, size - offset);
+        if (classes[offset / 8] == Eightbyte::SSE) {
+            registers.push_back(bytes <= 4 ? Builder.getFloatTy() : Builder.getDoubleTy());
+            abi.sseRegs++;
+        } else {
+            registers.push_back(Builder.getIntNTy(bytes * 8));
+            abi.intRegs++;
+        }
+    }
+    abi.kind = ValueABI::Kind::Direct;
+    abi.coerced = registers.size() == 1 ? registers[0] : llvm::StructType::get(context(), registers);
+    return abi;
+}
+
+llvm::Value* CodeGenerator::loadCoerced(llvm::Value* address, const ValueABI& abi)
+{
+    // the registers may be wider aligned than the class
+    llvm::MaybeAlign align(TheModule->getDataLayout().getABITypeAlignment(abi.type));
+    auto ptr = Builder.CreatePointerCast(address, llvm::PointerType::getUnqual(abi.coerced));
+    return Builder.CreateAlignedLoad(abi.coerced, ptr, align);
+}
+
+void CodeGenerator::storeCoerced(llvm::Value* value, llvm::Value* address, const ValueABI& abi)
+{
+    llvm::MaybeAlign align(TheModule->getDataLayout().getABITypeAlignment(abi.type));
+    auto ptr = Builder.CreatePointerCast(address, llvm::PointerType::getUnqual(abi.coerced));
+    Builder.CreateAlignedStore(value, ptr, align);
+}
+
+llvm::Function* CodeGenerator::createFunction(const std::string& name,
+                                              const std::vector<std::pair<Parse::Type*, std::string>>& args,
+                                              Parse::Type* returnType, Parse::Type* classType)
+{
+    FunctionABI abi;
+    // the SysV argument registers, a class that doesn't fit in those left
+    // goes on the stack as a whole
+    unsigned intRegs = 6, sseRegs = 8;
+    auto retType = getType(returnType);
+    std::vector<llvm::Type*> ArgT;
+    if (dynamic_cast<Parse::CompoundType*>(returnType)) {
+        abi.result = classify(static_cast<llvm::StructType*>(retType));
+        if (abi.result.kind == ValueABI::Kind::Direct) {
+            retType = abi.result.coerced;
+        } else {
+            retType = llvm::Type::getVoidTy(context());
+        }
+        if (abi.result.kind == ValueABI::Kind::Memory) {
+            ArgT.push_back(llvm::PointerType::getUnqual(abi.result.type));
+            intRegs--;
+        }
+    }
+    if (classType) {
+        ValueABI self;
+        self.type = llvm::PointerType::getUnqual(getType(classType));
+        ArgT.push_back(self.type);
+        intRegs--;
+        abi.args.emplace_back(self, "this");
+    }
+    for (auto& arg : args) {
+        ValueABI a;
+        a.type = getType(arg.first);
+        if (dynamic_cast<Parse::CompoundType*>(arg.first)) {
+            a = classify(static_cast<llvm::StructType*>(a.type));
+            if (a.kind == ValueABI::Kind::Direct && (a.intRegs > intRegs || a.sseRegs > sseRegs))
+                a.kind = ValueABI::Kind::Memory;
+        }
+        switch (a.kind) {
+        case ValueABI::Kind::Value:
+            ArgT.push_back(a.type);
+            if (a.type->isFloatingPointTy() && sseRegs) sseRegs--;
+            else if ((a.type->isIntegerTy() || a.type->isPointerTy()) && intRegs) intRegs--;
+            break;
+        case ValueABI::Kind::Direct:
+            if (auto s = llvm::dyn_cast<llvm::StructType>(a.coerced))
+                ArgT.insert(ArgT.end(), s->element_begin(), s->element_end());
+            else
+                ArgT.push_back(a.coerced);
+            intRegs -= a.intRegs;
+            sseRegs -= a.sseRegs;
+            break;
+        case ValueABI::Kind::Memory:
+            ArgT.push_back(llvm::PointerType::getUnqual(a.type));
+            break;
+        case ValueABI::Kind::Ignore:
+            break;
+        }
+        abi.args.emplace_back(a, arg.second);
+    }
+    auto FT = llvm::FunctionType::get(retType, ArgT, false);
+    auto Func = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, name, *TheModule);
+    auto arg = Func->arg_begin();
+    if (abi.result.kind == ValueABI::Kind::Memory) {
+        Func->addParamAttr(0, llvm::Attribute::StructRet);
+        Func->addParamAttr(0, llvm::Attribute::NoAlias);
+        (arg++)->setName("result");
+    }
+    for (auto& a : abi.args) {
+        switch (a.first.kind) {
+        case ValueABI::Kind::Value:
+            (arg++)->setName(a.second);
+            break;
+        case ValueABI::Kind::Direct:
+            if (a.first.coerced->isStructTy()) {
+                (arg++)->setName(a.second + ".coerce0");
+                (arg++)->setName(a.second + ".coerce1");
+            } else {
+                (arg++)->setName(a.second + ".coerce");
+            }
+            break;
+        case ValueABI::Kind::Memory:
+            Func->addParamAttr(arg->getArgNo(), llvm::Attribute::ByVal);
+            Func->addParamAttr(arg->getArgNo(), llvm::Attribute::getWithAlignment(context(), llvm::Align(8)));
+            (arg++)->setName(a.second + ".byval");
+            break;
+        case ValueABI::Kind::Ignore:
+            break;
+        }
+    }
+    abi_[Func] = std::move(abi);
+    return Func;
+}
+
+void CodeGenerator::beginFunction(llvm::Function* func)
+{
+    auto& abi = abi_[func];
+    auto arg = func->arg_begin();
+    switch (abi.result.kind) {
+    case ValueABI::Kind::Memory:
+        returnSlots_[func] = arg++;
+        break;
+    case ValueABI::Kind::Direct:
+    case ValueABI::Kind::Ignore:
+        returnSlots_[func] = createLocal(abi.result.type, "result");
+        break;
+    default:
+        break;
+    }
+    for (auto& a : abi.args) {
+        auto alloc = createLocal(a.first.type, a.second);
+        switch (a.first.kind) {
+        case ValueABI::Kind::Value:
+            Builder.CreateStore(arg++, alloc);
+            break;
+        case ValueABI::Kind::Direct:
+            if (auto s = llvm::dyn_cast<llvm::StructType>(a.first.coerced)) {
+                llvm::Value* value = llvm::UndefValue::get(s);
+                value = Builder.CreateInsertValue(value, arg++, 0);
+                value = Builder.CreateInsertValue(value, arg++, 1);
+                storeCoerced(value, alloc, a.first);
+            } else {
+                storeCoerced(arg++, alloc, a.first);
+            }
+            break;
+        case ValueABI::Kind::Memory:
+            // the copy is the caller's, the argument becomes an ordinary local
+            Builder.CreateStore(Builder.CreateLoad(arg++), alloc);
+            break;
+        case ValueABI::Kind::Ignore:
+            break;
+        }
+        st_.setAlloc(a.second, alloc);
+    }
+}
+
+llvm::Value* CodeGenerator::returnSlot()
+{
+    return returnSlots_.lookup(Builder.GetInsertBlock()->getParent());
+}
+
+llvm::ReturnInst* CodeGenerator::createReturn(llvm::Value* value)
+{
+    auto F = Builder.GetInsertBlock()->getParent();
+    auto it = abi_.find(F);
+    if (it == abi_.end() || it->second.result.kind == ValueABI::Kind::Value) return Builder.CreateRet(value);
+    if (it->second.result.kind != ValueABI::Kind::Direct) return Builder.CreateRetVoid();
+    return Builder.CreateRet(loadCoerced(returnSlots_.lookup(F), it->second.result));
+}
+
+llvm::CallInst* CodeGenerator::createCall(llvm::Function* func, llvm::ArrayRef<llvm::Value*> args, llvm::Value* slot)
+{
+    auto it = abi_.find(func);
+    if (it == abi_.end()) return Builder.CreateCall(func, args);
+    auto& abi = it->second;
+    std::vector<llvm::Value*> argv;
+    std::vector<unsigned> byval;
+    if (abi.result.kind == ValueABI::Kind::Memory) argv.push_back(slot);
+    for (size_t i = 0; i < args.size(); ++i) {
+        // this included
+        auto& a = abi.args[i].first;
+        switch (a.kind) {
+        case ValueABI::Kind::Value:
+            argv.push_back(args[i]);
+            break;
+        case ValueABI::Kind::Direct: {
+            auto temp = createLocal(a.type, "coerce");
+            Builder.CreateStore(args[i], temp);
+            auto value = loadCoerced(temp, a);
+            if (a.coerced->isStructTy()) {
+                argv.push_back(Builder.CreateExtractValue(value, 0));
+                argv.push_back(Builder.CreateExtractValue(value, 1));
+            } else {
+                argv.push_back(value);
+            }
+            break;
+        }
+        case ValueABI::Kind::Memory: {
+            auto temp = createLocal(a.type, "byval");
+            temp->setAlignment(llvm::MaybeAlign(8));
+            Builder.CreateStore(args[i], temp);
+            byval.push_back(argv.size());
+            argv.push_back(temp);
+            break;
+        }
+        case ValueABI::Kind::Ignore:
+            break;
+        }
+    }
+    auto call = Builder.CreateCall(func, argv);
+    if (abi.result.kind == ValueABI::Kind::Memory) call->addParamAttr(0, llvm::Attribute::StructRet);
+    for (auto i : byval) {
+        call->addParamAttr(i, llvm::Attribute::ByVal);
+        call->addParamAttr(i, llvm::Attribute::getWithAlignment(context(), llvm::Align(8)));
+    }
+    if (abi.result.kind == ValueABI::Kind::Direct) storeCoerced(call, slot, abi.result);
+    return call;
+}
+
+llvm::Function* CodeGenerator::getFunction(Parse::FunctionType* fn)
+{
+    // Class::new() is only declared when first called, generateIR() gives
+    // it a body
+    return declareFunction(fn);
+}
+
+void CodeGenerator::callDestructors(const Parse::ASTContext::Destructibles& vars)
+{
+    for (auto& v : vars) {
+        auto alloc = st_.getAlloc(v.second);
+        if (alloc == nullptr) {
+            std::cout << "Unknown variable name: " << v.second << "." << std::endl;
+            continue;
+        }
+        // unused, but VariableExprAST loads the object before the call too
+        auto value = Builder.CreateLoad(alloc);
+        if (auto rc = Parse::asRefCounted(v.first)) {
+            release(value, rc);
+            continue;
+        }
+        auto type = static_cast<Parse::CompoundType*>(v.first);
+        Builder.CreateCall(getFunction(type->getDestructor()), { alloc });
+    }
+}
+
+llvm::AllocaInst* CodeGenerator::createLocal(llvm::Type* type, const llvm::Twine& name)
+{
+    auto F = Builder.GetInsertBlock()->getParent();
+    auto& entry = F->getEntryBlock();
+    auto& last = lastLocal_[F];
+    llvm::IRBuilder<> TmpB(&entry, last ? std::next(last->getIterator()) : entry.begin());
+    last = TmpB.CreateAlloca(type, nullptr, name);
+    st_.addLocal(last);
+    if (optLevel_ != OptLevel::O0) Builder.CreateLifetimeStart(last);
+    return last;
+}
+
+void CodeGenerator::endLifetimes(llvm::ArrayRef<llvm::AllocaInst*> locals)
+{
+    auto BB = Builder.GetInsertBlock();
+    if (optLevel_ == OptLevel::O0 || !BB || BB->getTerminator()) return;
+    for (auto it = locals.rbegin(); it != locals.rend(); ++it) {
+        // a function emitted in the middle of another one has scopes of its own
+        if ((*it)->getFunction() == BB->getParent()) Builder.CreateLifetimeEnd(*it);
+    }
+}
+
+std::string CodeGenerator::newFunctionName(Parse::Type* type)
 {
+    Parse::FunctionType fn("new", {}, nullptr, nullptr);
+    fn.setNamespaceHierarchy(
+        context_.symbolTable().getNestedNamespace(type->getNamespaceHierarchy(), type->getTypename()));
+    return fn.mangledName();
+}
+
+std::string CodeGenerator::deleteFunctionName(Parse::Type* type)
+{
+    auto& st = context_.symbolTable();
+    Parse::FunctionType fn("delete", { { st.getType("__ptr", { type }), "p" } }, nullptr, nullptr);
+    fn.setNamespaceHierarchy(st.getNestedNamespace(type->getNamespaceHierarchy(), type->getTypename()));
+    return fn.mangledName();
+}
+
+// the size of classType as an i32, computed as the offset of the second
+// element of a null Class*
+llvm::Value* CodeGenerator::sizeOf(llvm::Type* classType)
+{
+    std::vector<llvm::Value*> index;
+    index.push_back(llvm::ConstantInt::get(context(), llvm::APInt(32, 1)));
+    auto size = Builder.CreateGEP(llvm::Constant::getNullValue(llvm::PointerType::get(classType, 0)), index);
+    return Builder.CreateCast(llvm::Instruction::CastOps::PtrToInt, size, llvm::Type::getInt32Ty(context()));
+}
+
+llvm::FunctionCallee CodeGenerator::runtimeAlloc()
+{
+    return TheModule->getOrInsertFunction("__rcpp_alloc", llvm::Type::getInt8PtrTy(context()),
+                                          llvm::Type::getInt32Ty(context()));
+}
+
+llvm::FunctionCallee CodeGenerator::runtimeFree()
+{
+    return TheModule->getOrInsertFunction("__rcpp_free", llvm::Type::getVoidTy(context()),
+                                          llvm::Type::getInt8PtrTy(context()), llvm::Type::getInt32Ty(context()));
+}
+
+// Class::new() is __rcpp_alloc(sizeof(Class)), see Runtime/Alloc.h.
+void CodeGenerator::defineNewFunction(llvm::Function* func, llvm::Type* classType)
+{
+    auto BB = llvm::BasicBlock::Create(context(), "entry", func);
+    Builder.SetInsertPoint(BB);
+    auto retVal = Builder.CreateCall(runtimeAlloc(), { sizeOf(classType) });
+    Builder.CreateRet(Builder.CreatePointerCast(retVal, func->getReturnType()));
+    optimizeFunction(*func);
+}
+
+// Class::delete(p) destroys *p, unless p is null, and hands the memory back
+// with __rcpp_free(p, sizeof(Class)).
+void CodeGenerator::defineDeleteFunction(llvm::Function* func, Parse::CompoundType* type)
+{
+    auto BB = llvm::BasicBlock::Create(context(), "entry", func);
+    auto DeleteBB = llvm::BasicBlock::Create(context(), "delete", func);
+    auto RetBB = llvm::BasicBlock::Create(context(), "ret", func);
+    llvm::Value* p = func->arg_begin();
+    Builder.SetInsertPoint(BB);
+    Builder.CreateCondBr(Builder.CreateIsNull(p), RetBB, DeleteBB);
+    Builder.SetInsertPoint(DeleteBB);
+    if (auto destructor = type->getDestructor()) Builder.CreateCall(getFunction(destructor), { p });
+    Builder.CreateCall(runtimeFree(), { Builder.CreatePointerCast(p, llvm::Type::getInt8PtrTy(context())), sizeOf(getType(type)) });
+    Builder.CreateBr(RetBB);
+    Builder.SetInsertPoint(RetBB);
+    Builder.CreateRetVoid();
+    optimizeFunction(*func);
+}
+
+llvm::Value* CodeGenerator::refCountedObject(llvm::Value* block)
+{
+    return Builder.CreateStructGEP(block, 1, "object");
+}
+
+llvm::Value* CodeGenerator::newRefCounted(Parse::BuiltinType* type)
+{
+    auto blockType = getType(type)->getPointerElementType();
+    auto block = Builder.CreatePointerCast(Builder.CreateCall(runtimeAlloc(), { sizeOf(blockType) }), getType(type));
+    Builder.CreateStore(llvm::ConstantInt::get(context(), llvm::APInt(64, 1)), Builder.CreateStructGEP(block, 0));
+    return block;
+}
+
+// An rc's count is only touched by the thread owning it, so it is a plain
+// load and store that the optimizer can see through. An arc's is an atomic
+// add, which needs no ordering as whoever copies it holds a reference.
+void CodeGenerator::retain(llvm::Value* block, Parse::BuiltinType* type)
+{
+    auto F = Builder.GetInsertBlock()->getParent();
+    auto RetainBB = llvm::BasicBlock::Create(context(), "retain", F);
+    auto ContBB = llvm::BasicBlock::Create(context(), "retaincont", F);
+    Builder.CreateCondBr(Builder.CreateIsNull(block), ContBB, RetainBB);
+    Builder.SetInsertPoint(RetainBB);
+    auto count = Builder.CreateStructGEP(block, 0, "count");
+    auto one = llvm::ConstantInt::get(context(), llvm::APInt(64, 1));
+    if (type->getCategory() == Parse::BuiltinType::category::Arc)
+        Builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, count, one, llvm::AtomicOrdering::Monotonic);
+    else
+        Builder.CreateStore(Builder.CreateAdd(Builder.CreateLoad(count), one), count);
+    Builder.CreateBr(ContBB);
+    Builder.SetInsertPoint(ContBB);
+}
+
+// The last arc released has to see what the other threads wrote to the
+// object before they released theirs, hence acq_rel.
+void CodeGenerator::release(llvm::Value* block, Parse::BuiltinType* type)
+{
+    auto F = Builder.GetInsertBlock()->getParent();
+    auto ReleaseBB = llvm::BasicBlock::Create(context(), "release", F);
+    auto DestroyBB = llvm::BasicBlock::Create(context(), "destroy", F);
+    auto ContBB = llvm::BasicBlock::Create(context(), "releasecont", F);
+    Builder.CreateCondBr(Builder.CreateIsNull(block), ContBB, ReleaseBB);
+    Builder.SetInsertPoint(ReleaseBB);
+    auto count = Builder.CreateStructGEP(block, 0, "count");
+    auto one = llvm::ConstantInt::get(context(), llvm::APInt(64, 1));
+    llvm::Value* last;
+    if (type->getCategory() == Parse::BuiltinType::category::Arc) {
+        auto old = Builder.CreateAtomicRMW(llvm::AtomicRMWInst::Sub, count, one,
+                                           llvm::AtomicOrdering::AcquireRelease);
+        last = Builder.CreateICmpEQ(old, one);
+    } else {
+        auto left = Builder.CreateSub(Builder.CreateLoad(count), one);
+        Builder.CreateStore(left, count);
+        last = Builder.CreateIsNull(left);
+    }
+    Builder.CreateCondBr(last, DestroyBB, ContBB);
+    Builder.SetInsertPoint(DestroyBB);
+    auto object = static_cast<Parse::CompoundType*>(type->getTemplateArgs()[0]);
+    if (auto destructor = object->getDestructor())
+        Builder.CreateCall(getFunction(destructor), { refCountedObject(block) });
+    auto blockType = getType(type)->getPointerElementType();
+    Builder.CreateCall(runtimeFree(), { Builder.CreatePointerCast(block, llvm::Type::getInt8PtrTy(context())),
+                                        sizeOf(blockType) });
+    Builder.CreateBr(ContBB);
+    Builder.SetInsertPoint(ContBB);
+}
+
+bool CodeGenerator::dumpModule()
+{
+    if (irStream_) TheModule->print(*irStream_, nullptr);
+    if (!llvmFile_.empty()) {
+        std::error_code EC;
+        llvm::raw_fd_ostream os(llvmFile_, EC, llvm::sys::fs::OF_Text);
+        if (EC) {
+            llvm::errs() << "Could not open file: " << EC.message() << "\n";
+            return false;
+        }
+        TheModule->print(os, nullptr);
+    }
+    if (!asmFile_.empty()) {
+        auto TM = targetMachine();
+        if (!TM) return false;
+        // code generation changes the IR it runs on
+        auto copy = llvm::CloneModule(*TheModule);
+        if (!emitFile(*copy, *TM, asmFile_, llvm::CGFT_AssemblyFile)) return false;
+    }
+    return true;
+}
+
+bool CodeGenerator::generate()
+{
+    {
+        TimeReport::Phase phase(report_, reportUnit_ + ": IR generation");
+        generateIR();
+    }
+    if (!cacheDir_.empty() || partitions_ > 1) {
+        if (!dumpModule()) return false;
+        // the functions and partitions are optimized on their own
+        TimeReport::Phase phase(report_, reportUnit_ + ": optimization and object code");
+        return cacheDir_.empty() ? outputPartitioned() : outputCached();
+    }
+    {
+        TimeReport::Phase phase(report_, reportUnit_ + ": module passes");
+        optimize();
+    }
+    if (!dumpModule()) return false;
+    TimeReport::Phase phase(report_, reportUnit_ + ": object code");
+    return output();
+}
+
+// same target as output() would use, but for the process' own triple
+static llvm::orc::JITTargetMachineBuilder jitTarget(const TargetConfig& config, OptLevel level)
+{
+    llvm::orc::JITTargetMachineBuilder JTMB(llvm::Triple(llvm::sys::getProcessTriple()));
+    JTMB.setCPU(config.cpu);
+    llvm::SmallVector<llvm::StringRef, 16> features;
+    llvm::StringRef(config.features).split(features, ',', -1, false);
+    JTMB.addFeatures(std::vector<std::string>(features.begin(), features.end()));
+    JTMB.setOptions(targetOptions(config));
+    JTMB.setCodeGenOptLevel(codeGenLevel(level));
+    if (config.codeModel) JTMB.setCodeModel(config.codeModel);
+    return JTMB;
+}
+
+static int jitError(llvm::Error err)
+{
+    llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "JIT: ");
+    return -1;
+}
+
+int CodeGenerator::run(const std::string& entry)
+{
+    {
+        TimeReport::Phase phase(report_, reportUnit_ + ": IR generation");
+        generateIR();
+    }
+    if (!tieredJIT_) {
+        TimeReport::Phase phase(report_, reportUnit_ + ": module passes");
+        optimize();
+    }
+    if (irStream_) TheModule->print(*irStream_, nullptr);
+    if (!targetMachine()) return -1;
+
+    auto entryFunc = TheModule->getFunction(entry);
+    if (!entryFunc) entryFunc = TheModule->getFunction("_R" + std::to_string(entry.size()) + entry);
+    if (!entryFunc || entryFunc->empty()) {
+        llvm::errs() << "Entry point not found: " << entry << "\n";
+        return -1;
+    }
+    auto retType = entryFunc->getReturnType();
+    if (entryFunc->arg_size() != 0 || !(retType->isVoidTy() || retType->isIntegerTy(32))) {
+        llvm::errs() << "Entry point must take no arguments and return i32 or void: " << entry << "\n";
+        return -1;
+    }
+    std::string symbol = entryFunc->getName().str();
+    bool returnsVoid = retType->isVoidTy();
+
+    llvm::JITTargetAddress address;
+    std::unique_ptr<llvm::orc::LLJIT> eager;
+    std::unique_ptr<TieredJIT> tiered;
+    if (tieredJIT_) {
+        // the level of the hot bodies, TieredJIT compiles tier 0 at CodeGenOpt::None
+        auto hotLevel = optLevel_ == OptLevel::O0 ? OptLevel::O2 : optLevel_;
+        auto J = TieredJIT::create(jitTarget(target_, hotLevel), passBuilderLevel(hotLevel));
+        if (!J) return jitError(J.takeError());
+        tiered = std::move(*J);
+        if (auto err = tiered->addModule(std::move(TheModule), std::move(TheContext))) return jitError(std::move(err));
+        auto sym = tiered->lookup(symbol);
+        if (!sym) return jitError(sym.takeError());
+        address = *sym;
+    } else {
+        auto J = llvm::orc::LLJITBuilder().setJITTargetMachineBuilder(jitTarget(target_, optLevel_)).create();
+        if (!J) return jitError(J.takeError());
+        eager = std::move(*J);
+        auto process = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            eager->getDataLayout().getGlobalPrefix());
+        if (!process) return jitError(process.takeError());
+        eager->getMainJITDylib().addGenerator(std::move(*process));
+        if (auto err = defineRuntime(*eager)) return jitError(std::move(err));
+        if (auto err = eager->addIRModule(llvm::orc::ThreadSafeModule(std::move(TheModule), std::move(TheContext))))
+            return jitError(std::move(err));
+        auto sym = eager->lookup(symbol);
+        if (!sym) return jitError(sym.takeError());
+        address = sym->getAddress();
+    }
+    int result = 0;
+    if (returnsVoid) reinterpret_cast<void (*)()>(address)();
+    else result = reinterpret_cast<int (*)()>(address)();
+    if (tiered && report_) report_->counter(reportUnit_ + ": functions tiered up", tiered->tieredUp());
+    return result;
+}
+
+void CodeGenerator::generateIR()
+{
+    if (directLowering_) {
+        // Everything else was emitted during convertToLLVM(). The new()
+        // and delete() functions go last, in class order, as in the
+        // ExprAST path.
+        auto moveToEnd = [&](const std::string& name, llvm::FunctionType* FT) {
+            auto Func = TheModule->getFunction(name);
+            if (Func && Func->empty()) {
+                Func->removeFromParent();
+                TheModule->getFunctionList().push_back(Func);
+            } else {
+                Func = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, name, *TheModule);
+            }
+            return Func;
+        };
+        for (auto c : context_.classTypes()) {
+            // imported classes only have the declarations
+            if (c->isImported()) continue;
+            auto ptrType = llvm::PointerType::getUnqual(getType(c));
+            defineNewFunction(moveToEnd(newFunctionName(c), llvm::FunctionType::get(ptrType, false)), getType(c));
+            auto deleteType = llvm::FunctionType::get(llvm::Type::getVoidTy(context()), { ptrType }, false);
+            auto Func = moveToEnd(deleteFunctionName(c), deleteType);
+            Func->arg_begin()->setName("p");
+            defineDeleteFunction(Func, c);
+        }
+        return;
+    }
     for(auto& c: *context_.Class())
     {
-        c->generateCode(*this)->print(llvm::errs());
-        std::cout << std::endl;
+        c->generateCode(*this);
     }
     for(auto& p: *context_.Prototype())
     {
-        p->generateCode(*this)->print(llvm::errs());
+        p->generateCode(*this);
     }
     for (auto& c : *context_.Class()) {
-        c->generateFunction_new(*this)->print(llvm::errs());
-        std::cout << std::endl;
+        c->generateFunction_new(*this);
+        c->generateFunction_delete(*this);
     }
-    //for (auto& c : context_.Classes()) {
-    //    c->generateFunction_new(*this)->print(llvm::errs());
-    //}
     for(auto& f: *context_.Function())
     {
-        f->generateCode(*this)->print(llvm::errs());
+        f->generateCode(*this);
     }
-    output();
 }
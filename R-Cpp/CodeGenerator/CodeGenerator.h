@@ -1,17 +1,41 @@
 #pragma once
+#include <map>
 #include <memory>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
-#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Target/TargetMachine.h"
 
 #include "../Parser/Parser.h"
+#include "../Util/TimeReport.h"
 #include "SymbolTable.h"
 
 namespace CG {
     class SymbolTable;
 
+    enum class OptLevel
+    {
+        O0, O1, O2, O3, Os
+    };
+
+    // What the object code is generated for, the driver's -mcpu/-march,
+    // -mattr, -ffast-math, -fPIC/-fno-pic and -mcmodel options.
+    struct TargetConfig
+    {
+        std::string cpu = "generic";    // "native" picks the host CPU and its features
+        std::string features;           // "+avx2,-fma", on top of the CPU's own
+        bool fastMath = false;
+        llvm::Optional<llvm::Reloc::Model> relocModel;
+        llvm::Optional<llvm::CodeModel::Model> codeModel;
+    };
+
     class CodeGenerator
     {
     public:
@@ -21,33 +45,211 @@ namespace CG {
         llvm::IRBuilder<>& builder();
         llvm::Function* getFunction(const std::string& Callee);
         llvm::Module& getModule();
-        llvm::legacy::FunctionPassManager* FPM();
 
-        void generate();
-        void output();
+        // Writes the object file, false if that failed.
+        bool generate();
+        // Compiles the module in memory instead of writing an object file and
+        // calls entry, a function without parameters returning i32 or
+        // void, given by its source name or mangled name. external:
+        // functions resolve against the running process. Returns what
+        // entry returns (0 for void) or -1 if it couldn't be run. The
+        // module is handed over to the JIT, nothing can be emitted after.
+        // With enableTieredJIT() see TieredJIT.h.
+        int run(const std::string& entry);
+        void generateIR();
+        // runs the module pipeline of the optimization level, if any
+        void optimize();
+        bool output();
+        // where generate() writes the object, output.o by default
+        void setOutputFile(std::string filename);
+        // generate() and run() print the IR to os before compiling it,
+        // nothing by default
+        void setIRStream(llvm::raw_ostream* os);
+        // generate() also writes the IR as text and the assembly there.
+        // With partitions or a cache directory the module is only
+        // optimized per function at that point, as it is split afterwards.
+        void setLLVMOutputFile(std::string filename);
+        void setAsmOutputFile(std::string filename);
+        // Set before convertToLLVM(). Records the phases of generate() and
+        // run() as "<unit>: <phase>", the functions emitted, the functions
+        // that tiered up in run() with the tiered JIT and, if the report
+        // times passes, the passes run on this thread.
+        void setTimeReport(TimeReport* report, std::string unit);
+        TimeReport* timeReport() const { return report_; }
+
+        // Set before convertToLLVM(). Above O0 each function goes through
+        // a cheap cleanup pipeline (mem2reg, instcombine, reassociate, GVN,
+        // simplifycfg) as soon as it is complete, and optimize() runs
+        // LLVM's default module pipeline for the level (inlining, SROA,
+        // LICM, unrolling, vectorisation) over the whole module.
+        void setOptimizationLevel(OptLevel level);
+        OptLevel optimizationLevel() const;
+        // Called on every function once it is complete: records the target
+        // attributes on it and runs the cleanup pipeline. Clears the
+        // builder's insertion point.
+        void optimizeFunction(llvm::Function& func);
+        // Set before convertToLLVM() and before the first targetMachine().
+        void setTargetConfig(TargetConfig config);
+        const TargetConfig& targetConfig() const;
+        // created on first use, also sets the module's triple and data layout
+        llvm::TargetMachine* targetMachine();
+
+        // Lower the Parse:: tree straight to IR during convertToLLVM()
+        // instead of going through ExprAST, see Parser/Lowering.cpp.
+        void enableDirectLowering();
+        // Split the module into n partitions that are optimized and
+        // compiled in parallel by generate(), each in a context of its own.
+        // The objects are merged into the output file with ld -r, which is
+        // required.
+        // Inlining doesn't cross partitions.
+        void setCodegenPartitions(unsigned n);
+        // Keep object code in dir, for chunks of consecutive functions
+        // keyed by hashes of their IR and of what they depend on, and only
+        // compile the chunks that are not there. generate() then merges the
+        // objects into the output file with ld -r. Above O0 a function is
+        // optimized together with the bodies it calls, so changing a
+        // function recompiles its callers too. Takes precedence over
+        // setCodegenPartitions(). An object is touched whenever a build
+        // reuses it, and objects left untouched for 30 days are removed, so
+        // the directory holds what recent builds used. With -ftime-report
+        // the functions taken from it are counted.
+        void setCacheDirectory(std::string dir);
+        // Set before convertToLLVM(). run() compiles functions lazily,
+        // unoptimized, and recompiles hot ones at the optimization level
+        // (-O2 if it is -O0) instead of optimizing everything up front.
+        void enableTieredJIT();
+        llvm::Type* getType(Parse::Type* type);
+        llvm::StructType* declareClass(Parse::CompoundType* type);
+        llvm::Function* declareFunction(Parse::FunctionType* fn);
+        // Classes are passed and returned the way C passes structs, so
+        // external: functions and C callers agree with us. On x86-64
+        // outside Windows that is the SysV classification: a class of up to
+        // 16 bytes travels in registers, one per eightbyte, a larger one
+        // (or one there are no registers left for) in memory. Elsewhere
+        // classes always go through memory. A class returned in memory is
+        // built in storage of the caller, its slot, passed as a hidden
+        // first argument (sret) before this, so a temporary or a variable
+        // being initialised is built in place. A class argument in memory
+        // is a byval copy.
+        llvm::Function* createFunction(const std::string& name,
+                                       const std::vector<std::pair<Parse::Type*, std::string>>& args,
+                                       Parse::Type* returnType, Parse::Type* classType);
+        // With the builder at the entry block of func, puts its arguments
+        // in locals of their names and sets up its slot.
+        void beginFunction(llvm::Function* func);
+        // Where the function being emitted builds the class it returns,
+        // nullptr if it doesn't return one. That is the caller's storage
+        // for sret, a local otherwise.
+        llvm::Value* returnSlot();
+        // ret value, or the slot's class for a function returning one
+        llvm::ReturnInst* createReturn(llvm::Value* value);
+        // Calls func with its arguments as createFunction() passes them. If
+        // func returns a class it ends up in slot.
+        llvm::CallInst* createCall(llvm::Function* func, llvm::ArrayRef<llvm::Value*> args, llvm::Value* slot);
+        llvm::Function* getFunction(Parse::FunctionType* fn);
+        void callDestructors(const Parse::ASTContext::Destructibles& vars);
+        // Storage for a local, an argument or a temporary of the function
+        // being emitted. The alloca goes to the entry block, after those
+        // created before it, so mem2reg promotes it even if it is declared
+        // in a loop. Above O0 its lifetime starts at the insertion point
+        // and ends with the scope of the symbol table it was created in.
+        llvm::AllocaInst* createLocal(llvm::Type* type, const llvm::Twine& name = "");
+        // lifetime.end for locals whose scope is over, if the block is
+        // still open
+        void endLifetimes(llvm::ArrayRef<llvm::AllocaInst*> locals);
+
+        // rc<T> and arc<T> point to a block from the runtime holding the
+        // count, an i64, followed by the T. They may be null.
+        llvm::Value* refCountedObject(llvm::Value* block);
+        // a block with a count of one, the T is left to be built
+        llvm::Value* newRefCounted(Parse::BuiltinType* type);
+        void retain(llvm::Value* block, Parse::BuiltinType* type);
+        // destroys the T and frees the block if that was the last reference
+        void release(llvm::Value* block, Parse::BuiltinType* type);
+
+        std::string newFunctionName(Parse::Type* type);
+        std::string deleteFunctionName(Parse::Type* type);
+        void defineNewFunction(llvm::Function* func, llvm::Type* classType);
+        void defineDeleteFunction(llvm::Function* func, Parse::CompoundType* type);
 
         SymbolTable& symbol() { return st_; }
 
         llvm::Type* getBuiltinType(const std::string& name);
         llvm::Value* getBuiltinTypeDefaultValue(const std::string& name);
-        llvm::Type* getType(const std::string& name)
-        {
-            return symbol().getType(name);
-        }
-        llvm::Type* getPtrTypeOf(const std::string& name)
+    private:
+        // how a value crosses a call, see createFunction()
+        struct ValueABI
         {
-            return llvm::PointerType::getUnqual(getType(name));
-        }
-        llvm::Type* getArrayTypeOf(const std::string& name,int count)
+            enum class Kind
+            {
+                Value,      // as its own type, anything but a class
+                Ignore,     // an empty class, nothing is passed
+                Direct,     // in registers
+                Memory      // sret or byval
+            };
+            Kind kind = Kind::Value;
+            llvm::Type* type = nullptr;
+            // Direct: the registers, a scalar or a struct of two
+            llvm::Type* coerced = nullptr;
+            unsigned intRegs = 0;
+            unsigned sseRegs = 0;
+        };
+        struct FunctionABI
         {
-            return llvm::ArrayType::get(getType(name), count);
-        }
-    private:
+            ValueABI result;
+            // this included, with their names
+            std::vector<std::pair<ValueABI, std::string>> args;
+        };
+        ValueABI classify(llvm::StructType* type);
+        // the class at address as the registers of abi, and back
+        llvm::Value* loadCoerced(llvm::Value* address, const ValueABI& abi);
+        void storeCoerced(llvm::Value* value, llvm::Value* address, const ValueABI& abi);
+        void setupPasses();
+        llvm::Value* sizeOf(llvm::Type* classType);
+        // __rcpp_alloc and __rcpp_free, see Runtime/Alloc.h
+        llvm::FunctionCallee runtimeAlloc();
+        llvm::FunctionCallee runtimeFree();
+        // a new one for each user, unlike targetMachine()
+        std::unique_ptr<llvm::TargetMachine> createTargetMachine() const;
+        // the IR stream and the .ll and .s files, false if one failed
+        bool dumpModule();
+        bool outputPartitioned();
+        bool outputCached();
+        // optimizes and compiles the bitcode modules parts[i] to objects[i]
+        // on as many threads as there are cores
+        bool compileParts(const std::vector<llvm::SmallString<0>>& parts,
+                          const std::vector<std::string>& objects) const;
+
         Parse::ASTContext& context_;
-        llvm::LLVMContext TheContext;
+        std::unique_ptr<llvm::LLVMContext> TheContext;
         llvm::IRBuilder<> Builder;
         std::unique_ptr<llvm::Module> TheModule;
-        std::unique_ptr<llvm::legacy::FunctionPassManager> TheFPM;
         SymbolTable st_;
+        bool directLowering_;
+        bool tieredJIT_;
+        unsigned partitions_;
+        std::string cacheDir_;
+        std::string output_;
+        llvm::raw_ostream* irStream_;
+        std::string llvmFile_;
+        std::string asmFile_;
+        TimeReport* report_;
+        std::string reportUnit_;
+        OptLevel optLevel_;
+        TargetConfig target_;
+        // the last local createLocal() put in each function's entry block
+        llvm::DenseMap<llvm::Function*, llvm::AllocaInst*> lastLocal_;
+        // of the functions from createFunction()
+        llvm::DenseMap<llvm::Function*, FunctionABI> abi_;
+        llvm::DenseMap<llvm::Function*, llvm::Value*> returnSlots_;
+        std::unique_ptr<llvm::TargetMachine> TheTargetMachine;
+        bool targetLookedUp_;
+        // new pass manager state, set up by the first optimizeFunction()
+        std::unique_ptr<llvm::PassBuilder> PB;
+        llvm::LoopAnalysisManager LAM;
+        llvm::FunctionAnalysisManager FAM;
+        llvm::CGSCCAnalysisManager CGAM;
+        llvm::ModuleAnalysisManager MAM;
+        llvm::FunctionPassManager FPM;
     };
 }
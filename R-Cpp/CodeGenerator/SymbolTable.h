@@ -1,39 +1,30 @@
 #pragma once
-#include <map>
+#include <string_view>
+#include <vector>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Instructions.h>
+#include "../Parser/SymbolMap.h"
 
 namespace CG {
     class CodeGenerator;
 
-    struct ClassSymbol
-    {
-        ClassSymbol():type(nullptr)
-        { }
-
-        ClassSymbol(llvm::Type* type)
-            :type(type)
-        {}
-
-        llvm::Type* type;
-        // <type, name>
-        std::vector<std::pair<std::string, std::string>> members;
-    };
-
     class SymbolTable
     {
     public:
         SymbolTable(CodeGenerator&cg):cg_(cg)
         {
             createScope();
-            generateBuiltinType();
         }
         void createScope() {
-            var_map_.emplace_back();
+            var_map_.pushScope();
+            scopes_.push_back(locals_.size());
         }
-        void destroyScope() {
-            var_map_.pop_back();
+        // ends the lifetimes of the locals of the scope, see
+        // CodeGenerator::createLocal()
+        void destroyScope();
+        void addLocal(llvm::AllocaInst* alloc) {
+            locals_.push_back(alloc);
         }
 
         class ScopeGuard
@@ -52,54 +43,35 @@ namespace CG {
             SymbolTable& st_;
         };
 
-        llvm::AllocaInst* getAlloc(const std::string& name)
+        llvm::AllocaInst* getAlloc(std::string_view name)
         {
-            for(auto it=var_map_.rbegin();it!=var_map_.rend();++it)
-            {
-                auto iterator = it->find(name);
-                if (iterator != it->end()) return iterator->second;
-            }
-            return nullptr;
+            auto alloc = var_map_.find(names_.find(name));
+            return alloc ? *alloc : nullptr;
         }
 
-        void setAlloc(const std::string& name,llvm::AllocaInst* alloc)
+        void setAlloc(std::string_view name,llvm::AllocaInst* alloc)
         {
-            var_map_.back()[name] = alloc;
+            var_map_.bind(names_.internCopy(name), alloc);
         }
 
-        llvm::Function* getFunction(const std::string& name)
+        llvm::Function* getFunction(std::string_view name)
         {
-            return function_map_[name];
+            auto func = function_map_.find(names_.find(name));
+            return func ? *func : nullptr;
         }
 
-        void setFunction(const std::string& name,llvm::Function* func)
+        void setFunction(std::string_view name,llvm::Function* func)
         {
-            function_map_[name] = func;
-        }
-
-        llvm::Type* getType(const std::string& name);
-
-        void setType(const std::string& name,llvm::StructType* type)
-        {
-            class_map_[name].type = type;
-        }
-
-        const ClassSymbol& getClass(const std::string& name)
-        {
-            return class_map_[name];
-        }
-
-        void setClass(const std::string& name, ClassSymbol symbol)
-        {
-            class_map_[name] = symbol;
+            function_map_[names_.internCopy(name)] = func;
         }
 
     private:
-        void generateBuiltinType();
-
         CodeGenerator& cg_;
-        std::map<std::string, llvm::Function*> function_map_;
-        std::map<std::string, ClassSymbol> class_map_;
-        std::vector<std::map<std::string, llvm::AllocaInst*>> var_map_;
+        StringTable names_;
+        SymbolMap<llvm::Function*> function_map_;
+        ScopedSymbolMap<llvm::AllocaInst*> var_map_;
+        // the locals of the open scopes, scopes_ has where each one starts
+        std::vector<llvm::AllocaInst*> locals_;
+        std::vector<size_t> scopes_;
     };
 }
@@ -0,0 +1,203 @@
+#include "TieredJIT.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Support/raw_ostream.h"
+#include "../Runtime/Alloc.h"
+
+using namespace CG;
+
+llvm::Error CG::defineRuntime(llvm::orc::LLJIT& jit)
+{
+    llvm::orc::MangleAndInterner mangle(jit.getExecutionSession(), jit.getDataLayout());
+    auto symbol = [](auto* function) {
+        return llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(function), llvm::JITSymbolFlags::Exported);
+    };
+    llvm::orc::SymbolMap symbols;
+    symbols[mangle("__rcpp_alloc")] = symbol(&__rcpp_alloc);
+    symbols[mangle("__rcpp_free")] = symbol(&__rcpp_free);
+    return jit.getMainJITDylib().define(llvm::orc::absoluteSymbols(std::move(symbols)));
+}
+
+llvm::Expected<std::unique_ptr<TieredJIT>> TieredJIT::create(llvm::orc::JITTargetMachineBuilder JTMB,
+                                                             llvm::PassBuilder::OptimizationLevel hotLevel)
+{
+    // the hot bodies are compiled with tm at the level JTMB asks for,
+    // everything the lazy JIT compiles is tier 0 and gets no codegen
+    // optimization
+    auto tm = JTMB.createTargetMachine();
+    if (!tm) return tm.takeError();
+    JTMB.setCodeGenOptLevel(llvm::CodeGenOpt::None);
+    auto jit = llvm::orc::LLLazyJITBuilder().setJITTargetMachineBuilder(std::move(JTMB)).create();
+    if (!jit) return jit.takeError();
+
+    // external: functions come from the process, tierUp() is called by address
+    auto& JD = (*jit)->getMainJITDylib();
+    auto process = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        (*jit)->getDataLayout().getGlobalPrefix());
+    if (!process) return process.takeError();
+    JD.addGenerator(std::move(*process));
+    if (auto err = defineRuntime(**jit)) return std::move(err);
+
+    return std::unique_ptr<TieredJIT>(new TieredJIT(std::move(*jit), std::move(*tm), hotLevel));
+}
+
+TieredJIT::TieredJIT(std::unique_ptr<llvm::orc::LLLazyJIT> jit, std::unique_ptr<llvm::TargetMachine> tm,
+                     llvm::PassBuilder::OptimizationLevel hotLevel):
+    jit_(std::move(jit)), tm_(std::move(tm)), hotLevel_(hotLevel), tieredUp_(0)
+{
+    // every partition costs a copy of the module, so a thunk is compiled
+    // together with the body it is going to call
+    jit_->setPartitionFunction([](llvm::orc::CompileOnDemandLayer::GlobalValueSet requested) {
+        auto partition = requested;
+        for (auto gv : requested) {
+            auto name = gv->getName();
+            auto module = gv->getParent();
+            if (name.endswith(".t0")) partition.insert(module->getFunction(name.drop_back(3)));
+            else if (auto body = module->getFunction((name + ".t0").str())) partition.insert(body);
+        }
+        return llvm::Optional<llvm::orc::CompileOnDemandLayer::GlobalValueSet>(std::move(partition));
+    });
+}
+
+llvm::Error TieredJIT::addModule(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context)
+{
+    context_ = llvm::orc::ThreadSafeContext(std::move(context));
+    module->setDataLayout(jit_->getDataLayout());
+    original_ = llvm::CloneModule(*module);
+    instrument(*module);
+    return jit_->addLazyIRModule(llvm::orc::ThreadSafeModule(std::move(module), context_));
+}
+
+llvm::Expected<llvm::JITTargetAddress> TieredJIT::lookup(llvm::StringRef name)
+{
+    auto sym = jit_->lookup(name);
+    if (!sym) return sym.takeError();
+    return sym->getAddress();
+}
+
+// the address of host data as a constant of type ty
+static llvm::Constant* hostAddress(const void* p, llvm::Type* ty)
+{
+    auto address = llvm::ConstantInt::get(llvm::Type::getInt64Ty(ty->getContext()), reinterpret_cast<std::uintptr_t>(p));
+    return llvm::ConstantExpr::getIntToPtr(address, ty);
+}
+
+void TieredJIT::instrument(llvm::Module& module)
+{
+    auto& ctx = module.getContext();
+    llvm::IRBuilder<> builder(ctx);
+    auto i32 = llvm::Type::getInt32Ty(ctx);
+    auto tierUpType = llvm::FunctionType::get(llvm::Type::getVoidTy(ctx),
+                                              { llvm::Type::getInt8PtrTy(ctx), i32 }, false);
+    auto tierUpFn = hostAddress(reinterpret_cast<const void*>(&TieredJIT::tierUp), tierUpType->getPointerTo());
+    auto self = hostAddress(this, llvm::Type::getInt8PtrTy(ctx));
+
+    std::vector<llvm::Function*> bodies;
+    for (auto& F : module)
+        if (!F.isDeclaration()) bodies.push_back(&F);
+    // the tables are never resized, the code holds their addresses
+    hotBodies_.assign(bodies.size(), nullptr);
+    calls_.assign(bodies.size(), 0);
+
+    for (auto F : bodies) {
+        auto name = F->getName().str();
+        auto id = static_cast<std::uint32_t>(names_.size());
+        names_.push_back(name);
+
+        // f becomes a thunk, the body moves to f.t0
+        F->setName(name + ".t0");
+        auto thunk = llvm::Function::Create(F->getFunctionType(), llvm::Function::ExternalLinkage, name, module);
+        thunk->copyAttributesFrom(F);
+        F->replaceAllUsesWith(thunk);
+        std::vector<llvm::Value*> args;
+        for (auto& arg : thunk->args()) args.push_back(&arg);
+        auto tailCall = [&](llvm::Value* callee) {
+            auto call = builder.CreateCall(F->getFunctionType(), callee, args);
+            // musttail wants the sret of a class returned on the call too
+            call->setAttributes(F->getAttributes());
+            call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+            if (call->getType()->isVoidTy()) builder.CreateRetVoid();
+            else builder.CreateRet(call);
+        };
+        auto tier0 = llvm::BasicBlock::Create(ctx, "tier0", thunk);
+        auto tier2 = llvm::BasicBlock::Create(ctx, "tier2", thunk);
+        builder.SetInsertPoint(llvm::BasicBlock::Create(ctx, "entry", thunk, tier0));
+        auto hotBody = builder.CreateLoad(hostAddress(&hotBodies_[id], F->getType()->getPointerTo()));
+        hotBody->setAtomic(llvm::AtomicOrdering::Acquire);
+        hotBody->setAlignment(llvm::Align(sizeof(void*)));
+        builder.CreateCondBr(builder.CreateIsNull(hotBody), tier0, tier2);
+        builder.SetInsertPoint(tier0);
+        tailCall(F);
+        builder.SetInsertPoint(tier2);
+        tailCall(hotBody);
+
+        // count the calls of f.t0, the hotCalls-th one tiers up. The add is
+        // atomic so that exactly one caller sees hotCalls-1 before it.
+        auto calls = hostAddress(&calls_[id], i32->getPointerTo());
+        // after the allocas, which have to stay in the entry block
+        auto& entry = F->getEntryBlock();
+        auto pos = entry.getFirstInsertionPt();
+        while (llvm::isa<llvm::AllocaInst>(*pos)) ++pos;
+        builder.SetInsertPoint(&entry, pos);
+        auto count = builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, calls, builder.getInt32(1),
+                                             llvm::AtomicOrdering::Monotonic);
+        auto hot = builder.CreateICmpEQ(count, builder.getInt32(hotCalls - 1));
+        auto then = llvm::SplitBlockAndInsertIfThen(hot, &*builder.GetInsertPoint(), false);
+        builder.SetInsertPoint(then);
+        builder.CreateCall(tierUpType, tierUpFn, { self, builder.getInt32(id) });
+    }
+}
+
+void TieredJIT::tierUp(TieredJIT* self, std::uint32_t id)
+{
+    auto& name = self->names_[id];
+    if (auto err = self->compileHot(id)) {
+        // keep running the tier 0 body
+        llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "JIT: tier-up of " + name + " failed: ");
+        return;
+    }
+    ++self->tieredUp_;
+}
+
+llvm::Error TieredJIT::compileHot(std::uint32_t id)
+{
+    auto& name = names_[id];
+    std::unique_ptr<llvm::Module> hot;
+    std::unique_ptr<llvm::MemoryBuffer> object;
+    {
+        auto lock = context_.getLock();
+        // the other functions come along as available_externally so that
+        // the inliner can use them, calls that are left go through thunks
+        llvm::ValueToValueMapTy VMap;
+        hot = llvm::CloneModule(*original_, VMap);
+        for (auto& F : *hot) {
+            if (F.isDeclaration()) continue;
+            if (F.getName() == name) F.setName(name + ".t2");
+            else F.setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+        }
+
+        llvm::LoopAnalysisManager LAM;
+        llvm::FunctionAnalysisManager FAM;
+        llvm::CGSCCAnalysisManager CGAM;
+        llvm::ModuleAnalysisManager MAM;
+        llvm::PassBuilder PB(tm_.get());
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+        PB.buildPerModuleDefaultPipeline(hotLevel_).run(*hot, MAM);
+        // tm_ is not shared with the lazy JIT, the context lock keeps
+        // concurrent tier-ups off it too
+        object = llvm::orc::SimpleCompiler(*tm_)(*hot);
+    }
+
+    if (auto err = jit_->addObjectFile(std::move(object))) return err;
+    auto body = lookup(name + ".t2");
+    if (!body) return body.takeError();
+    __atomic_store_n(&hotBodies_[id], reinterpret_cast<void*>(*body), __ATOMIC_RELEASE);
+    return llvm::Error::success();
+}
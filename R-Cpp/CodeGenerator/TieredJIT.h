@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
+
+namespace CG {
+    // Makes the runtime library (Runtime/Alloc.h) available to JIT'd code,
+    // the compiler is linked with it.
+    llvm::Error defineRuntime(llvm::orc::LLJIT& jit);
+
+    // In-memory execution with lazy, tiered compilation.
+    //
+    // Every function f of the module becomes a thunk, which all callers
+    // use, and its unoptimized body f.t0 that counts its calls. The thunk
+    // tail calls the optimized body if there is one and f.t0 otherwise.
+    // The module goes into a LLLazyJIT, so a body is only compiled when it
+    // is first called, at CodeGenOpt::None. Once f.t0 has been called
+    // hotCalls times the untouched copy of f is optimized at the hot level,
+    // compiled as f.t2 with its callees available for inlining and the
+    // codegen level of the JITTargetMachineBuilder given to create(), and
+    // published to the thunk with an atomic store. Functions that loop for long in a single call
+    // stay in tier 0, there is no on-stack replacement.
+    class TieredJIT
+    {
+    public:
+        static constexpr unsigned hotCalls = 1000;
+
+        static llvm::Expected<std::unique_ptr<TieredJIT>> create(llvm::orc::JITTargetMachineBuilder JTMB,
+                                                                 llvm::PassBuilder::OptimizationLevel hotLevel);
+
+        llvm::Error addModule(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context);
+        llvm::Expected<llvm::JITTargetAddress> lookup(llvm::StringRef name);
+
+        size_t tieredUp() const { return tieredUp_; }
+
+    private:
+        TieredJIT(std::unique_ptr<llvm::orc::LLLazyJIT> jit, std::unique_ptr<llvm::TargetMachine> tm,
+                  llvm::PassBuilder::OptimizationLevel hotLevel);
+
+        void instrument(llvm::Module& module);
+        // called from f.t0 when it gets hot
+        static void tierUp(TieredJIT* self, std::uint32_t id);
+        llvm::Error compileHot(std::uint32_t id);
+
+        std::unique_ptr<llvm::orc::LLLazyJIT> jit_;
+        // at the hot codegen level, only compileHot() uses it
+        std::unique_ptr<llvm::TargetMachine> tm_;
+        llvm::PassBuilder::OptimizationLevel hotLevel_;
+        llvm::orc::ThreadSafeContext context_;
+        // the module as it was before instrument(), hot bodies are cloned from it
+        std::unique_ptr<llvm::Module> original_;
+        // by function id, the instrumented code holds the addresses of the
+        // entries of hotBodies_ and calls_
+        std::vector<std::string> names_;
+        std::vector<void*> hotBodies_;
+        std::vector<std::uint32_t> calls_;
+        std::atomic<size_t> tieredUp_;
+    };
+}
@@ -0,0 +1,278 @@
+#include "Driver.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Parser/Parser.h"
+#include "Parser/ModuleInterface.h"
+
+namespace
+{
+    // a source file and what it is compiled to
+    struct Unit
+    {
+        enum class State
+        {
+            Pending, Done, Failed
+        };
+
+        std::string source;
+        std::string module;
+        std::string object;
+        std::unique_ptr<Parse::Parser> parser;
+        // --dump-ast and --dump-ir, printed once the unit is done
+        std::string dump;
+        // units among the inputs it imports
+        std::vector<size_t> imports;
+        State state = State::Pending;
+    };
+}
+
+// work(0), work(1), ... on up to jobs threads, started in that order
+static void parallelFor(size_t n, unsigned jobs, const std::function<void(size_t)>& work)
+{
+    std::atomic<size_t> next(0);
+    auto worker = [&] {
+        for (size_t i; (i = next++) < n;) work(i);
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < std::min<size_t>(jobs, n); ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+}
+
+static bool parse(Unit& unit, const DriverOptions& options, TimeReport* report)
+{
+    try {
+        {
+            // the parser tokenizes on demand
+            TimeReport::Phase phase(report, unit.module + ": lex and parse");
+            unit.parser = std::make_unique<Parse::Parser>(unit.source);
+            unit.parser->MainLoop();
+        }
+        if (options.dumpAST) {
+            llvm::raw_string_ostream os(unit.dump);
+            unit.parser->print(os);
+        }
+        return true;
+    }
+    catch (std::exception& e) {
+        llvm::errs() << unit.source << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+static bool compile(Unit& unit, const DriverOptions& options, TimeReport* report)
+{
+    try {
+        auto& parser = *unit.parser;
+        CG::CodeGenerator cg(parser);
+        cg.setOptimizationLevel(options.optLevel);
+        cg.setTargetConfig(options.target);
+        if (options.directLowering) cg.enableDirectLowering();
+        cg.setCodegenPartitions(options.partitions);
+        cg.setCacheDirectory(options.cacheDir);
+        cg.setOutputFile(unit.object);
+        llvm::raw_string_ostream dump(unit.dump);
+        if (options.dumpIR) cg.setIRStream(&dump);
+        if (options.emitLLVM) cg.setLLVMOutputFile(unit.module + ".ll");
+        if (options.emitAsm) cg.setAsmOutputFile(unit.module + ".s");
+        cg.setTimeReport(report, unit.module);
+        {
+            TimeReport::Phase phase(report, unit.module + ": check and lower");
+            parser.convertToLLVM(options.semaThreads);
+        }
+        if (!cg.generate()) return false;
+        if (report) report->counter(unit.module + ": AST arena bytes", parser.context().arenaBytes());
+        auto interface = unit.module + Parse::ModuleInterface::extension;
+        {
+            TimeReport::Phase phase(report, unit.module + ": interface");
+            parser.writeInterface(interface);
+        }
+        return true;
+    }
+    catch (std::exception& e) {
+        llvm::errs() << unit.source << ": " << e.what() << "\n";
+        return false;
+    }
+}
+
+// units in an order where each comes after those it imports, empty if
+// there is a cycle
+static std::vector<size_t> importOrder(const std::vector<Unit>& units)
+{
+    enum { unvisited, visiting, visited };
+    std::vector<int> mark(units.size(), unvisited);
+    std::vector<size_t> order;
+    std::function<bool(size_t)> visit = [&](size_t i) {
+        if (mark[i] == visited) return true;
+        if (mark[i] == visiting) {
+            llvm::errs() << "Import cycle through " << units[i].module << "\n";
+            return false;
+        }
+        mark[i] = visiting;
+        for (auto j : units[i].imports)
+            if (!visit(j)) return false;
+        mark[i] = visited;
+        order.push_back(i);
+        return true;
+    };
+    for (size_t i = 0; i < units.size(); ++i)
+        if (!visit(i)) return {};
+    return order;
+}
+
+static bool link(const std::vector<std::string>& objects, const std::string& output, TimeReport* report)
+{
+    TimeReport::Phase phase(report, "link");
+    auto cc = llvm::sys::findProgramByName("cc");
+    if (!cc) {
+        llvm::errs() << "Could not link: cc not found\n";
+        return false;
+    }
+    std::vector<llvm::StringRef> args{ *cc, "-o", output };
+    args.insert(args.end(), objects.begin(), objects.end());
+    // Class::new() and delete() allocate through it, see Runtime/Alloc.h
+    args.push_back(RCPP_RUNTIME_LIBRARY);
+    args.push_back("-lpthread");
+    std::string error;
+    if (llvm::sys::ExecuteAndWait(*cc, args, llvm::None, {}, 0, 0, &error) == 0) return true;
+    llvm::errs() << "Could not link " << output << (error.empty() ? "" : ": ") << error << "\n";
+    return false;
+}
+
+// JSON first, printing the text resets the pass timers
+bool printTimeReport(TimeReport& report, const DriverOptions& options)
+{
+    if (!options.timeReportJSON.empty()) {
+        std::error_code EC;
+        llvm::raw_fd_ostream os(options.timeReportJSON, EC, llvm::sys::fs::OF_Text);
+        if (EC) {
+            llvm::errs() << "Could not open file: " << EC.message() << "\n";
+            return false;
+        }
+        report.printJSON(os);
+    }
+    if (options.timeReport) report.print(llvm::errs());
+    return true;
+}
+
+int compileSources(DriverOptions options)
+{
+    if (options.compileOnly && !options.output.empty() && options.sources.size() > 1) {
+        llvm::errs() << "-o with -c needs a single source file\n";
+        return -1;
+    }
+    // the executable has to be position independent if cc links a PIE
+    if (!options.compileOnly && !options.target.relocModel) options.target.relocModel = llvm::Reloc::PIC_;
+
+    std::unique_ptr<TimeReport> report;
+    if (options.timeReport || !options.timeReportJSON.empty()) {
+        // the pass timers are not thread safe
+        bool timePasses = options.jobs == 1 && options.partitions == 1 && options.cacheDir.empty();
+        if (!timePasses)
+            llvm::errs() << "note: passes are not timed with -j, --codegen-partitions or --cache-dir\n";
+        report = std::make_unique<TimeReport>(timePasses);
+    }
+    // the whole compilation, ends before the report is printed
+    llvm::Optional<TimeReport::Phase> total;
+    total.emplace(report.get(), "total");
+
+    std::vector<Unit> units(options.sources.size());
+    std::map<std::string, size_t> modules;
+    for (size_t i = 0; i < units.size(); ++i) {
+        auto& unit = units[i];
+        unit.source = options.sources[i];
+        unit.module = llvm::sys::path::stem(unit.source).str();
+        if (!modules.emplace(unit.module, i).second) {
+            llvm::errs() << "Two sources are module " << unit.module << "\n";
+            return -1;
+        }
+        if (!options.compileOnly) {
+            llvm::SmallString<128> path;
+            if (auto EC = llvm::sys::fs::createTemporaryFile(unit.module, "o", path)) {
+                llvm::errs() << "Could not create a temporary file: " << EC.message() << "\n";
+                return -1;
+            }
+            unit.object = path.str().str();
+        } else if (!options.output.empty()) {
+            unit.object = options.output;
+        } else {
+            unit.object = unit.module + ".o";
+        }
+    }
+    auto removeTemporaries = [&] {
+        if (options.compileOnly) return;
+        for (auto& unit : units) llvm::sys::fs::remove(unit.object);
+    };
+
+    parallelFor(units.size(), options.jobs, [&](size_t i) {
+        if (!parse(units[i], options, report.get())) units[i].state = Unit::State::Failed;
+    });
+    for (auto& unit : units) {
+        if (!unit.parser) continue;
+        for (auto& name : unit.parser->imports()) {
+            auto it = modules.find(name);
+            if (it != modules.end()) unit.imports.push_back(it->second);
+        }
+    }
+    auto order = importOrder(units);
+    if (order.empty()) {
+        removeTemporaries();
+        return -1;
+    }
+
+    // A unit is only started once those before it in order are, so the
+    // ones it waits for are all running or done.
+    std::mutex mutex;
+    std::condition_variable finished;
+    parallelFor(order.size(), options.jobs, [&](size_t k) {
+        auto& unit = units[order[k]];
+        bool importsDone = true;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&] {
+                for (auto j : unit.imports)
+                    if (units[j].state == Unit::State::Pending) return false;
+                return true;
+            });
+            for (auto j : unit.imports) importsDone = importsDone && units[j].state == Unit::State::Done;
+            if (unit.state == Unit::State::Failed) importsDone = false;
+        }
+        bool ok = importsDone && compile(unit, options, report.get());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            unit.state = ok ? Unit::State::Done : Unit::State::Failed;
+            llvm::outs() << unit.dump;
+            llvm::outs().flush();
+            unit.dump = std::string();
+        }
+        finished.notify_all();
+    });
+
+    bool ok = true;
+    std::vector<std::string> objects;
+    for (auto& unit : units) {
+        ok = ok && unit.state == Unit::State::Done;
+        objects.push_back(unit.object);
+    }
+    if (ok && !options.compileOnly) {
+        auto executable = options.output.empty() ? "a.out" : options.output;
+        ok = link(objects, executable, report.get());
+        if (ok) std::cout << "output to: " << executable << std::endl;
+    }
+    removeTemporaries();
+    total.reset();
+    if (report && !printTimeReport(*report, options)) ok = false;
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "CodeGenerator/CodeGenerator.h"
+
+// What the driver does with its source files, see main.cpp for the options.
+struct DriverOptions
+{
+    std::vector<std::string> sources;
+    // -c: one object per source, <source stem>.o unless -o names it
+    bool compileOnly = false;
+    // the object with -c and a single source, the executable otherwise
+    // (a.out if empty)
+    std::string output;
+    // -j: sources compiled at once
+    unsigned jobs = 1;
+    // --dump-ast and --dump-ir print to stdout, one source after another,
+    // --emit-llvm and --emit-asm write <stem>.ll and <stem>.s
+    bool dumpAST = false;
+    bool dumpIR = false;
+    bool emitLLVM = false;
+    bool emitAsm = false;
+    // -ftime-report prints the phases, functions and passes to stderr,
+    // -ftime-report-json=FILE writes them as JSON. Passes are only timed
+    // if everything runs on one thread, see TimeReport.h.
+    bool timeReport = false;
+    std::string timeReportJSON;
+
+    // the same for each source
+    bool directLowering = false;
+    unsigned partitions = 1;
+    unsigned semaThreads = 1;
+    std::string cacheDir;
+    CG::OptLevel optLevel = CG::OptLevel::O0;
+    CG::TargetConfig target;
+};
+
+// Compiles each source with a Parser and CodeGenerator of its own, up to
+// jobs of them at once, and links the objects with the system's cc unless
+// compileOnly. A source is its own module, named by its stem, and its
+// interface is written to <stem>.rpi in the working directory. Sources that
+// import others among the inputs wait for their interfaces, so the order
+// on the command line doesn't matter, import cycles are an error. Returns
+// 0 if everything was compiled (and linked), -1 otherwise.
+int compileSources(DriverOptions options);
+
+// Writes report as -ftime-report-json asks for and prints it to stderr with
+// -ftime-report. False if the JSON file could not be opened.
+bool printTimeReport(TimeReport& report, const DriverOptions& options);
@@ -1,43 +1,176 @@
 #include "Lexer.h"
+#include <algorithm>
+#include <cstring>
 using namespace std;
 
-Lexer::Lexer(const string& filename)
-    : fstream_(filename, fstream_.in), lastChar_(' '),
-    lineCount(1),charCount(1),index_(0)
+Lexer::Lexer(const string& filename, Mode mode, const ScanKernel& kernel, Tokenize tokenize)
+    : lastChar_(' '), offset_(0), tokenStart_(0), index_(0),
+    onDemand_(tokenize == Tokenize::OnDemand), base_(0), produced_(0),
+    cur_(nullptr), end_(nullptr), scan_(&kernel)
 {
-    if (!fstream_.is_open())
-        throw std::runtime_error("Failed to open " + filename + ".");
-    while (!fstream_.eof())
-    {
-        tokens_.push_back(getNextToken());
+    if (mode == Mode::Mapped) {
+        source_ = std::make_unique<SourceFile>(filename);
+        if (source_->size() > UINT32_MAX)
+            throw std::runtime_error(filename + " is too large.");
+        cur_ = source_->begin();
+        end_ = source_->end();
+    } else {
+        fstream_.open(filename, fstream_.in);
+        if (!fstream_.is_open())
+            throw std::runtime_error("Failed to open " + filename + ".");
+        lineStarts_.push_back(0);
+    }
+    if (onDemand_) {
+        // grows only if the parser keeps an iterator further back than this
+        tokens_.assign(256, Token(TokenType::Eof, 0));
+        produce();
+        return;
+    }
+    // roughly one token every five bytes of source
+    if (source_)
+        tokens_.reserve(source_->size() / 5 + 1);
+    do {
+        tokens_.push_back(scanNext());
+    } while (tokens_.back().type != TokenType::Eof);
+    produced_ = tokens_.size();
+}
+
+Lexer::iterator::iterator(Lexer* lexer, size_t pos)
+    : lexer_(lexer), pos_(pos)
+{
+    lexer_->pin(pos_);
+}
+
+Lexer::iterator::iterator(const iterator& other)
+    : iterator(other.lexer_, other.pos_)
+{
+}
+
+Lexer::iterator& Lexer::iterator::operator=(const iterator& other)
+{
+    if (this != &other) {
+        lexer_->unpin(pos_);
+        lexer_ = other.lexer_;
+        pos_ = other.pos_;
+        lexer_->pin(pos_);
     }
-    if (tokens_.back().type != TokenType::Eof) tokens_.push_back(makeToken(TokenType::Eof));
+    return *this;
+}
+
+Lexer::iterator::~iterator()
+{
+    lexer_->unpin(pos_);
+}
+
+void Lexer::pin(size_t pos)
+{
+    if (onDemand_)
+        pins_.push_back(pos);
+}
+
+void Lexer::unpin(size_t pos)
+{
+    if (!onDemand_) return;
+    // iterators are mostly released in reverse order
+    auto it = std::find(pins_.rbegin(), pins_.rend(), pos);
+    pins_.erase(std::next(it).base());
+}
+
+const Token& Lexer::at(size_t i)
+{
+    if (!onDemand_)
+        return tokens_[std::min(i, produced_ - 1)];
+    while (i >= produced_ && tokens_[(produced_ - 1) & (tokens_.size() - 1)].type != TokenType::Eof)
+        produce();
+    // everything past the end reads as Eof
+    if (i >= produced_) i = produced_ - 1;
+    return tokens_[i & (tokens_.size() - 1)];
+}
+
+void Lexer::produce()
+{
+    if (produced_ - base_ == tokens_.size()) {
+        // drop the tokens that neither the parser nor a live iterator can
+        // come back to, or grow the buffer if there are none
+        auto keep = std::min(index_, produced_ - 1);
+        for (auto p : pins_)
+            keep = std::min(keep, p);
+        if (keep > base_) {
+            base_ = keep;
+        } else {
+            std::vector<Token> grown(tokens_.size() * 2, tokens_[0]);
+            for (auto i = base_; i != produced_; ++i)
+                grown[i & (grown.size() - 1)] = tokens_[i & (tokens_.size() - 1)];
+            tokens_.swap(grown);
+        }
+    }
+    tokens_[produced_ & (tokens_.size() - 1)] = scanNext();
+    ++produced_;
+}
+
+Token Lexer::scanNext()
+{
+    if (source_)
+        return scanToken();
+    if (fstream_.eof())
+        return Token(TokenType::Eof, offset_ - 1);
+    return getNextToken();
 }
 
 Token Lexer::nextToken()
 {
-    return tokens_[index_++];
+    // read before advancing, so that produce() cannot drop this token
+    auto t = at(index_);
+    ++index_;
+    return t;
 }
 
-void Lexer::setIterator(iterator it)
+void Lexer::setIterator(const iterator& it)
 {
-    index_ = it;
+    index_ = it.pos_;
 }
 
 Lexer::iterator Lexer::getIterator()
 {
-    return index_;
+    return iterator(this, index_);
 }
 
-struct Token Lexer::curToken()
+Token Lexer::curToken()
 {
-    return tokens_[index_];
+    return at(index_);
+}
+
+std::string_view Lexer::content(const Token& t) const
+{
+    return strings_.get(t.handle);
+}
+
+std::string_view Lexer::curContent()
+{
+    return content(at(index_));
+}
+
+SourceLocation Lexer::location(const Token& t)
+{
+    if (lineStarts_.empty())
+        buildLineIndex();
+    auto it = std::upper_bound(lineStarts_.begin(), lineStarts_.end(), t.offset) - 1;
+    return { static_cast<int>(it - lineStarts_.begin()) + 1, static_cast<int>(t.offset - *it) + 1 };
+}
+
+void Lexer::buildLineIndex()
+{
+    auto begin = source_->begin();
+    lineStarts_.push_back(0);
+    for (auto p = begin; (p = static_cast<const char*>(memchr(p, '\n', end_ - p))) != nullptr; ++p)
+        lineStarts_.push_back(static_cast<std::uint32_t>(p - begin + 1));
 }
 
 Token Lexer::getNextToken()
 {
     while (isspace(lastChar_)||lastChar_=='\n'||lastChar_=='\r')
         getNextChar();
+    tokenStart_ = offset_ - 1;
     if (isalpha(lastChar_)||lastChar_=='_')
         return nextIdentifier();
     if (isdigit(lastChar_) || lastChar_ == '.')
@@ -54,19 +187,9 @@ Token Lexer::getNextToken()
     return nextCharacter();
 }
 
-int Lexer::getLineNo()
-{
-    return lineCount;
-}
-
-int Lexer::getCharNo()
-{
-    return charCount;
-}
-
 Token Lexer::viewNextToken()
 {
-    return tokens_[index_+1];
+    return at(index_ + 1);
 }
 
 
@@ -79,30 +202,9 @@ Token Lexer::nextIdentifier()
         content += lastChar_;
         getNextChar();
     }
-    if (content == "fn")
-        return makeToken(TokenType::Function);
-    if (content == "import")
-        return makeToken(TokenType::Import);
-    if (content == "trait")
-        return makeToken(TokenType::Trait);
-    if (content == "namespace")
-        return makeToken(TokenType::Namespace);
-    if (content == "class")
-        return makeToken(TokenType::Class);
-    if (content == "return")
-        return makeToken(TokenType::Return);
-    if (content == "if")
-        return makeToken(TokenType::If);
-    if (content == "else")
-        return makeToken(TokenType::Else);
-    if (content == "for")
-        return makeToken(TokenType::For);
-    if (content == "external")
-        return makeToken(TokenType::External);
-    if (content == "internal")
-        return makeToken(TokenType::Internal);
-    if (content == "using")
-        return makeToken(TokenType::Using);
+    auto type = keywordToToken(content);
+    if (type != TokenType::Identifier)
+        return makeToken(type);
     return makeToken(TokenType::Identifier, content);
 }
 
@@ -117,17 +219,18 @@ Token Lexer::nextNumber()
         return makeToken(TokenType::Point);
     }
     string num;
+    bool hasPoint = false;
     while (isdigit(lastChar_) || lastChar_ == '.')
     {
         if (lastChar_ == '.')
         {
-            if (isFloat) throw std::invalid_argument("Bad number.");
-            isFloat = true;
+            if (hasPoint) throw std::invalid_argument("Bad number.");
+            hasPoint = true;
         }
         num += lastChar_;
         getNextChar();
     }
-    return makeToken(isFloat ? TokenType::Float : TokenType::Integer, num);
+    return makeToken(isFloat || hasPoint ? TokenType::Float : TokenType::Integer, num);
 }
 
 Token Lexer::skipComment()
@@ -136,7 +239,7 @@ Token Lexer::skipComment()
     while (lastChar_ != '\n' && lastChar_ != '\r')
     {
         getNextChar();
-        if (lastChar_ == EOF) return makeToken(TokenType::Eof);
+        if (lastChar_ == EOF) return Token(TokenType::Eof, offset_ - 1);
     }
     return getNextToken();
 }
@@ -150,18 +253,73 @@ Token Lexer::nextCharacter()
 
 void Lexer::getNextChar()
 {
+    if (lastChar_ == '\n')
+        lineStarts_.push_back(offset_);
     lastChar_ = fstream_.get();
-    if(lastChar_=='\n')
-    {
-        lineCount++;
-        charCount = 1;
-    }else
-    {
-        charCount++;
+    ++offset_;
+}
+
+Token Lexer::makeToken(TokenType tok, std::string_view content)
+{
+    return Token(tok, tokenStart_, content.empty() ? 0 : strings_.internCopy(content));
+}
+
+static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+void Lexer::skipBlank()
+{
+    for (;;) {
+        cur_ = scan_->skipSpace(cur_, end_);
+        if (end_ - cur_ < 2 || cur_[0] != '/' || cur_[1] != '/')
+            return;
+        // comment: //...
+        cur_ = scan_->skipLine(cur_ + 2, end_);
+    }
+}
+
+Token Lexer::scanToken()
+{
+    skipBlank();
+    auto start = cur_;
+    if (cur_ == end_)
+        return makeMappedToken(TokenType::Eof, start);
+    auto c = *cur_;
+    if (isalpha(static_cast<unsigned char>(c)) || c == '_') {
+        // identifier: [a-zA-Z_][a-zA-Z0-9_]*
+        cur_ = scan_->skipIdentifier(cur_ + 1, end_);
+        std::string_view content(start, cur_ - start);
+        auto type = keywordToToken(content);
+        if (type != TokenType::Identifier)
+            return makeMappedToken(type, start);
+        return makeMappedToken(TokenType::Identifier, start, content);
+    }
+    if (isDigit(c) || c == '.') {
+        // Number: [0-9.]+
+        if (c == '.' && (cur_ + 1 == end_ || !isDigit(cur_[1]))) {
+            // like the point in obj.func()
+            ++cur_;
+            return makeMappedToken(TokenType::Point, start);
+        }
+        bool hasPoint = false;
+        for (;;) {
+            cur_ = scan_->skipDigits(cur_, end_);
+            if (cur_ == end_ || *cur_ != '.') break;
+            if (hasPoint) throw std::invalid_argument("Bad number.");
+            hasPoint = true;
+            ++cur_;
+        }
+        return makeMappedToken(hasPoint ? TokenType::Float : TokenType::Integer, start,
+                               std::string_view(start, cur_ - start));
     }
+    ++cur_;
+    return makeMappedToken(charToToken(c), start);
 }
 
-Token Lexer::makeToken(TokenType tok, const std::string& content)
+Token Lexer::makeMappedToken(TokenType tok, const char* start, std::string_view content)
 {
-    return Token(tok, content, getLineNo(), getCharNo());
+    return Token(tok, static_cast<std::uint32_t>(start - source_->begin()),
+                 content.empty() ? 0 : strings_.intern(content));
 }
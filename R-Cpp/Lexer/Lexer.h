@@ -1,35 +1,101 @@
 #pragma once
 #include <fstream>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include "../Util/Token.h"
+#include "ScanKernel.h"
+#include "SourceFile.h"
+#include "StringTable.h"
 
 class Lexer
 {
 public:
-    using iterator = size_t;
+    enum class Mode
+    {
+        Stream,   // read through std::fstream, contents are copied into the string table
+        Mapped    // mmap the file, the string table refers to the mapped buffer
+    };
 
-    Lexer(const std::string& filename);
+    enum class Tokenize
+    {
+        Upfront,  // tokenize the whole file in the constructor
+        OnDemand  // scan tokens into a ring buffer as they are consumed
+    };
+
+    // A position to come back to with setIterator(). In OnDemand mode the
+    // tokens from the oldest live iterator onwards are kept in the buffer,
+    // so backtracking works as long as the iterator is alive.
+    class iterator
+    {
+    public:
+        iterator(const iterator& other);
+        iterator& operator=(const iterator& other);
+        ~iterator();
+
+    private:
+        friend class Lexer;
+        iterator(Lexer* lexer, size_t pos);
+
+        Lexer* lexer_;
+        size_t pos_;
+    };
+
+    // kernel is only used in Mapped mode
+    Lexer(const std::string& filename, Mode mode = Mode::Mapped, const ScanKernel& kernel = ScanKernel::scalar(),
+          Tokenize tokenize = Tokenize::Upfront);
     Token nextToken();
-    void setIterator(iterator it);
+    void setIterator(const iterator& it);
     iterator getIterator();
     Token viewNextToken();
     Token curToken();
+    std::string_view content(const Token& t) const;
+    std::string_view curContent();
+    SourceLocation location(const Token& t);
+    // tokens scanned so far, all of them in Upfront mode
+    size_t tokenCount() const { return produced_; }
+    // tokens held in memory at once
+    size_t tokenCapacity() const { return tokens_.capacity(); }
+    const StringTable& strings() const { return strings_; }
 
 private:
+    const Token& at(size_t i);
+    void produce();
+    Token scanNext();
+    void pin(size_t pos);
+    void unpin(size_t pos);
+
     Token nextIdentifier();
     Token nextNumber();
     Token skipComment();
     Token nextCharacter();
     Token getNextToken();
     void getNextChar();
-    int getLineNo();
-    int getCharNo();
-    Token makeToken(TokenType tok,const std::string& content="");
+    Token makeToken(TokenType tok, std::string_view content = {});
+
+    Token scanToken();
+    void skipBlank();
+    Token makeMappedToken(TokenType tok, const char* start, std::string_view content = {});
+    void buildLineIndex();
 
     std::fstream fstream_;
     char lastChar_;
-    int lineCount, charCount;
-    iterator index_;
+    std::uint32_t offset_, tokenStart_;
+    size_t index_;
+    // OnDemand mode uses tokens_ as a ring buffer (its size is a power of
+    // two) holding the tokens [base_, produced_)
     std::vector<Token> tokens_;
+    bool onDemand_;
+    size_t base_, produced_;
+    std::vector<size_t> pins_;
+    StringTable strings_;
+    // offset of the first character of every line, filled while reading
+    // in Stream mode and on the first location() query in Mapped mode
+    std::vector<std::uint32_t> lineStarts_;
+
+    std::unique_ptr<SourceFile> source_;
+    const char* cur_;
+    const char* end_;
+    const ScanKernel* scan_;
 };
@@ -0,0 +1,196 @@
+#include "ScanKernel.h"
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RCPP_SCAN_X86
+#include <immintrin.h>
+#ifdef __GNUC__
+// lets the SIMD kernels be compiled without raising the baseline ISA of
+// the whole build, available() only lists them when the CPU supports them
+#define RCPP_TARGET(isa) __attribute__((target(isa)))
+#else
+#include <intrin.h>
+#define RCPP_TARGET(isa)
+#endif
+#endif
+
+namespace
+{
+template <typename Class>
+const char* skipScalar(const char* p, const char* end)
+{
+    while (p != end && Class::scalar(*p))
+        ++p;
+    return p;
+}
+
+#ifdef RCPP_SCAN_X86
+unsigned countTrailingZeros(unsigned mask)
+{
+#ifdef __GNUC__
+    return __builtin_ctz(mask);
+#else
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#endif
+}
+
+// bytes in [lo, hi]; all classes are ASCII, so bytes >= 0x80 compare as
+// negative and never match
+RCPP_TARGET("sse2") inline __m128i inRange(__m128i v, char lo, char hi)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+RCPP_TARGET("avx2") inline __m256i inRange(__m256i v, char lo, char hi)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+#endif
+
+struct Space
+{
+    static bool scalar(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+#ifdef RCPP_SCAN_X86
+    RCPP_TARGET("sse2") static __m128i sse2(__m128i v)
+    {
+        return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), inRange(v, '\t', '\r'));
+    }
+    RCPP_TARGET("avx2") static __m256i avx2(__m256i v)
+    {
+        return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), inRange(v, '\t', '\r'));
+    }
+#endif
+};
+
+struct Line
+{
+    static bool scalar(char c) { return c != '\n' && c != '\r'; }
+#ifdef RCPP_SCAN_X86
+    RCPP_TARGET("sse2") static __m128i sse2(__m128i v)
+    {
+        auto newline = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+        return _mm_cmpeq_epi8(newline, _mm_setzero_si128());
+    }
+    RCPP_TARGET("avx2") static __m256i avx2(__m256i v)
+    {
+        auto newline = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                       _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        return _mm256_cmpeq_epi8(newline, _mm256_setzero_si256());
+    }
+#endif
+};
+
+struct Identifier
+{
+    static bool scalar(char c)
+    {
+        auto lower = c | 0x20;
+        return (lower >= 'a' && lower <= 'z') || (c >= '0' && c <= '9') || c == '_';
+    }
+#ifdef RCPP_SCAN_X86
+    RCPP_TARGET("sse2") static __m128i sse2(__m128i v)
+    {
+        auto letter = inRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+        return _mm_or_si128(_mm_or_si128(letter, inRange(v, '0', '9')), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    }
+    RCPP_TARGET("avx2") static __m256i avx2(__m256i v)
+    {
+        auto letter = inRange(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+        return _mm256_or_si256(_mm256_or_si256(letter, inRange(v, '0', '9')),
+                               _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+    }
+#endif
+};
+
+struct Digit
+{
+    static bool scalar(char c) { return c >= '0' && c <= '9'; }
+#ifdef RCPP_SCAN_X86
+    RCPP_TARGET("sse2") static __m128i sse2(__m128i v) { return inRange(v, '0', '9'); }
+    RCPP_TARGET("avx2") static __m256i avx2(__m256i v) { return inRange(v, '0', '9'); }
+#endif
+};
+
+#ifdef RCPP_SCAN_X86
+template <typename Class>
+RCPP_TARGET("sse2") const char* skipSse2(const char* p, const char* end)
+{
+    for (; end - p >= 16; p += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(Class::sse2(v)));
+        if (mask != 0xFFFFu) return p + countTrailingZeros(~mask);
+    }
+    return skipScalar<Class>(p, end);
+}
+
+template <typename Class>
+RCPP_TARGET("avx2") const char* skipAvx2(const char* p, const char* end)
+{
+    for (; end - p >= 32; p += 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(Class::avx2(v)));
+        if (mask != 0xFFFFFFFFu) return p + countTrailingZeros(~mask);
+    }
+    return skipSse2<Class>(p, end);
+}
+
+bool hasSse2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(__GNUC__)
+    return __builtin_cpu_supports("sse2");
+#else
+    int info[4];
+    __cpuid(info, 1);
+    return info[3] & (1 << 26);
+#endif
+}
+
+bool hasAvx2()
+{
+#ifdef __GNUC__
+    return __builtin_cpu_supports("avx2");
+#else
+    // the OS must also save the YMM registers
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = info[2] & (1 << 27), avx = info[2] & (1 << 28);
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#endif
+}
+#endif
+
+const ScanKernel scalarKernel = {
+    "scalar", skipScalar<Space>, skipScalar<Line>, skipScalar<Identifier>, skipScalar<Digit>
+};
+#ifdef RCPP_SCAN_X86
+const ScanKernel sse2Kernel = {
+    "sse2", skipSse2<Space>, skipSse2<Line>, skipSse2<Identifier>, skipSse2<Digit>
+};
+const ScanKernel avx2Kernel = {
+    "avx2", skipAvx2<Space>, skipAvx2<Line>, skipAvx2<Identifier>, skipAvx2<Digit>
+};
+#endif
+}
+
+const ScanKernel& ScanKernel::scalar()
+{
+    return scalarKernel;
+}
+
+const std::vector<const ScanKernel*>& ScanKernel::available()
+{
+    static const std::vector<const ScanKernel*> kernels = [] {
+        std::vector<const ScanKernel*> v{ &scalarKernel };
+#ifdef RCPP_SCAN_X86
+        if (hasSse2()) v.push_back(&sse2Kernel);
+        if (hasSse2() && hasAvx2()) v.push_back(&avx2Kernel);
+#endif
+        return v;
+    }();
+    return kernels;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+
+// Byte-class scanning used by the mapped lexer. Every function returns the
+// first position in [p, end) whose byte is not in its class, or end.
+// The SIMD kernels classify 16 (SSE2) or 32 (AVX2) bytes per step and
+// must give exactly the same results as the scalar one.
+struct ScanKernel
+{
+    const char* name;
+    // ' ', '\t', '\n', '\v', '\f', '\r'
+    const char* (*skipSpace)(const char* p, const char* end);
+    // anything but '\n' and '\r', i.e. the rest of a // comment
+    const char* (*skipLine)(const char* p, const char* end);
+    // [a-zA-Z0-9_]
+    const char* (*skipIdentifier)(const char* p, const char* end);
+    // [0-9]
+    const char* (*skipDigits)(const char* p, const char* end);
+
+    // The lexer's default. Tokens are short, so on .rpp sources the setup
+    // of a vector step costs more than it saves and the SIMD kernels are
+    // slower (see benchmark/LexerBench), they are only worth picking for
+    // input with long runs of one class.
+    static const ScanKernel& scalar();
+    // kernels this CPU can run: scalar, then SSE2 and AVX2
+    static const std::vector<const ScanKernel*>& available();
+};
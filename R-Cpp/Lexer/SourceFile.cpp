@@ -0,0 +1,49 @@
+#include "SourceFile.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceFile::SourceFile(const std::string& filename)
+    : data_(nullptr), size_(0), mapped_(false)
+{
+#ifndef _WIN32
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw std::runtime_error("Failed to open " + filename + ".");
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        auto p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(p);
+            size_ = st.st_size;
+            mapped_ = true;
+        }
+    }
+    close(fd);
+    if (mapped_) return;
+#endif
+    // empty files, pipes and platforms without mmap
+    std::ifstream fs(filename, std::ios::in | std::ios::binary);
+    if (!fs.is_open())
+        throw std::runtime_error("Failed to open " + filename + ".");
+    std::ostringstream ss;
+    ss << fs.rdbuf();
+    buffer_ = ss.str();
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
+
+SourceFile::~SourceFile()
+{
+#ifndef _WIN32
+    if (mapped_)
+        munmap(const_cast<char*>(data_), size_);
+#endif
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Read-only view of a whole source file. On POSIX systems the file is
+// mmap'd so that the lexer can hand out slices of it without copying,
+// elsewhere the content is read into an owned buffer.
+class SourceFile
+{
+public:
+    explicit SourceFile(const std::string& filename);
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    std::string_view content() const { return { data_, size_ }; }
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_;
+    size_t size_;
+    bool mapped_;
+    std::string buffer_;
+};
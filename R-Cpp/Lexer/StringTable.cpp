@@ -0,0 +1,31 @@
+#include "StringTable.h"
+
+StringTable::StringTable()
+{
+    strings_.emplace_back();
+    index_.emplace(std::string_view(), 0);
+}
+
+StringTable::handle StringTable::intern(std::string_view s)
+{
+    auto it = index_.find(s);
+    if (it != index_.end()) return it->second;
+    auto h = static_cast<handle>(strings_.size());
+    strings_.push_back(s);
+    index_.emplace(s, h);
+    return h;
+}
+
+StringTable::handle StringTable::internCopy(std::string_view s)
+{
+    auto it = index_.find(s);
+    if (it != index_.end()) return it->second;
+    storage_.emplace_back(s);
+    return intern(storage_.back());
+}
+
+StringTable::handle StringTable::find(std::string_view s) const
+{
+    auto it = index_.find(s);
+    return it == index_.end() ? npos : it->second;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Interned identifiers and literals. Each distinct string is stored once
+// and referred to by a 32-bit handle; handle 0 is the empty string.
+class StringTable
+{
+public:
+    using handle = std::uint32_t;
+    // never a valid handle
+    static constexpr handle npos = ~handle(0);
+
+    StringTable();
+
+    // the viewed characters must outlive the table (e.g. an mmap'd file)
+    handle intern(std::string_view s);
+    // copies s into storage owned by the table on first occurrence
+    handle internCopy(std::string_view s);
+    // npos if s has not been interned
+    handle find(std::string_view s) const;
+    std::string_view get(handle h) const { return strings_[h]; }
+    size_t size() const { return strings_.size(); }
+
+private:
+    std::vector<std::string_view> strings_;
+    std::unordered_map<std::string_view, handle> index_;
+    std::deque<std::string> storage_;
+};
@@ -1,11 +1,16 @@
 #include "AST.h"
-#include <iostream>
+#include <algorithm>
 
 std::string toXMLPair(const std::string& tag,const std::string& content) {
     return "<" + tag + ">" + content + "</" + tag + ">";
 }
 
-Parse::FunctionType* findSuitableFunction(const std::vector<std::unique_ptr<Parse::Stmt>>& argList, const std::vector<Parse::FunctionType*>* fnList) {
+// raw_ostream doesn't take string_views
+static llvm::StringRef ref(std::string_view s) {
+    return { s.data(), s.size() };
+}
+
+Parse::FunctionType* Parse::findSuitableFunction(llvm::ArrayRef<Parse::Stmt*> argList, const std::vector<Parse::FunctionType*>* fnList) {
     Parse::FunctionType* target = nullptr;
     for (auto& f : *fnList) {
         bool flag = true;
@@ -27,7 +32,7 @@ Parse::FunctionType* findSuitableFunction(const std::vector<std::unique_ptr<Pars
     return target;
 }
 
-Parse::FunctionType* findSuitableFunction(const std::vector<std::unique_ptr<Parse::Stmt>>& argList, const std::vector<std::unique_ptr<Parse::FunctionType>>* fnList) {
+Parse::FunctionType* Parse::findSuitableFunction(llvm::ArrayRef<Parse::Stmt*> argList, const std::vector<std::unique_ptr<Parse::FunctionType>>* fnList) {
     Parse::FunctionType* target = nullptr;
     for (auto& f : *fnList) {
         bool flag = true;
@@ -49,14 +54,62 @@ Parse::FunctionType* findSuitableFunction(const std::vector<std::unique_ptr<Pars
     return target;
 }
 
-Parse::CompoundStmt::CompoundStmt(std::vector<std::unique_ptr<Stmt>> exprs)
-    : stmts_(std::move(exprs)) 
+// The value of stmt, lowered to expr, as a reference of its own for whoever
+// consumes it: an rc or arc temporary is taken over, anything else retained.
+static std::unique_ptr<ExprAST> ownedValue(Parse::Stmt* stmt, std::unique_ptr<ExprAST> expr,
+                                           Parse::ASTContext* context)
+{
+    if (!Parse::asRefCounted(stmt->getType()) || context->takeTemporary(stmt)) return expr;
+    return std::make_unique<RetainAST>(std::move(expr));
+}
+
+// the callee owns its arguments
+static void ownArguments(llvm::ArrayRef<Parse::Stmt*> args, std::vector<std::unique_ptr<ExprAST>>& exprs,
+                         Parse::ASTContext* context)
+{
+    for (size_t i = 0; i < args.size(); ++i) {
+        exprs[i] = ownedValue(args[i], std::move(exprs[i]), context);
+    }
+}
+
+Parse::ASTContext::Destructibles Parse::returnDestructibles(ASTContext* context, Stmt* value, ReturnKind& kind)
+{
+    auto vars = context->destructiblesOfAll();
+    kind = ReturnKind::Value;
+    auto object = dynamic_cast<CompoundType*>(value ? value->getType() : nullptr);
+    if (object || (value && asRefCounted(value->getType()))) {
+        if (context->takeTemporary(value)) {
+            if (object) kind = ReturnKind::InPlace;
+        } else {
+            // a class of someone else is copied
+            kind = object ? ReturnKind::Value : ReturnKind::Retain;
+            auto local = vars.end();
+            if (auto var = dynamic_cast<VariableStmt*>(value)) {
+                // the innermost variable of that name comes first
+                auto name = var->getName();
+                local = std::find_if(vars.begin(), vars.end(), [&](auto& v) { return v.second == name; });
+            }
+            if (local != vars.end() && object && object->getMoveConstructor()) {
+                kind = ReturnKind::MoveConstruct;
+            } else if (local != vars.end()) {
+                kind = ReturnKind::Value;
+                vars.erase(local);
+            }
+        }
+    }
+    auto destructibles = context->namelessDestructibles();
+    destructibles.insert(destructibles.end(), vars.begin(), vars.end());
+    return destructibles;
+}
+
+Parse::CompoundStmt::CompoundStmt(llvm::ArrayRef<Stmt*> exprs)
+    : stmts_(exprs) 
 { }
 
-void Parse::CompoundStmt::print(std::string indent, bool last) {
+void Parse::CompoundStmt::print(llvm::raw_ostream& os, std::string indent, bool last) {
     indent += last ? "  " : "| ";
     for (size_t i = 0; i < stmts_.size(); ++i) {
-        stmts_[i]->print(indent, i == stmts_.size() - 1);
+        stmts_[i]->print(os, indent, i == stmts_.size() - 1);
     }
 }
 
@@ -94,21 +147,20 @@ std::unique_ptr<BlockExprAST> Parse::CompoundStmt::toBlockExprAST(ASTContext* co
     return std::make_unique<BlockExprAST>(std::move(exprs), hasReturn);
 }
 
-Parse::IfStmt::IfStmt(std::unique_ptr<Stmt> condition, std::unique_ptr<CompoundStmt> then,
-                      std::unique_ptr<CompoundStmt> els): cond_(std::move(condition)), then_(std::move(then)),
-                                                          else_(std::move(els)) {
+Parse::IfStmt::IfStmt(Stmt* condition, CompoundStmt* then, CompoundStmt* els)
+    : cond_(condition), then_(then), else_(els) {
 }
 
-void Parse::IfStmt::print(std::string indent, bool last) {
-    std::cout << indent << "+-IfStmt " << std::endl;
+void Parse::IfStmt::print(llvm::raw_ostream& os, std::string indent, bool last) {
+    os << indent << "+-IfStmt " << '\n';
     indent += last ? "  " : "| ";
-    std::cout << indent << "+- Condition" << std::endl;
-    cond_->print(indent, false);
-    std::cout << indent << "+- Then" << std::endl;
-    then_->print(indent, else_ == nullptr);
+    os << indent << "+- Condition" << '\n';
+    cond_->print(os, indent, false);
+    os << indent << "+- Then" << '\n';
+    then_->print(os, indent, else_ == nullptr);
     if (else_) {
-        std::cout << indent << "+- Else" << std::endl;
-        else_->print(indent, true);
+        os << indent << "+- Else" << '\n';
+        else_->print(os, indent, true);
     }
 
 }
@@ -139,23 +191,22 @@ std::unique_ptr<ExprAST> Parse::IfStmt::toLLVMAST(ASTContext* context)
     return std::make_unique<IfExprAST>(std::move(cond),std::move(then),std::move(els));
 }
 
-Parse::ForStmt::ForStmt(std::unique_ptr<Stmt> start, std::unique_ptr<Stmt> cond, std::unique_ptr<Stmt> end,
-                        std::unique_ptr<CompoundStmt> body): start_(std::move(start)), cond_(std::move(cond)),
-                                                             end_(std::move(end)), body_(std::move(body)) {
+Parse::ForStmt::ForStmt(Stmt* start, Stmt* cond, Stmt* end, CompoundStmt* body)
+    : start_(start), cond_(cond), end_(end), body_(body) {
 
 }
 
-void Parse::ForStmt::print(std::string indent, bool last) {
-    std::cout << indent << "+-ForStmt" << std::endl;
+void Parse::ForStmt::print(llvm::raw_ostream& os, std::string indent, bool last) {
+    os << indent << "+-ForStmt" << '\n';
     indent += last ? "  " : "| ";
-    std::cout << indent << "+-start" << std::endl;
-    start_->print(indent + "| ", false);
-    std::cout << indent << "+-cond" << std::endl;
-    cond_->print(indent + "| ", false);
-    std::cout << indent << "+-body" << std::endl;
-    body_->print(indent + "| ", false);
-    std::cout << indent << "+-end" << std::endl;
-    end_->print(indent + "  ", true);
+    os << indent << "+-start" << '\n';
+    start_->print(os, indent + "| ", false);
+    os << indent << "+-cond" << '\n';
+    cond_->print(os, indent + "| ", false);
+    os << indent << "+-body" << '\n';
+    body_->print(os, indent + "| ", false);
+    os << indent << "+-end" << '\n';
+    end_->print(os, indent + "  ", true);
 }
 
 std::string Parse::ForStmt::dumpToXML() const {
@@ -180,13 +231,13 @@ std::unique_ptr<ExprAST> Parse::ForStmt::toLLVMAST(ASTContext* context)
         end_->toLLVMAST(context), std::move(body));
 }
 
-Parse::ReturnStmt::ReturnStmt(std::unique_ptr<Stmt> returnVal): ret_val_(std::move(returnVal)) {
+Parse::ReturnStmt::ReturnStmt(Stmt* returnVal): ret_val_(returnVal) {
 }
 
-void Parse::ReturnStmt::print(std::string indent, bool last) {
-    std::cout << indent << "+-ReturnStmt" << std::endl;
+void Parse::ReturnStmt::print(llvm::raw_ostream& os, std::string indent, bool last) {
+    os << indent << "+-ReturnStmt" << '\n';
     indent += last ? "  " : " |";
-    ret_val_->print(indent, true);
+    ret_val_->print(os, indent, true);
 }
 
 std::string Parse::ReturnStmt::dumpToXML() const {
@@ -198,20 +249,27 @@ std::string Parse::ReturnStmt::dumpToXML() const {
 
 std::unique_ptr<ExprAST> Parse::ReturnStmt::toLLVMAST(ASTContext* context)
 {
-    return std::make_unique<ReturnAST>(ret_val_->toLLVMAST(context), context->callDestructorsOfAll());
+    std::unique_ptr<ExprAST> value;
+    if (ret_val_ != nullptr) value = ret_val_->toLLVMAST(context);
+    ReturnKind kind;
+    auto destructors = ASTContext::callDestructors(returnDestructibles(context, ret_val_, kind));
+    if (kind == ReturnKind::Retain) value = std::make_unique<RetainAST>(std::move(value));
+    auto ret = std::make_unique<ReturnAST>(std::move(value), std::move(destructors));
+    if (kind == ReturnKind::InPlace) ret->setInPlace();
+    if (kind == ReturnKind::MoveConstruct)
+        ret->setMoveConstructor(static_cast<CompoundType*>(ret_val_->getType())->getMoveConstructor()->mangledName());
+    return ret;
 }
 
 Parse::BinaryOperatorStmt::
-BinaryOperatorStmt(std::unique_ptr<Stmt> lhs, std::unique_ptr<Stmt> rhs, OperatorType op): lhs_(std::move(lhs)),
-                                                                                           rhs_(std::move(rhs)),
-                                                                                           op_(op) {
+BinaryOperatorStmt(Stmt* lhs, Stmt* rhs, OperatorType op): lhs_(lhs), rhs_(rhs), op_(op) {
 }
 
-void Parse::BinaryOperatorStmt::print(std::string indent, bool last) {
-    std::cout << indent << "+-BinaryOperatorStmt " << op_ << std::endl;
+void Parse::BinaryOperatorStmt::print(llvm::raw_ostream& os, std::string indent, bool last) {
+    os << indent << "+-BinaryOperatorStmt " << operatorDescription(op_) << '\n';
     indent += last ? "  " : "| ";
-    lhs_->print(indent, false);
-    rhs_->print(indent, true);
+    lhs_->print(os, indent, false);
+    rhs_->print(os, indent, true);
 }
 
 std::string Parse::BinaryOperatorStmt::dumpToXML() const {
@@ -225,13 +283,15 @@ std::string Parse::BinaryOperatorStmt::dumpToXML() const {
 std::unique_ptr<ExprAST> Parse::BinaryOperatorStmt::toLLVMAST(ASTContext* context)
 {
     if(op_==OperatorType::ScopeResolution) {
-        auto l = dynamic_cast<VariableStmt*>(lhs_.get());
+        auto l = dynamic_cast<VariableStmt*>(lhs_);
         if (!l) throw std::logic_error("Left hand of :: is not a valid scope name.");
         auto ns = context->symbolTable().getNamespace(l->getName());
         if (!ns) throw std::logic_error("No namespace named " + l->getName() + ".");
         context->symbolTable().setSpecfiedNamespace(ns);
         auto ret= rhs_->toLLVMAST(context);
         context->symbolTable().unsetSpecfiedNamespace();
+        type_ = rhs_->getType();
+        temporary_ = rhs_->temporary();
         return ret;
     }
     auto l = lhs_->toLLVMAST(context);
@@ -239,28 +299,29 @@ std::unique_ptr<ExprAST> Parse::BinaryOperatorStmt::toLLVMAST(ASTContext* contex
     {
         auto t = lhs_->getType();
         if(op_==OperatorType::MemberAccessA) {
-            if (t->getTypename() != "__ptr") throw std::logic_error("Operator -> only suits for pointer.");
+            if (t->getTypename() != "__ptr" && !asRefCounted(t))
+                throw std::logic_error("Operator -> only suits for pointer.");
             t = t->getTemplateArgs()[0];
             lhs_->setType(t);
-            l = std::make_unique<UnaryExprAST>(std::move(l), OperatorType::Dereference, t->mangledName());
+            l = std::make_unique<UnaryExprAST>(std::move(l), OperatorType::Dereference, t);
         }
         auto type = dynamic_cast<CompoundType*>(t);
         if(!type)
         {
             throw std::logic_error("Invalid member access.");
         }
-        auto r = dynamic_cast<VariableStmt*>(rhs_.get());
+        auto r = dynamic_cast<VariableStmt*>(rhs_);
         auto index = type->getMemberIndex(r->getName());
         if(index!=-1) {
             type_ = type->getMemberType(r->getName());
-            return std::make_unique<MemberAccessAST>(std::move(l), index, type_->mangledName());
+            return std::make_unique<MemberAccessAST>(std::move(l), index, type_);
         }
         auto funclist = type->getFunction(r->getName());
         if(funclist==nullptr) {
             throw std::logic_error("Unknown member.");
         }
         type_ = (*funclist)[0];
-        auto ret = std::make_unique<CallExprAST>(r->getName(), std::vector<std::unique_ptr<ExprAST>>{}, "null");
+        auto ret = std::make_unique<CallExprAST>(r->getName(), std::vector<std::unique_ptr<ExprAST>>{}, nullptr);
         ret->setThis(std::move(l));
         return ret;
     }
@@ -272,6 +333,7 @@ std::unique_ptr<ExprAST> Parse::BinaryOperatorStmt::toLLVMAST(ASTContext* contex
     if(op_==OperatorType::Assignment)
     {
         type_ = context->symbolTable().getType("void");
+        r = ownedValue(rhs_, std::move(r), context);
     }else
     {
         type_ = lhs_->getType();
@@ -287,24 +349,19 @@ Parse::Type* Parse::BinaryOperatorStmt::getRHSType() {
     return rhs_->getType();
 }
 
-Parse::UnaryOperatorStmt::
-UnaryOperatorStmt(std::unique_ptr<Stmt> expr, OperatorType op): stmt_(std::move(expr)), op_(op) {
-}
-
-Parse::UnaryOperatorStmt::UnaryOperatorStmt(std::unique_ptr<Stmt> expr, OperatorType op,
-                                            std::vector<std::unique_ptr<Stmt>> args): stmt_(std::move(expr)), op_(op),
-                                                                                      args_(std::move(args)) {
+Parse::UnaryOperatorStmt::UnaryOperatorStmt(Stmt* expr, OperatorType op, llvm::ArrayRef<Stmt*> args)
+    : stmt_(expr), op_(op), args_(args) {
 }
 
-void Parse::UnaryOperatorStmt::print(std::string indent, bool last) {
-    std::cout << indent << "+-UnaryOperatorStmt " << op_ << std::endl;
+void Parse::UnaryOperatorStmt::print(llvm::raw_ostream& os, std::string indent, bool last) {
+    os << indent << "+-UnaryOperatorStmt " << operatorDescription(op_) << '\n';
     indent += last ? "  " : "| ";
     if (args_.size() == 0) {
-        stmt_->print(indent, true);
+        stmt_->print(os, indent, true);
     } else {
-        stmt_->print(indent, false);
+        stmt_->print(os, indent, false);
         for (size_t i = 0; i < args_.size(); ++i) {
-            args_[i]->print(indent, i == args_.size() - 1);
+            args_[i]->print(os, indent, i == args_.size() - 1);
         }
     }
 }
@@ -320,44 +377,74 @@ std::string Parse::UnaryOperatorStmt::dumpToXML() const {
 }
 
 std::unique_ptr<ExprAST> Parse::UnaryOperatorStmt::toLLVMAST(ASTContext* context) {
+    temporary_ = 0;
     auto expr = stmt_->toLLVMAST(context);
     std::vector<std::unique_ptr<ExprAST>> argsExpr;
     for(auto&arg:args_)
     {
         argsExpr.push_back(arg->toLLVMAST(context));
     }
+    // an rc or arc made or returned here, or a class returned, is
+    // destroyed at the end of the statement, unless it is taken over
+    auto keepTemporary = [&](std::unique_ptr<ExprAST> value) -> std::unique_ptr<ExprAST> {
+        bool object = dynamic_cast<CompoundType*>(type_) != nullptr;
+        if (!object && !asRefCounted(type_)) return value;
+        temporary_ = context->getNamelessVarCount();
+        auto name = ASTContext::namelessVarName(temporary_);
+        context->symbolTable().addNamelessVariable(type_, name);
+        if (object) {
+            static_cast<CallExprAST*>(value.get())->setResult(name);
+            return value;
+        }
+        return std::make_unique<TemporaryAST>(name, std::move(value));
+    };
     auto fn = dynamic_cast<FunctionType*>(stmt_->getType());
     if(fn &&op_==OperatorType::FunctionCall) {
         auto call = dynamic_cast<CallExprAST*>(expr.get());
         if(call) {
             // a.fun()
-            auto stmt = dynamic_cast<BinaryOperatorStmt*>(stmt_.get());
+            auto stmt = dynamic_cast<BinaryOperatorStmt*>(stmt_);
             auto fnList = dynamic_cast<CompoundType*>(stmt->getLHSType())->getFunction(call->getName());
             auto target = findSuitableFunction(args_, fnList);
             type_ = target->returnType();
-            call->setType(type_->mangledName());
+            ownArguments(args_, argsExpr, context);
+            call->setType(type_);
             call->setName(target->mangledName());
             call->setArgs(std::move(argsExpr));
-            return expr;
+            return keepTemporary(std::move(expr));
         }else {
             // func()
             auto fnList = context->symbolTable().getFunction(fn->getTypename());
             auto target = findSuitableFunction(args_, fnList);
             type_ = target->returnType();
-            return std::make_unique<CallExprAST>(target->mangledName(), std::move(argsExpr), target->returnType()->mangledName());
+            ownArguments(args_, argsExpr, context);
+            return keepTemporary(std::make_unique<CallExprAST>(target->mangledName(), std::move(argsExpr), type_));
 
         }
     }
-    auto type = dynamic_cast<TypeStmt*>(stmt_.get());
+    auto type = dynamic_cast<TypeStmt*>(stmt_);
+    if (type && op_ == OperatorType::FunctionCall && asRefCounted(type->getType())) {
+        // rc<T>(args) builds a T in a new block
+        auto object = static_cast<CompoundType*>(type->getType()->getTemplateArgs()[0]);
+        std::string constructor;
+        if (!args_.empty() || !object->getConstructors()->empty()) {
+            constructor = findSuitableFunction(args_, object->getConstructors())->mangledName();
+            ownArguments(args_, argsExpr, context);
+        }
+        type_ = type->getType();
+        return keepTemporary(std::make_unique<RefCountedNewAST>(type_, constructor, std::move(argsExpr)));
+    }
     if(type && op_==OperatorType::FunctionCall) {
         auto fnlist = dynamic_cast<CompoundType*>(type->getType())->getConstructors();
         auto target = findSuitableFunction(args_, fnlist);
+        ownArguments(args_, argsExpr, context);
         type_ = type->getType();
-        auto name = context->namelessVarName();
+        temporary_ = context->getNamelessVarCount();
+        auto name = ASTContext::namelessVarName(temporary_);
         context->symbolTable().addNamelessVariable(type_, name);
-        return std::make_unique<NamelessVarExprAST>(name, type_->mangledName(),target->mangledName(),std::move(argsExpr));
+        return std::make_unique<NamelessVarExprAST>(name, type_,target->mangledName(),std::move(argsExpr));
     }
-    auto var = dynamic_cast<VariableStmt*>(stmt_.get());
+    auto var = dynamic_cast<VariableStmt*>(stmt_);
     if(var && op_==OperatorType::Subscript)
     {
         if(var->getType()->getTypename()!="__arr")
@@ -365,30 +452,30 @@ std::unique_ptr<ExprAST> Parse::UnaryOperatorStmt::toLLVMAST(ASTContext* context
             throw std::logic_error("No suitable operation between " + var->getType()->getTypename() + " and [].");
         }
         type_ = var->getType()->getTemplateArgs()[0];
-        return std::make_unique<UnaryExprAST>(std::move(expr), OperatorType::Subscript, std::move(argsExpr), type_->mangledName());
+        return std::make_unique<UnaryExprAST>(std::move(expr), OperatorType::Subscript, std::move(argsExpr), type_);
     }
     throw std::logic_error("No suitable unary operation.");
 }
 
-Parse::VariableDefStmt::VariableDefStmt(std::unique_ptr<Stmt> type, const std::string& name)
-    : vartype_(std::move(type)), name_(name)
+Parse::VariableDefStmt::VariableDefStmt(Stmt* type, std::string_view name)
+    : vartype_(type), name_(name), init_val_(nullptr)
 { }
 
-void Parse::VariableDefStmt::setInitValue(std::unique_ptr<Stmt> initVal) {
-    init_val_ = std::move(initVal);
+void Parse::VariableDefStmt::setInitValue(Stmt* initVal) {
+    init_val_ = initVal;
 }
 
-void Parse::VariableDefStmt::print(std::string indent, bool last) {
-    std::cout << indent << "+-VariableDefStmt " << name_ << " ";
-    std::cout << dynamic_cast<TypeStmt*>(vartype_.get())->getName();
-    std::cout << std::endl;
+void Parse::VariableDefStmt::print(llvm::raw_ostream& os, std::string indent, bool last) {
+    os << indent << "+-VariableDefStmt " << ref(name_) << " ";
+    os << dynamic_cast<TypeStmt*>(vartype_)->getName();
+    os << '\n';
     indent += last ? "  " : "| ";
     if (init_val_)
-        init_val_->print(indent, true);
+        init_val_->print(os, indent, true);
 }
 
 std::string Parse::VariableDefStmt::dumpToXML() const {
-    std::string str = "<Stmt type=\"VariableDefStmt\" name=\"" + name_ + "\">";
+    std::string str = "<Stmt type=\"VariableDefStmt\" name=\"" + std::string(name_) + "\">";
     str += toXMLPair("type", vartype_->dumpToXML());
     if(init_val_)
         str += toXMLPair("initVal", init_val_->dumpToXML());
@@ -397,46 +484,51 @@ std::string Parse::VariableDefStmt::dumpToXML() const {
 }
 
 std::unique_ptr<ExprAST> Parse::VariableDefStmt::toLLVMAST(ASTContext* context) {
+    std::string name(name_);
     vartype_->toLLVMAST(context);
-    auto t = dynamic_cast<TypeStmt*>(vartype_.get());
+    auto t = dynamic_cast<TypeStmt*>(vartype_);
     if (t == nullptr)
         throw std::logic_error("Invalid type.");
-    if(context->symbolTable().getVariable(name_)!=nullptr) {
-        throw std::logic_error("Duplicate variable name: " + name_);
+    if(context->symbolTable().getVariable(name)!=nullptr) {
+        throw std::logic_error("Duplicate variable name: " + name);
     }
-    context->symbolTable().addVariable(t->getType(), name_);
+    context->symbolTable().addVariable(t->getType(), name);
     if(init_val_!=nullptr) {
-        return std::make_unique<VariableDefAST>(t->getType()->mangledName(), name_, init_val_->toLLVMAST(context));
+        auto init = init_val_->toLLVMAST(context);
+        // a class temporary is built in the variable
+        bool inPlace = dynamic_cast<CompoundType*>(t->getType()) && context->takeTemporary(init_val_);
+        if (!inPlace) init = ownedValue(init_val_, std::move(init), context);
+        return std::make_unique<VariableDefAST>(t->getType(), name, std::move(init), inPlace);
     }else {
-        return std::make_unique<VariableDefAST>(t->getType()->mangledName(), name_);
+        return std::make_unique<VariableDefAST>(t->getType(), name);
     }
 
 }
 
 Parse::TypeStmt::
-TypeStmt(const std::string& name, std::vector<std::unique_ptr<Stmt>> arglist): name_(name), arglist_(std::move(arglist))
+TypeStmt(std::string_view name, llvm::ArrayRef<Stmt*> arglist): name_(name), arglist_(arglist)
 {
 }
 
-void Parse::TypeStmt::print(std::string indent, bool last)
+void Parse::TypeStmt::print(llvm::raw_ostream& os, std::string indent, bool last)
 {
-    std::cout << indent << "+-Type/Function " << getName() << std::endl;
+    os << indent << "+-Type/Function " << getName() << '\n';
 }
 
 std::string Parse::TypeStmt::getName()
 {
-    std::string name = name_;
+    std::string name(name_);
     if (arglist_.size() != 0)
     {
         name += "<";
         for (size_t i = 0; i < arglist_.size(); ++i)
         {
-            auto type = dynamic_cast<TypeStmt*>(arglist_[i].get());
+            auto type = dynamic_cast<TypeStmt*>(arglist_[i]);
             if(type)
                 name += type->getName();
             else
             {
-                auto num = dynamic_cast<IntegerStmt*>(arglist_[i].get());
+                auto num = dynamic_cast<IntegerStmt*>(arglist_[i]);
                 assert(num != nullptr);
                 name += std::to_string(num->getNumber());
             }
@@ -448,7 +540,7 @@ std::string Parse::TypeStmt::getName()
 }
 
 std::string Parse::TypeStmt::dumpToXML() const {
-    std::string str = "<Stmt type=\"TypeStmt\" name=\"" + name_ + "\">";
+    std::string str = "<Stmt type=\"TypeStmt\" name=\"" + std::string(name_) + "\">";
     for(auto& arg:arglist_) {
         str += toXMLPair("argument", arg->dumpToXML());
     }
@@ -464,11 +556,11 @@ std::unique_ptr<ExprAST> Parse::TypeStmt::toLLVMAST(ASTContext* context)
     for(auto& stmt:arglist_)
     {
         stmt->toLLVMAST(context);
-        if(dynamic_cast<TypeStmt*>(stmt.get()))
+        if(dynamic_cast<TypeStmt*>(stmt))
             typelist.push_back(stmt->getType());
         else 
         {
-            auto integer = dynamic_cast<IntegerStmt*>(stmt.get());
+            auto integer = dynamic_cast<IntegerStmt*>(stmt);
             if (integer)
                 typelist.push_back(context->addLiteralType(LiteralType::category::Integer, integer->getNumber()));
             else
@@ -480,43 +572,49 @@ std::unique_ptr<ExprAST> Parse::TypeStmt::toLLVMAST(ASTContext* context)
     {
         throw std::logic_error("Unknown type.");
     }
+    if (asRefCounted(type_) && !dynamic_cast<CompoundType*>(typelist[0]))
+        throw std::logic_error("rc and arc only hold classes.");
+    // nothing would release them, see ClassDecl::memberTypeList()
+    if (name_ == "__arr" && asRefCounted(typelist[0]))
+        throw std::logic_error("Arrays of rc or arc are not supported.");
     return nullptr;
 }
 
-Parse::VariableStmt::VariableStmt(const std::string& name): name_(name) {
+Parse::VariableStmt::VariableStmt(std::string_view name): name_(name) {
 }
 
-void Parse::VariableStmt::print(std::string indent, bool last) {
-    std::cout << indent << "+-VariableStmt " << name_ << std::endl;
+void Parse::VariableStmt::print(llvm::raw_ostream& os, std::string indent, bool last) {
+    os << indent << "+-VariableStmt " << ref(name_) << '\n';
 }
 
 std::string Parse::VariableStmt::dumpToXML() const {
-    return "<Stmt type=\"VariableStmt\" name=\"" + name_ + "\"></Stmt>";
+    return "<Stmt type=\"VariableStmt\" name=\"" + std::string(name_) + "\"></Stmt>";
 }
 
 std::unique_ptr<ExprAST> Parse::VariableStmt::toLLVMAST(ASTContext* context) {
-    auto v = context->symbolTable().getVariable(name_);
+    std::string name(name_);
+    auto v = context->symbolTable().getVariable(name);
     if (v) {  // is a variable
         type_ = v->type_;
-        return std::make_unique<VariableExprAST>(name_, v->type_->mangledName());
+        return std::make_unique<VariableExprAST>(name, v->type_);
     }
-    auto f = context->symbolTable().getFunction(name_);
+    auto f = context->symbolTable().getFunction(name);
     if(!f)  // is not a function
-        throw std::logic_error("Unknown identifier: " + name_);
+        throw std::logic_error("Unknown identifier: " + name);
     //type_ = v.type;
     return nullptr;
 }
 
-const std::string& Parse::VariableStmt::getName()
+std::string Parse::VariableStmt::getName()
 {
-    return name_;
+    return std::string(name_);
 }
 
 Parse::IntegerStmt::IntegerStmt(std::int64_t val): val_(val) {
 }
 
-void Parse::IntegerStmt::print(std::string indent, bool last) {
-    std::cout << indent << "+-IntegerStmt " << val_ << std::endl;
+void Parse::IntegerStmt::print(llvm::raw_ostream& os, std::string indent, bool last) {
+    os << indent << "+-IntegerStmt " << val_ << '\n';
 }
 
 std::int64_t Parse::IntegerStmt::getNumber() const
@@ -531,14 +629,14 @@ std::string Parse::IntegerStmt::dumpToXML() const {
 std::unique_ptr<ExprAST> Parse::IntegerStmt::toLLVMAST(ASTContext*c)
 {
     type_ = c->symbolTable().getType("i32");
-    return std::make_unique<IntegerExprAST>(val_);
+    return std::make_unique<IntegerExprAST>(val_, type_);
 }
 
 Parse::FloatStmt::FloatStmt(double val): val_(val) {
 }
 
-void Parse::FloatStmt::print(std::string indent, bool last) {
-    std::cout << indent << "+-FloatStmt " << val_ << std::endl;
+void Parse::FloatStmt::print(llvm::raw_ostream& os, std::string indent, bool last) {
+    os << indent << "+-FloatStmt " << val_ << '\n';
 }
 
 double Parse::FloatStmt::getNumber() const {
@@ -552,45 +650,45 @@ std::string Parse::FloatStmt::dumpToXML() const {
 std::unique_ptr<ExprAST> Parse::FloatStmt::toLLVMAST(ASTContext* c)
 {
     type_ = c->symbolTable().getType("float");
-    return std::make_unique<FloatExprAST>(val_);
+    return std::make_unique<FloatExprAST>(val_, type_);
 }
 
-Parse::FunctionDecl::FunctionDecl(std::string funcName,
-    std::vector<std::pair<std::unique_ptr<Stmt>, std::string>> args,
-    std::unique_ptr<Stmt> retType, std::unique_ptr<CompoundStmt> body,bool isExternal)
-: funcName_(funcName),args_(std::move(args)),retType_(std::move(retType)), body_(std::move(body)),isExternal_(isExternal)
+Parse::FunctionDecl::FunctionDecl(std::string_view funcName,
+    llvm::ArrayRef<std::pair<Stmt*, std::string_view>> args,
+    Stmt* retType, CompoundStmt* body,bool isExternal)
+: funcName_(funcName),args_(args),retType_(retType), body_(body),isExternal_(isExternal),funcType_(nullptr)
 {
 }
 
-void Parse::FunctionDecl::print(std::string indent, bool last) {
-    std::cout << indent << "+-Function " << funcName_ <<" (";
+void Parse::FunctionDecl::print(llvm::raw_ostream& os, std::string indent, bool last) {
+    os << indent << "+-Function " << ref(funcName_) <<" (";
     for (auto it = args_.begin(); it != args_.end();++it) {
-        std::cout << dynamic_cast<TypeStmt*>(it->first.get())->getName();
-        std::cout << " "<<it->second;
-        if (it != args_.end() - 1) std::cout << ",";
+        os << dynamic_cast<TypeStmt*>(it->first)->getName();
+        os << " "<<ref(it->second);
+        if (it != args_.end() - 1) os << ",";
     }
-    std::cout << ") -> ";
-    std::cout << dynamic_cast<TypeStmt*>(retType_.get())->getName();
+    os << ") -> ";
+    os << dynamic_cast<TypeStmt*>(retType_)->getName();
     if(isExternal_) {
-        std::cout << " external" << std::endl;
+        os << " external" << '\n';
     }else {
-        std::cout << std::endl;
-        body_->print(indent, last);
+        os << '\n';
+        body_->print(os, indent, last);
     }
     //indent += last ? "  " : "| ";
 
 }
 
-void Parse::FunctionDecl::setBody(std::unique_ptr<CompoundStmt> body)
+void Parse::FunctionDecl::setBody(CompoundStmt* body)
 {
-    body_ = std::move(body);
+    body_ = body;
 }
 
 std::string Parse::FunctionDecl::dumpToXML() const {
-    std::string str = "<FunctionDecl name=\"" + funcName_ + "\" external=\"" + (isExternal_ ? "true" : "false") + "\">";
+    std::string str = "<FunctionDecl name=\"" + std::string(funcName_) + "\" external=\"" + (isExternal_ ? "true" : "false") + "\">";
     str += "<arguments>";
     for(auto& arg:args_) {
-        str += "<argument name=\""+arg.second+"\">";
+        str += "<argument name=\""+std::string(arg.second)+"\">";
         str+=arg.first->dumpToXML();
         str += "</argument>";
     }
@@ -602,47 +700,34 @@ std::string Parse::FunctionDecl::dumpToXML() const {
     return str;
 }
 
-Parse::ClassDecl::ClassDecl(const std::string& name): name_(name),classType_(nullptr) {
+Parse::ClassDecl::ClassDecl(std::string_view name, llvm::ArrayRef<std::pair<Stmt*, std::string_view>> memberVariables,
+                             llvm::ArrayRef<FunctionDecl*> memberFunctions,
+                             llvm::ArrayRef<FunctionDecl*> constructors, FunctionDecl* destructor,
+                             FunctionDecl* moveConstructor)
+    : name_(name), memberVariables_(memberVariables), memberFunctions_(memberFunctions),
+      constructors_(constructors), destructor_(destructor), moveConstructor_(moveConstructor), classType_(nullptr) {
 }
 
-void Parse::ClassDecl::addMemberFunction(std::unique_ptr<FunctionDecl> func) {
-    memberFunctions_.emplace_back(std::move(func));
-}
-
-void Parse::ClassDecl::addMemberVariable(std::unique_ptr<Stmt> type, const std::string& name) {
-    memberVariables_.emplace_back(std::move(type), name);
-}
-
-void Parse::ClassDecl::addConstructor(std::unique_ptr<FunctionDecl> func)
-{
-    constructors_.emplace_back(std::move(func));
-}
-
-void Parse::ClassDecl::setDestructor(std::unique_ptr<FunctionDecl> func)
-{
-    destructor_=std::move(func);
-}
-
-void Parse::ClassDecl::print(std::string indent, bool last) {
-    std::cout << indent << "+-ClassDecl " << name_ << std::endl;
+void Parse::ClassDecl::print(llvm::raw_ostream& os, std::string indent, bool last) {
+    os << indent << "+-ClassDecl " << ref(name_) << '\n';
     indent += last ? "  " : "| ";
-    std::cout << indent << "+-member variables" << std::endl;
+    os << indent << "+-member variables" << '\n';
     auto extraindent = memberFunctions_.empty() ? "  " : "| ";
     for (auto& p : memberVariables_) {
-        std::cout << indent << extraindent << "+-" << p.second << " " ;
-        std::cout << dynamic_cast<TypeStmt*>(p.first.get())->getName();
-        std::cout << std::endl;
+        os << indent << extraindent << "+-" << ref(p.second) << " " ;
+        os << dynamic_cast<TypeStmt*>(p.first)->getName();
+        os << '\n';
     }
     for (size_t i = 0; i < memberFunctions_.size(); ++i) {
-        memberFunctions_[i]->print(indent, i == memberFunctions_.size() - 1);
+        memberFunctions_[i]->print(os, indent, i == memberFunctions_.size() - 1);
     }
 }
 
 std::string Parse::ClassDecl::dumpToXML() const {
-    std::string str ="<ClassDecl name=\""+name_+"\">";
+    std::string str ="<ClassDecl name=\""+std::string(name_)+"\">";
     str += "<memberVariables>";
     for(auto& var:memberVariables_) {
-        str += "<variable name=\"" + var.second + "\">";
+        str += "<variable name=\"" + std::string(var.second) + "\">";
         str += var.first->dumpToXML();
         str += "</variable>";
     }
@@ -666,39 +751,51 @@ std::string Parse::ClassDecl::dumpToXML() const {
 void Parse::ClassDecl::toLLVM(ASTContext* context)
 {
     std::vector<std::pair<Type*, std::string>> memberList;
-    for(auto& p:memberVariables_)
-    {
-        p.first->toLLVMAST(context);
-        auto type = p.first->getType();
-        memberList.emplace_back(type, p.second);
-    }
-    classType_ = dynamic_cast<CompoundType*>(context->addType(name_, std::move(memberList)));
+    classType_ = dynamic_cast<CompoundType*>(context->addType(std::string(name_), memberTypeList(context)));
     generateNewFunction(context);
 }
 
 void Parse::ClassDecl::generateNewFunction(ASTContext* context) {
     std::vector<Type*> typeArgs;
     typeArgs.push_back(classType_);
-    SymbolTable::NamespaceGuard guard(context->symbolTable(), name());
-    context->symbolTable().addFunction(
-    "new", std::vector<std::pair<Type*, std::string>>{},context->symbolTable().getType("__ptr",typeArgs));
+    auto& st = context->symbolTable();
+    SymbolTable::NamespaceGuard guard(st, name());
+    auto ptrType = st.getType("__ptr", typeArgs);
+    st.addFunction("new", std::vector<std::pair<Type*, std::string>>{}, ptrType);
+    st.addFunction("delete", { { ptrType, "p" } }, st.getType("void"));
 }
 
-const std::vector<std::pair<std::unique_ptr<Parse::Stmt>, std::string>>& Parse::ClassDecl::getMemberVariables()
+llvm::ArrayRef<std::pair<Parse::Stmt*, std::string_view>> Parse::ClassDecl::getMemberVariables()
 {
     return memberVariables_;
 }
 
 void Parse::FunctionDecl::toLLVM(ASTContext* context)
 {
+    if (!context->codeGenerator()) {
+        if (auto ast = toFunctionAST(context)) context->addFunctionAST(std::move(ast));
+        return;
+    }
     SymbolTable::ScopeGuard guard(context->symbolTable());
+    SymbolTable::FunctionGuard function(context->symbolTable());
     for (auto& arg : funcType_->args()) {
         context->symbolTable().addVariable(arg.first, arg.second);
     }
-    if (!isExternal_&&body_) {
-        auto body = body_->toBlockExprAST(context);
-        context->setFuncBody(funcType_, std::move(body));
+    if (!isExternal_&&body_) toLLVMIR(context);
+}
+
+std::unique_ptr<FunctionAST> Parse::FunctionDecl::toFunctionAST(ASTContext* context)
+{
+    if (isExternal_ || !body_) return nullptr;
+    SymbolTable::ScopeGuard guard(context->symbolTable());
+    SymbolTable::FunctionGuard function(context->symbolTable());
+    for (auto& arg : funcType_->args()) {
+        context->symbolTable().addVariable(arg.first, arg.second);
     }
+    auto body = body_->toBlockExprAST(context);
+    // the arguments and locals are destroyed when the end is reached
+    if (!body->hasReturn()) guard.setBlock(body.get());
+    return std::make_unique<FunctionAST>(funcType_->mangledName(), std::move(body), context->currentClass());
 }
 
 Parse::FunctionType* Parse::FunctionDecl::registerPrototype(ASTContext* context) {
@@ -710,7 +807,7 @@ Parse::FunctionType* Parse::FunctionDecl::registerPrototype(ASTContext* context)
         arglist.emplace_back(type, p.second);
     }
     retType_->toLLVMAST(context);
-    funcType_ = context->addFuncPrototype(funcName_, std::move(arglist), retType_->getType(), isExternal_);
+    funcType_ = context->addFuncPrototype(std::string(funcName_), std::move(arglist), retType_->getType(), isExternal_);
     
     return funcType_;
 }
@@ -718,8 +815,13 @@ Parse::FunctionType* Parse::FunctionDecl::registerPrototype(ASTContext* context)
 void Parse::ClassDecl::registerMemberFunction(ASTContext* context) {
     ASTContext::ClassScopeGuard guard(*context, classType_);
     for(auto& f:constructors_) {
-        
-        classType_->addConstructor(f->registerPrototype(context));
+        auto constructor = f->registerPrototype(context);
+        classType_->addConstructor(constructor);
+        if (f != moveConstructor_) continue;
+        auto& args = constructor->args();
+        if (args.size() != 1 || args[0].first->getTypename() != "__ptr" || args[0].first->getTemplateArgs()[0] != classType_)
+            throw std::logic_error("The move constructor of " + name() + " has to take a __ptr<" + name() + ">.");
+        classType_->setMoveConstructor(constructor);
     }
     for(auto& f:memberFunctions_) {
         classType_->addFunction(f->registerPrototype(context));
@@ -742,6 +844,8 @@ std::vector<std::pair<Parse::Type*, std::string>> Parse::ClassDecl::memberTypeLi
     for (auto& p : memberVariables_) {
         p.first->toLLVMAST(context);
         auto type = p.first->getType();
+        // members are neither initialized nor destroyed
+        if (asRefCounted(type)) throw std::logic_error("Members of type rc or arc are not supported.");
         memberList.emplace_back(type, p.second);
     }
     return memberList;
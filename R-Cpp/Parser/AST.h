@@ -1,24 +1,41 @@
 #pragma once
 #include <memory>
+#include <string_view>
 #include <vector>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/Support/raw_ostream.h>
 #include "../Util/Operator.h"
 #include "../CodeGenerator/AST.h"
 #include "ASTContext.h"
 
+// All Stmt and Decl nodes are allocated by ASTContext::create() and freed
+// together with the context without running destructors. They refer to
+// their children through plain pointers, and to names and child lists
+// copied into the same arena.
 namespace Parse
 {
+    // What a Stmt lowers to when it is emitted straight to IR: its value
+    // and, for variables, members, subscripts and dereferences, the address
+    // the value was loaded from.
+    struct LoweredValue
+    {
+        llvm::Value* value = nullptr;
+        llvm::Value* address = nullptr;
+    };
+
     class Decl
     {
     public:
-        virtual void print(std::string indent, bool last)=0;
+        virtual void print(llvm::raw_ostream& os, std::string indent, bool last)=0;
         virtual std::string dumpToXML() const = 0;
-        virtual ~Decl() = default;
+    protected:
+        ~Decl() = default;
     };
 
     class Stmt
     {
     public:
-        Stmt()
+        Stmt(): type_(nullptr), temporary_(0)
         {}
 
         auto getType()
@@ -30,149 +47,192 @@ namespace Parse
             type_ = t;
         }
 
-        virtual void print(std::string indent, bool last)=0;
+        virtual void print(llvm::raw_ostream& os, std::string indent, bool last)=0;
         virtual std::string dumpToXML() const = 0;
         virtual std::unique_ptr<ExprAST> toLLVMAST(ASTContext*) = 0;
-        virtual ~Stmt() {
-            //assert(type_!=nullptr);
-        }
+        // Does the checks of toLLVMAST() and emits the IR right away through
+        // ASTContext::codeGenerator(), see Lowering.cpp.
+        virtual LoweredValue toLLVMIR(ASTContext*) = 0;
+        // toLLVMIR() for a consumer that takes the value over if it is a
+        // temporary: a class built by a construction or a call is built in
+        // destination then, and the value is destination.
+        virtual LoweredValue lowerInto(ASTContext* context, llvm::Value* /*destination*/) { return toLLVMIR(context); }
+        // Set by lowering when the value is a new rc or arc, or a class,
+        // that nothing else refers to yet, from a construction or a call:
+        // the id of the temporary keeping it until the end of the
+        // statement, see ASTContext::takeTemporary(). 0 otherwise.
+        int64_t temporary() const { return temporary_; }
         Type* type_;
+        int64_t temporary_;
+    protected:
+        ~Stmt() = default;
     };
 
+    FunctionType* findSuitableFunction(llvm::ArrayRef<Stmt*> argList, const std::vector<FunctionType*>* fnList);
+    FunctionType* findSuitableFunction(llvm::ArrayRef<Stmt*> argList,
+                                       const std::vector<std::unique_ptr<FunctionType>>* fnList);
+
+    // How `return value;` hands the value to the caller.
+    enum class ReturnKind
+    {
+        Value,          // as it is, a temporary or a local is moved out
+        Retain,         // an rc or arc of someone else, retained
+        InPlace,        // a class temporary, built in the return slot
+        MoveConstruct   // a local class, moved by its move constructor
+    };
+
+    // What `return value;` destroys, the temporaries and then the variables
+    // of the function, and how the value is returned. A temporary is taken
+    // over. A local rc or arc, or a local class without a move constructor,
+    // is moved out instead of being destroyed.
+    ASTContext::Destructibles returnDestructibles(ASTContext* context, Stmt* value, ReturnKind& kind);
+
     class CompoundStmt:public Stmt
     {
     public:
-        CompoundStmt(std::vector<std::unique_ptr<Stmt>> exprs);
-        void print(std::string indent, bool last) override;
+        CompoundStmt(llvm::ArrayRef<Stmt*> exprs);
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
         std::string dumpToXML() const override;
         std::unique_ptr<ExprAST> toLLVMAST(ASTContext*) override;
         std::unique_ptr<BlockExprAST> toBlockExprAST(ASTContext*);
+        LoweredValue toLLVMIR(ASTContext*) override;
+        // Returns whether the block has a return statement; with
+        // untilReturn nothing after the first one is emitted.
+        bool lowerBlock(ASTContext* context, bool untilReturn);
     private:
-        std::vector<std::unique_ptr<Stmt>> stmts_;
+        llvm::ArrayRef<Stmt*> stmts_;
     };
 
     class IfStmt :public Stmt
     {
     public:
-        IfStmt(std::unique_ptr<Stmt> condition, std::unique_ptr<CompoundStmt> then,
-               std::unique_ptr<CompoundStmt> els = nullptr);
+        IfStmt(Stmt* condition, CompoundStmt* then, CompoundStmt* els = nullptr);
 
-        void print(std::string indent, bool last) override;
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
         std::string dumpToXML() const override;
         std::unique_ptr<ExprAST> toLLVMAST(ASTContext* context) override;
+        LoweredValue toLLVMIR(ASTContext* context) override;
     private:
-        std::unique_ptr<Stmt> cond_;
-        std::unique_ptr<CompoundStmt> then_;
-        std::unique_ptr<CompoundStmt> else_;
+        Stmt* cond_;
+        CompoundStmt* then_;
+        CompoundStmt* else_;
     };
 
     class ForStmt: public Stmt
     {
     public:
-        ForStmt(std::unique_ptr<Stmt> start, std::unique_ptr<Stmt> cond, std::unique_ptr<Stmt> end,
-                std::unique_ptr<CompoundStmt> body);
+        ForStmt(Stmt* start, Stmt* cond, Stmt* end, CompoundStmt* body);
 
-        void print(std::string indent, bool last) override;
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
         std::string dumpToXML() const override;
         std::unique_ptr<ExprAST> toLLVMAST(ASTContext*) override;
+        LoweredValue toLLVMIR(ASTContext*) override;
     private:
-        std::unique_ptr<Stmt> start_, cond_, end_;
-        std::unique_ptr<CompoundStmt> body_;
+        Stmt *start_, *cond_, *end_;
+        CompoundStmt* body_;
     };
 
     class ReturnStmt: public Stmt
     {
     public:
-        ReturnStmt(std::unique_ptr<Stmt> returnVal);
-        void print(std::string indent, bool last) override;
+        ReturnStmt(Stmt* returnVal);
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
         std::string dumpToXML() const override;
         std::unique_ptr<ExprAST> toLLVMAST(ASTContext*) override;
+        LoweredValue toLLVMIR(ASTContext*) override;
     private:
-        std::unique_ptr<Stmt> ret_val_;
+        Stmt* ret_val_;
     };
 
     class BinaryOperatorStmt :public Stmt
     {
     public:
-        BinaryOperatorStmt(std::unique_ptr<Stmt> lhs, std::unique_ptr<Stmt> rhs, OperatorType op);
-        void print(std::string indent, bool last) override;
+        BinaryOperatorStmt(Stmt* lhs, Stmt* rhs, OperatorType op);
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
         std::string dumpToXML() const override;
         std::unique_ptr<ExprAST> toLLVMAST(ASTContext*) override;
+        LoweredValue toLLVMIR(ASTContext*) override;
+        LoweredValue lowerInto(ASTContext* context, llvm::Value* destination) override;
         Type* getLHSType();
         Type* getRHSType();
 
     private:
-        std::unique_ptr<Stmt> lhs_;
-        std::unique_ptr<Stmt> rhs_;
+        Stmt* lhs_;
+        Stmt* rhs_;
         OperatorType op_;
     };
 
     class UnaryOperatorStmt :public Stmt
     {
     public:
-        UnaryOperatorStmt(std::unique_ptr<Stmt> expr, OperatorType op);
-        UnaryOperatorStmt(std::unique_ptr<Stmt> expr, OperatorType op, std::vector<std::unique_ptr<Stmt>> args);
+        UnaryOperatorStmt(Stmt* expr, OperatorType op, llvm::ArrayRef<Stmt*> args = {});
 
-        void print(std::string indent, bool last) override;
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
         std::string dumpToXML() const override;
         std::unique_ptr<ExprAST> toLLVMAST(ASTContext*) override;
+        LoweredValue toLLVMIR(ASTContext*) override;
+        LoweredValue lowerInto(ASTContext* context, llvm::Value* destination) override;
 
     private:
-        std::unique_ptr<Stmt> stmt_;
+        Stmt* stmt_;
         OperatorType op_;
-        std::vector<std::unique_ptr<Stmt>> args_;
+        llvm::ArrayRef<Stmt*> args_;
     };
 
     class VariableDefStmt: public Stmt
     {
     public:
-        VariableDefStmt(std::unique_ptr<Stmt> type, const std::string& name);
+        VariableDefStmt(Stmt* type, std::string_view name);
 
-        void setInitValue(std::unique_ptr<Stmt> initVal);
-        void print(std::string indent, bool last) override;
+        void setInitValue(Stmt* initVal);
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
         std::string dumpToXML() const override;
         std::unique_ptr<ExprAST> toLLVMAST(ASTContext*) override;
+        LoweredValue toLLVMIR(ASTContext*) override;
     private:
-        std::unique_ptr<Stmt> vartype_;
-        std::string name_;
-        std::unique_ptr<Stmt> init_val_;
+        Stmt* vartype_;
+        std::string_view name_;
+        Stmt* init_val_;
     };
 
     class TypeStmt: public Stmt
     {
     public:
-        TypeStmt(const std::string& name, std::vector<std::unique_ptr<Stmt>> arglist = {});
-        void print(std::string indent, bool last) override;
+        TypeStmt(std::string_view name, llvm::ArrayRef<Stmt*> arglist = {});
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
 
         std::string getName();
         std::string dumpToXML() const override;
         std::unique_ptr<ExprAST> toLLVMAST(ASTContext*) override;
+        LoweredValue toLLVMIR(ASTContext*) override;
     private:
-        std::string name_;
-        std::vector<std::unique_ptr<Stmt>> arglist_;
+        std::string_view name_;
+        llvm::ArrayRef<Stmt*> arglist_;
     };
 
 
     class VariableStmt: public Stmt
     {
     public:
-        VariableStmt(const std::string& name);
-        void print(std::string indent, bool last) override;
+        VariableStmt(std::string_view name);
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
         std::string dumpToXML() const override;
         std::unique_ptr<ExprAST> toLLVMAST(ASTContext*) override;
-        const std::string& getName();
+        LoweredValue toLLVMIR(ASTContext*) override;
+        std::string getName();
     private:
-        std::string name_;
+        std::string_view name_;
     };
 
     class IntegerStmt: public Stmt
     {
     public:
         IntegerStmt(std::int64_t val);
-        void print(std::string indent, bool last) override;
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
         std::int64_t getNumber() const;
         std::string dumpToXML() const override;
         std::unique_ptr<ExprAST> toLLVMAST(ASTContext*) override;
+        LoweredValue toLLVMIR(ASTContext*) override;
     private:
         std::int64_t val_;
     };
@@ -181,10 +241,11 @@ namespace Parse
     {
     public:
         FloatStmt(double val);
-        void print(std::string indent, bool last) override;
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
         double getNumber()const;
         std::string dumpToXML() const override;
         std::unique_ptr<ExprAST> toLLVMAST(ASTContext*) override;
+        LoweredValue toLLVMIR(ASTContext*) override;
     private:
         double val_;
     };
@@ -198,21 +259,27 @@ namespace Parse
     class FunctionDecl:public Decl
     {
     public:
-        FunctionDecl(std::string funcName,
-        std::vector<std::pair<std::unique_ptr<Stmt>, std::string>> args,
-        std::unique_ptr<Stmt> retType ,
-        std::unique_ptr<CompoundStmt> body = nullptr, bool isExternal=false);
-        void print(std::string indent, bool last) override;
-        void setBody(std::unique_ptr<CompoundStmt> body);
+        FunctionDecl(std::string_view funcName,
+        llvm::ArrayRef<std::pair<Stmt*, std::string_view>> args,
+        Stmt* retType,
+        CompoundStmt* body = nullptr, bool isExternal=false);
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
+        void setBody(CompoundStmt* body);
         std::string dumpToXML() const override;
         void toLLVM(ASTContext* context);
+        void toLLVMIR(ASTContext* context);
+        // checks the body and returns its FunctionAST without adding it to
+        // the context, nullptr if there is no body
+        std::unique_ptr<FunctionAST> toFunctionAST(ASTContext* context);
         FunctionType* registerPrototype(ASTContext* context);
+        // set by registerPrototype()
+        FunctionType* type() const { return funcType_; }
 
     private:
-        std::string funcName_;
-        std::vector<std::pair<std::unique_ptr<Stmt>, std::string>> args_;
-        std::unique_ptr<Stmt> retType_;
-        std::unique_ptr<CompoundStmt> body_;
+        std::string_view funcName_;
+        llvm::ArrayRef<std::pair<Stmt*, std::string_view>> args_;
+        Stmt* retType_;
+        CompoundStmt* body_;
         bool isExternal_;
         FunctionType* funcType_;
     };
@@ -221,28 +288,31 @@ namespace Parse
     class ClassDecl:public Decl
     {
     public:
-        ClassDecl(const std::string& name);
-
-        void addMemberFunction(std::unique_ptr<FunctionDecl> func);
-        void addMemberVariable(std::unique_ptr<Stmt> type, const std::string& name);
-        void addConstructor(std::unique_ptr<FunctionDecl> func);
-        void setDestructor(std::unique_ptr<FunctionDecl> func);
-        void print(std::string indent, bool last) override;
-        const std::string& name() { return name_; }
+        ClassDecl(std::string_view name, llvm::ArrayRef<std::pair<Stmt*, std::string_view>> memberVariables,
+                  llvm::ArrayRef<FunctionDecl*> memberFunctions, llvm::ArrayRef<FunctionDecl*> constructors,
+                  FunctionDecl* destructor, FunctionDecl* moveConstructor = nullptr);
+
+        void print(llvm::raw_ostream& os, std::string indent, bool last) override;
+        std::string name() { return std::string(name_); }
         std::string dumpToXML() const override;
         void toLLVM(ASTContext* context);
-        const std::vector<std::pair<std::unique_ptr<Stmt>, std::string>>& getMemberVariables();
+        llvm::ArrayRef<std::pair<Stmt*, std::string_view>> getMemberVariables();
         void registerMemberFunction(ASTContext* context);
+        // registers Class::new() and Class::delete(p)
         void generateNewFunction(ASTContext* context);
 
         std::vector<std::pair<Type*, std::string>> memberTypeList(ASTContext* context);
         void setType(CompoundType* type);
+        // set by toLLVM()
+        CompoundType* type() const { return classType_; }
     private:
-        std::string name_;
-        std::vector<std::pair<std::unique_ptr<Stmt>, std::string>> memberVariables_;
-        std::vector<std::unique_ptr<FunctionDecl>> memberFunctions_;
-        std::vector<std::unique_ptr<FunctionDecl>> constructors_;
-        std::unique_ptr<FunctionDecl> destructor_;
+        std::string_view name_;
+        llvm::ArrayRef<std::pair<Stmt*, std::string_view>> memberVariables_;
+        llvm::ArrayRef<FunctionDecl*> memberFunctions_;
+        llvm::ArrayRef<FunctionDecl*> constructors_;
+        FunctionDecl* destructor_;
+        // one of constructors_, declared with move
+        FunctionDecl* moveConstructor_;
         CompoundType* classType_;
     };
 
@@ -1,9 +1,9 @@
 #include "ASTContext.h"
 #include "SymbolTable.h"
 #include "AST.h"
+#include "../CodeGenerator/CodeGenerator.h"
 
-Parse::ASTContext::ASTContext(): symbol_table_(std::make_unique<SymbolTable>(*this)), nameless_var_count_(1),
-                                 cur_parsing_class_(nullptr) {
+Parse::ASTContext::ASTContext(): symbol_table_(std::make_unique<SymbolTable>(*this)), cur_parsing_class_(nullptr), codegen_(nullptr) {
 
 }
 
@@ -11,8 +11,19 @@ Parse::SymbolTable& Parse::ASTContext::symbolTable() {
     return *symbol_table_;
 }
 
+std::string_view Parse::ASTContext::copyString(std::string_view str) {
+    if (str.empty()) return {};
+    auto p = arena_.Allocate<char>(str.size());
+    std::copy(str.begin(), str.end(), p);
+    return { p, str.size() };
+}
+
+size_t Parse::ASTContext::arenaBytes() const {
+    return arena_.getBytesAllocated();
+}
+
 int64_t Parse::ASTContext::getNamelessVarCount() {
-    return nameless_var_count_++;
+    return symbolTable().body().namelessVarCount++;
 }
 
 void Parse::ASTContext::addClassAST(std::unique_ptr<ClassAST> ast) {
@@ -20,9 +31,9 @@ void Parse::ASTContext::addClassAST(std::unique_ptr<ClassAST> ast) {
     classes_.push_back(std::move(ast));
 }
 
-void Parse::ASTContext::addClassTemplate(std::vector<std::pair<std::string, std::string>> arglist, std::unique_ptr<ClassDecl> decl)
+void Parse::ASTContext::addClassTemplate(std::vector<std::pair<std::string, std::string>> arglist, ClassDecl* decl)
 {
-    symbolTable().addClassTemplate(std::move(arglist), std::move(decl));
+    symbolTable().addClassTemplate(std::move(arglist), decl);
 }
 
 Parse::Type* Parse::ASTContext::
@@ -35,30 +46,31 @@ addType(const std::string& name, std::vector<std::pair<Type*, std::string>> memb
 Parse::FunctionType* Parse::ASTContext::addFuncPrototype(const std::string& name,
                                                          std::vector<std::pair<Type*, std::string>> argList,
                                                          Type* returnType, bool isExternal) {
-    std::vector<std::pair<std::string, std::string>> members;
-    for (auto& m : argList) {
-        members.emplace_back(m.first->mangledName(), m.second);
+    if (codegen_) {
+        auto fn = symbol_table_->addFunction(name, std::move(argList), returnType, currentClass(), isExternal);
+        codegen_->declareFunction(fn);
+        return fn;
     }
+    auto members = argList;
     auto fn = symbol_table_->addFunction(name, std::move(argList), returnType,currentClass(),  isExternal);
     prototype_.push_back(std::make_unique<PrototypeAST>(fn->mangledName(), std::move(members),
-                                                        returnType->mangledName(),
-                                                        currentClass() == nullptr
-                                                            ? ""
-                                                            : currentClass()->mangledName()));
+                                                        returnType, currentClass()));
     return fn;
 }
 
-void Parse::ASTContext::setFuncBody(FunctionType* func, std::unique_ptr<BlockExprAST> body) {
-    auto c = currentClass();
-    functions_.push_back(
-        std::make_unique<FunctionAST>(func->mangledName(), std::move(body), c == nullptr ? "" : c->mangledName()));
-
+void Parse::ASTContext::addFunctionAST(std::unique_ptr<FunctionAST> ast) {
+    assert(ast != nullptr);
+    functions_.push_back(std::move(ast));
 }
 
 Parse::LiteralType* Parse::ASTContext::addLiteralType(LiteralType::category type, int64_t val)
 {
-    literal_types_.push_back(std::make_unique<LiteralType>(LiteralType::category::Integer, val));
-    return literal_types_.back().get();
+    auto it = literal_types_.find({ type, val });
+    if (it != literal_types_.end()) return it->second.get();
+    if (symbol_table_->frozen()) throw SymbolTable::FrozenError();
+    auto& literal = literal_types_[{ type, val }];
+    literal = std::make_unique<LiteralType>(type, val);
+    return literal.get();
 }
 
 std::vector<std::unique_ptr<ClassAST>>* Parse::ASTContext::Class() {
@@ -90,64 +102,95 @@ void Parse::ASTContext::unsetCurrentClass() {
     symbolTable().destroyScope();
 }
 
-std::string Parse::ASTContext::namelessVarName() {
-    return "__" + std::to_string(nameless_var_count_++);
+std::string Parse::ASTContext::namelessVarName(int64_t id) {
+    return "__" + std::to_string(id);
+}
+
+bool Parse::ASTContext::takeTemporary(Stmt* stmt) {
+    if (!stmt->temporary()) return false;
+    symbolTable().takeNamelessVariable(namelessVarName(stmt->temporary()));
+    return true;
 }
 
 void Parse::ASTContext::addLLVMType(CompoundType* t)
 {
-    std::vector<std::pair<std::string, std::string>> members;
-    for (auto& m : t->getMemberVariables()) {
-        members.emplace_back(m.first->mangledName(), m.second);
+    if (codegen_) {
+        class_types_.push_back(t);
+        codegen_->declareClass(t);
+        return;
     }
-    classes_.push_back(std::make_unique<ClassAST>(t->mangledName(), std::move(members), t));
+    classes_.push_back(std::make_unique<ClassAST>(t));
 }
 
-std::vector<std::unique_ptr<ExprAST>> Parse::ASTContext::callDestructorsOfScope() {
+std::vector<std::unique_ptr<ExprAST>> Parse::ASTContext::callDestructors(const Destructibles& vars) {
     std::vector<std::unique_ptr<ExprAST>> exprlist;
-    auto varlist = symbolTable().getVariableListOfScope();
-    for(auto it=varlist.rbegin();it!=varlist.rend();++it) {
-        auto type = dynamic_cast<CompoundType*>(symbolTable().getVariable(*it)->type_);
-        if(type !=nullptr) {
-            auto s = std::make_unique<CallExprAST>(type->getDestructor()->mangledName(), std::vector<std::unique_ptr<ExprAST>>{}, "void");
-            s->setThis(std::make_unique<VariableExprAST>(*it, type->mangledName()));
-           // BinaryOperatorStmt stmt(std::make_unique<VariableStmt>(*it), std::make_unique<VariableStmt>("__destructor"), OperatorType::FunctionCall);
-            exprlist.push_back(std::move(s));
+    for (auto& v : vars) {
+        auto var = std::make_unique<VariableExprAST>(v.second, v.first);
+        if (asRefCounted(v.first)) {
+            exprlist.push_back(std::make_unique<ReleaseAST>(std::move(var)));
+            continue;
         }
+        auto type = static_cast<CompoundType*>(v.first);
+        auto s = std::make_unique<CallExprAST>(type->getDestructor()->mangledName(), std::vector<std::unique_ptr<ExprAST>>{}, nullptr);
+        s->setThis(std::move(var));
+        exprlist.push_back(std::move(s));
     }
     return exprlist;
 }
 
+std::vector<std::unique_ptr<ExprAST>> Parse::ASTContext::callDestructorsOfScope() {
+    return callDestructors(destructiblesOfScope());
+}
+
 std::vector<std::unique_ptr<ExprAST>> Parse::ASTContext::callNamelessVariablesDestructor() {
-    std::vector<std::unique_ptr<ExprAST>> exprlist;
+    return callDestructors(namelessDestructibles());
+}
+
+Parse::ASTContext::Destructibles Parse::ASTContext::destructiblesOfScope() {
+    return destructiblesFrom(symbolTable().scopeBegin());
+}
+
+Parse::ASTContext::Destructibles Parse::ASTContext::namelessDestructibles() {
+    Destructibles vars;
     auto& varlist = symbolTable().getNamelessVariableList();
     for(auto it=varlist.rbegin();it!=varlist.rend();++it) {
-        auto type = dynamic_cast<CompoundType*>((*it)->type_);
-        if (type != nullptr) {
-            auto s = std::make_unique<CallExprAST>(type->getDestructor()->mangledName(), std::vector<std::unique_ptr<ExprAST>>{}, "void");
-            s->setThis(std::make_unique<VariableExprAST>((*it)->name_, type->mangledName()));
-
-            //BinaryOperatorStmt stmt(std::make_unique<VariableStmt>((*it)->name_), std::make_unique<VariableStmt>("__destructor"), OperatorType::FunctionCall);
-            exprlist.push_back(std::move(s));
+        auto type = (*it)->type_;
+        if (dynamic_cast<CompoundType*>(type) || asRefCounted(type)) {
+            vars.emplace_back(type, (*it)->name_);
         }
     }
     symbolTable().clearNamelessVariable();
-    return exprlist;
+    return vars;
 }
 
-std::vector<std::unique_ptr<ExprAST>> Parse::ASTContext::callDestructorsOfAll() {
-    std::vector<std::unique_ptr<ExprAST>> exprlist;
-    auto& varlist = symbolTable().getVariableListOfAll();
-    for(auto i=varlist.rbegin();i!=varlist.rend();++i) {
-        for (auto it = i->rbegin(); it != i->rend(); ++it) {
-            auto type = dynamic_cast<CompoundType*>(symbolTable().getVariable(*it)->type_);
-            if (type != nullptr) {
-                auto s = std::make_unique<CallExprAST>(type->getDestructor()->mangledName(), std::vector<std::unique_ptr<ExprAST>>{}, "void");
-                s->setThis(std::make_unique<VariableExprAST>(*it, type->mangledName()));
-                // BinaryOperatorStmt stmt(std::make_unique<VariableStmt>(*it), std::make_unique<VariableStmt>("__destructor"), OperatorType::FunctionCall);
-                exprlist.push_back(std::move(s));
-            }
+Parse::ASTContext::Destructibles Parse::ASTContext::destructiblesOfAll() {
+    return destructiblesFrom(symbolTable().functionBegin());
+}
+
+// the variables declared since the first'th, latest first
+Parse::ASTContext::Destructibles Parse::ASTContext::destructiblesFrom(size_t first) {
+    Destructibles vars;
+    for (auto i = symbolTable().variableCount(); i-- > first;) {
+        auto v = symbolTable().variableAt(i);
+        if (dynamic_cast<CompoundType*>(v->type_) || asRefCounted(v->type_)) {
+            vars.emplace_back(v->type_, v->name_);
         }
     }
-    return exprlist;
+    return vars;
+}
+
+void Parse::ASTContext::setCodeGenerator(CG::CodeGenerator* cg) {
+    codegen_ = cg;
+}
+
+CG::CodeGenerator* Parse::ASTContext::codeGenerator() const {
+    return codegen_;
+}
+
+const std::vector<Parse::CompoundType*>& Parse::ASTContext::classTypes() const {
+    return class_types_;
+}
+
+bool Parse::ASTContext::addImport(const std::string& name) {
+    return imports_.insert(name).second;
 }
@@ -1,9 +1,17 @@
 #pragma once
+#include <map>
+#include <set>
+#include <string_view>
+#include <type_traits>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/Support/Allocator.h>
 #include "SymbolTable.h"
 #include "../CodeGenerator/AST.h"
 
 namespace Parse
 {
+    class Stmt;
+
     class ASTContext
     {
     public:
@@ -16,20 +24,61 @@ namespace Parse
         Type* addType(const std::string& name, std::vector<std::pair<Type*, std::string>> memberList);
         FunctionType* addFuncPrototype(const std::string& name, std::vector<std::pair<Type*, std::string>> argList,
                                        Type* returnType, bool isExternal = false);
-        void setFuncBody(FunctionType* func, std::unique_ptr<BlockExprAST> body);
+        void addFunctionAST(std::unique_ptr<FunctionAST> ast);
+        // one LiteralType per value, so that template instances compare equal
         LiteralType* addLiteralType(LiteralType::category type, int64_t val);
-        void addClassTemplate(std::vector<std::pair<std::string, std::string>> arglist, std::unique_ptr<ClassDecl> decl);
+        void addClassTemplate(std::vector<std::pair<std::string, std::string>> arglist, ClassDecl* decl);
         std::vector<std::unique_ptr<ClassAST>>* Class();
         std::vector<std::unique_ptr<PrototypeAST>>* Prototype();
         std::vector<std::unique_ptr<FunctionAST>>* Function();
         CompoundType* currentClass() const;
         void setCurrentClass(CompoundType* t);
         void unsetCurrentClass();
-        std::string namelessVarName();
+        static std::string namelessVarName(int64_t id);
+        // Takes over the temporary stmt evaluated to, see Stmt::temporary(),
+        // so that it isn't destroyed at the end of the statement. False if
+        // stmt's value isn't one, the consumer has to retain an rc or copy
+        // a class then.
+        bool takeTemporary(Stmt* stmt);
         void addLLVMType(CompoundType* t);
         std::vector<std::unique_ptr<ExprAST>> callDestructorsOfScope();
         std::vector<std::unique_ptr<ExprAST>> callNamelessVariablesDestructor();
-        std::vector<std::unique_ptr<ExprAST>> callDestructorsOfAll();
+        // <type, variable> whose destructors the calls above run, in order:
+        // classes, and rc and arc which are released instead
+        using Destructibles = std::vector<std::pair<Type*, std::string>>;
+        static std::vector<std::unique_ptr<ExprAST>> callDestructors(const Destructibles& vars);
+        Destructibles destructiblesOfScope();
+        Destructibles namelessDestructibles();
+        // those of the function being lowered, its arguments included
+        Destructibles destructiblesOfAll();
+
+        // When set, types, prototypes and function bodies are lowered to IR
+        // through it as they are checked, and no ClassAST, PrototypeAST or
+        // FunctionAST is built.
+        void setCodeGenerator(CG::CodeGenerator* cg);
+        CG::CodeGenerator* codeGenerator() const;
+        // classes in the order Class() would list them, for direct lowering
+        const std::vector<CompoundType*>& classTypes() const;
+        // false if the module was imported already
+        bool addImport(const std::string& name);
+
+        // Parse::Stmt and Parse::Decl nodes are bump allocated here and
+        // released in one go with the context, their destructors never run.
+        template <typename T, typename... Args>
+        T* create(Args&&... args) {
+            static_assert(std::is_trivially_destructible<T>::value, "arena nodes are never destroyed");
+            return new (arena_.Allocate<T>()) T(std::forward<Args>(args)...);
+        }
+        template <typename T>
+        llvm::ArrayRef<T> copyArray(const std::vector<T>& v) {
+            static_assert(std::is_trivially_destructible<T>::value, "arena nodes are never destroyed");
+            if (v.empty()) return {};
+            auto p = arena_.Allocate<T>(v.size());
+            std::uninitialized_copy(v.begin(), v.end(), p);
+            return { p, v.size() };
+        }
+        std::string_view copyString(std::string_view str);
+        size_t arenaBytes() const;
         struct ClassScopeGuard
         {
         public:
@@ -45,13 +94,18 @@ namespace Parse
         };
 
     private:
+        Destructibles destructiblesFrom(size_t first);
+
+        llvm::BumpPtrAllocator arena_;
         std::unique_ptr<SymbolTable> symbol_table_;
         std::vector<std::unique_ptr<ClassAST>> classes_;
         std::vector<std::unique_ptr<PrototypeAST>> prototype_;
         std::vector<std::unique_ptr<FunctionAST>> functions_;
-        std::vector<std::unique_ptr<LiteralType>> literal_types_;
-        int64_t nameless_var_count_;
+        std::map<std::pair<LiteralType::category, int64_t>, std::unique_ptr<LiteralType>> literal_types_;
 
         CompoundType* cur_parsing_class_;
+        CG::CodeGenerator* codegen_;
+        std::vector<CompoundType*> class_types_;
+        std::set<std::string> imports_;
     };
 }
@@ -0,0 +1,438 @@
+// Direct lowering of the Parse:: tree to LLVM IR.
+//
+// With CodeGenerator::enableDirectLowering() convertToLLVM() checks and
+// emits every function body in a single walk instead of building the
+// ExprAST tree first. Each toLLVMIR() does the checks of the matching
+// toLLVMAST() and emits what the matching ExprAST::generateCode() would,
+// unused loads included, so both paths give the same module.
+#include "AST.h"
+#include "../CodeGenerator/CodeGenerator.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Verifier.h"
+#include <iostream>
+
+static Parse::LoweredValue lowerError(const std::string& msg) {
+    std::cout << msg << std::endl;
+    return {};
+}
+
+static llvm::Value* int32(CG::CodeGenerator& cg, int64_t val, bool isSigned = false) {
+    return llvm::ConstantInt::get(cg.context(), llvm::APInt(32, val, isSigned));
+}
+
+// see ownedValue() in AST.cpp
+static llvm::Value* ownedValue(Parse::Stmt* stmt, llvm::Value* value, Parse::ASTContext* context) {
+    auto rc = Parse::asRefCounted(stmt->getType());
+    if (rc && !context->takeTemporary(stmt)) context->codeGenerator()->retain(value, rc);
+    return value;
+}
+
+Parse::LoweredValue Parse::CompoundStmt::toLLVMIR(ASTContext* context)
+{
+    lowerBlock(context, false);
+    return {};
+}
+
+bool Parse::CompoundStmt::lowerBlock(ASTContext* context, bool untilReturn)
+{
+    auto& cg = *context->codeGenerator();
+    bool hasReturn = false;
+    for (auto& stmt : stmts_) {
+        stmt->toLLVMIR(context);
+        if (dynamic_cast<ReturnStmt*>(stmt)) {
+            hasReturn = true;
+            context->symbolTable().clearNamelessVariable();
+            if (untilReturn) break;
+        } else {
+            cg.callDestructors(context->namelessDestructibles());
+        }
+    }
+    return hasReturn;
+}
+
+Parse::LoweredValue Parse::IfStmt::toLLVMIR(ASTContext* context)
+{
+    auto& cg = *context->codeGenerator();
+    auto& builder = cg.builder();
+    CG::SymbolTable::ScopeGuard sg(cg.symbol());
+    auto cond = cond_->toLLVMIR(context).value;
+    if (!cond) return {};
+    if (!llvm::isa<llvm::IntegerType>(*cond->getType()))
+        return lowerError("Only bool or integer can be the condition.");
+    cond = builder.CreateICmpNE(cond, llvm::ConstantInt::get(cg.context(),
+        llvm::APInt(static_cast<llvm::IntegerType*>(cond->getType())->getBitWidth(), 0)), "ifcond");
+    llvm::Function* F = builder.GetInsertBlock()->getParent();
+    auto ThenBB = llvm::BasicBlock::Create(cg.context(), "then", F);
+    auto ElseBB = llvm::BasicBlock::Create(cg.context(), "else");
+    auto MergeBB = llvm::BasicBlock::Create(cg.context(), "ifcont");
+    builder.CreateCondBr(cond, ThenBB, else_ == nullptr ? MergeBB : ElseBB);
+    auto lowerBranch = [&](CompoundStmt* block) {
+        SymbolTable::ScopeGuard guard(context->symbolTable());
+        if (!block->lowerBlock(context, true)) {
+            cg.callDestructors(context->destructiblesOfScope());
+            builder.CreateBr(MergeBB);
+        }
+    };
+    builder.SetInsertPoint(ThenBB);
+    lowerBranch(then_);
+    if (else_ != nullptr) {
+        F->getBasicBlockList().push_back(ElseBB);
+        builder.SetInsertPoint(ElseBB);
+        lowerBranch(else_);
+    } else {
+        delete ElseBB;
+    }
+    F->getBasicBlockList().push_back(MergeBB);
+    builder.SetInsertPoint(MergeBB);
+    return { F };
+}
+
+Parse::LoweredValue Parse::ForStmt::toLLVMIR(ASTContext* context)
+{
+    auto& cg = *context->codeGenerator();
+    auto& builder = cg.builder();
+    CG::SymbolTable::ScopeGuard sg(cg.symbol());
+    SymbolTable::ScopeGuard guard(context->symbolTable());
+    if (!start_->toLLVMIR(context).value) return {};
+    auto F = builder.GetInsertBlock()->getParent();
+    auto PreHeaderBB = llvm::BasicBlock::Create(cg.context(), "cond", F);
+    builder.CreateBr(PreHeaderBB);
+    builder.SetInsertPoint(PreHeaderBB);
+    auto EndCond = cond_->toLLVMIR(context).value;
+    EndCond = builder.CreateICmpNE(EndCond,
+        llvm::ConstantInt::get(llvm::Type::getInt1Ty(cg.context()), llvm::APInt(1, 0)), "loopcond");
+    auto LoopBB = llvm::BasicBlock::Create(cg.context(), "loop", F);
+    auto AfterBB = llvm::BasicBlock::Create(cg.context(), "afterloop", F);
+    builder.CreateCondBr(EndCond, LoopBB, AfterBB);
+    builder.SetInsertPoint(LoopBB);
+    body_->lowerBlock(context, false);
+    // the body shares the scope of the loop variable
+    cg.callDestructors(context->destructiblesOfScope());
+    end_->toLLVMIR(context);
+    builder.CreateBr(PreHeaderBB);
+    builder.SetInsertPoint(AfterBB);
+    return { llvm::Constant::getNullValue(llvm::Type::getDoubleTy(cg.context())) };
+}
+
+Parse::LoweredValue Parse::ReturnStmt::toLLVMIR(ASTContext* context)
+{
+    auto& cg = *context->codeGenerator();
+    auto slot = cg.returnSlot();
+    LoweredValue ret;
+    if (ret_val_ != nullptr) {
+        ret = ret_val_->lowerInto(context, slot);
+        if (!ret.value) return {};
+    }
+    // see ReturnAST::generateCode()
+    ReturnKind kind;
+    auto destructibles = returnDestructibles(context, ret_val_, kind);
+    if (kind == ReturnKind::Retain) cg.retain(ret.value, asRefCounted(ret_val_->getType()));
+    if (kind == ReturnKind::MoveConstruct) {
+        auto move = static_cast<CompoundType*>(ret_val_->getType())->getMoveConstructor();
+        cg.builder().CreateCall(cg.getFunction(move), { slot, ret.address });
+    } else if (slot && ret.value && kind != ReturnKind::InPlace) {
+        cg.builder().CreateStore(ret.value, slot);
+    }
+    cg.callDestructors(destructibles);
+    return { cg.createReturn(ret.value) };
+}
+
+Parse::LoweredValue Parse::BinaryOperatorStmt::toLLVMIR(ASTContext* context)
+{
+    return lowerInto(context, nullptr);
+}
+
+Parse::LoweredValue Parse::BinaryOperatorStmt::lowerInto(ASTContext* context, llvm::Value* destination)
+{
+    auto& cg = *context->codeGenerator();
+    auto& builder = cg.builder();
+    if (op_ == OperatorType::ScopeResolution) {
+        auto l = dynamic_cast<VariableStmt*>(lhs_);
+        if (!l) throw std::logic_error("Left hand of :: is not a valid scope name.");
+        auto ns = context->symbolTable().getNamespace(l->getName());
+        if (!ns) throw std::logic_error("No namespace named " + l->getName() + ".");
+        context->symbolTable().setSpecfiedNamespace(ns);
+        auto ret = rhs_->lowerInto(context, destination);
+        context->symbolTable().unsetSpecfiedNamespace();
+        type_ = rhs_->getType();
+        temporary_ = rhs_->temporary();
+        return ret;
+    }
+    auto l = lhs_->toLLVMIR(context);
+    if (op_ == OperatorType::MemberAccessP || op_ == OperatorType::MemberAccessA) {
+        auto t = lhs_->getType();
+        if (op_ == OperatorType::MemberAccessA) {
+            auto rc = asRefCounted(t);
+            if (t->getTypename() != "__ptr" && !rc) throw std::logic_error("Operator -> only suits for pointer.");
+            t = t->getTemplateArgs()[0];
+            lhs_->setType(t);
+            auto object = rc ? cg.refCountedObject(l.value) : l.value;
+            l = { builder.CreateLoad(object), object };
+        }
+        auto type = dynamic_cast<CompoundType*>(t);
+        if (!type) throw std::logic_error("Invalid member access.");
+        auto r = dynamic_cast<VariableStmt*>(rhs_);
+        auto index = type->getMemberIndex(r->getName());
+        if (index != -1) {
+            type_ = type->getMemberType(r->getName());
+            std::vector<llvm::Value*> indices{ int32(cg, 0, true), int32(cg, index) };
+            auto ptr = builder.CreateGEP(l.address, indices, "memberptr");
+            return { builder.CreateLoad(ptr), ptr };
+        }
+        auto funclist = type->getFunction(r->getName());
+        if (funclist == nullptr) throw std::logic_error("Unknown member.");
+        type_ = (*funclist)[0];
+        // the enclosing UnaryOperatorStmt emits the call on this object
+        return { nullptr, l.address };
+    }
+    auto r = rhs_->toLLVMIR(context);
+    if (lhs_->getType() != rhs_->getType()) {
+        throw std::logic_error("No suitable binary operator between " + lhs_->getType()->getTypename() + " and " +
+                               rhs_->getType()->getTypename() + ".");
+    }
+    if (op_ == OperatorType::Assignment)
+        type_ = context->symbolTable().getType("void");
+    else
+        type_ = lhs_->getType();
+    if (!l.value || !r.value) return {};
+    if (op_ == OperatorType::Assignment || isCompoundAssignOperator(op_)) {
+        if (!l.address) return lowerError("destination of '=' must be a variable");
+        if (auto rc = op_ == OperatorType::Assignment ? asRefCounted(lhs_->getType()) : nullptr) {
+            // see BinaryExprAST::generateCode()
+            auto value = ownedValue(rhs_, r.value, context);
+            auto old = builder.CreateLoad(l.address);
+            auto store = builder.CreateStore(value, l.address);
+            cg.release(old, rc);
+            return { store };
+        }
+        auto res = r.value;
+        if (op_ != OperatorType::Assignment) {
+            res = builtinTypeOperate(l.value, lhs_->getType(), r.value, rhs_->getType(),
+                                     compoundAssignToOperator(op_), cg);
+        }
+        return { builder.CreateStore(res, l.address) };
+    }
+    auto res = builtinTypeOperate(l.value, lhs_->getType(), r.value, rhs_->getType(), op_, cg);
+    if (!res) return lowerError("No suitable operator.");
+    return { res };
+}
+
+Parse::LoweredValue Parse::UnaryOperatorStmt::toLLVMIR(ASTContext* context)
+{
+    return lowerInto(context, nullptr);
+}
+
+Parse::LoweredValue Parse::UnaryOperatorStmt::lowerInto(ASTContext* context, llvm::Value* destination)
+{
+    auto& cg = *context->codeGenerator();
+    auto& builder = cg.builder();
+    temporary_ = 0;
+    auto expr = stmt_->toLLVMIR(context);
+    // see UnaryOperatorStmt::toLLVMAST()
+    auto keepTemporary = [&](llvm::Value* value) -> LoweredValue {
+        if (!asRefCounted(type_)) return { value };
+        temporary_ = context->getNamelessVarCount();
+        auto name = ASTContext::namelessVarName(temporary_);
+        context->symbolTable().addNamelessVariable(type_, name);
+        auto alloc = cg.createLocal(value->getType(), name);
+        builder.CreateStore(value, alloc);
+        cg.symbol().setAlloc(name, alloc);
+        return { value, alloc };
+    };
+    auto fn = dynamic_cast<FunctionType*>(stmt_->getType());
+    auto type = dynamic_cast<TypeStmt*>(stmt_);
+    if (type && op_ == OperatorType::FunctionCall && asRefCounted(type->getType())) {
+        auto rc = asRefCounted(type->getType());
+        auto object = static_cast<CompoundType*>(rc->getTemplateArgs()[0]);
+        auto block = cg.newRefCounted(rc);
+        if (!args_.empty() || !object->getConstructors()->empty()) {
+            std::vector<llvm::Value*> argv{ cg.refCountedObject(block) };
+            for (auto& arg : args_) {
+                auto value = arg->toLLVMIR(context).value;
+                if (!value) return {};
+                argv.push_back(ownedValue(arg, value, context));
+            }
+            auto target = findSuitableFunction(args_, object->getConstructors());
+            cg.createCall(cg.getFunction(target), argv, nullptr);
+        }
+        type_ = rc;
+        return keepTemporary(block);
+    }
+    if (!fn && type && op_ == OperatorType::FunctionCall) {
+        // A temporary is allocated before its constructor arguments are
+        // evaluated but numbered after the temporaries among them.
+        auto classType = dynamic_cast<CompoundType*>(type->getType());
+        llvm::AllocaInst* alloc = nullptr;
+        if (!destination) {
+            alloc = cg.createLocal(cg.getType(classType));
+            builder.CreateLoad(alloc);
+        }
+        std::vector<llvm::Value*> argv{ destination ? destination : alloc };
+        for (auto& arg : args_) {
+            auto value = arg->toLLVMIR(context).value;
+            if (!value) return {};
+            // the callee owns its arguments, see ownArguments() in AST.cpp
+            argv.push_back(ownedValue(arg, value, context));
+        }
+        auto target = findSuitableFunction(args_, classType->getConstructors());
+        type_ = classType;
+        temporary_ = context->getNamelessVarCount();
+        auto name = ASTContext::namelessVarName(temporary_);
+        context->symbolTable().addNamelessVariable(type_, name);
+        // see NamelessVarExprAST::generateCode()
+        if (destination) {
+            cg.createCall(cg.getFunction(target), argv, nullptr);
+            return { destination };
+        }
+        alloc->setName(name);
+        cg.symbol().setAlloc(name, alloc);
+        cg.createCall(cg.getFunction(target), argv, nullptr);
+        return { builder.CreateLoad(alloc), alloc };
+    }
+    auto var = dynamic_cast<VariableStmt*>(stmt_);
+    if (var && op_ == OperatorType::Subscript) {
+        if (var->getType()->getTypename() != "__arr") {
+            throw std::logic_error("No suitable operation between " + var->getType()->getTypename() + " and [].");
+        }
+        type_ = var->getType()->getTemplateArgs()[0];
+        std::vector<llvm::Value*> indices{ int32(cg, 0, true) };
+        for (auto& arg : args_) {
+            indices.push_back(arg->toLLVMIR(context).value);
+        }
+        auto ptr = builder.CreateGEP(expr.address, indices);
+        return { builder.CreateLoad(ptr), ptr };
+    }
+    if (fn && op_ == OperatorType::FunctionCall) {
+        auto member = dynamic_cast<BinaryOperatorStmt*>(stmt_);
+        std::vector<llvm::Value*> argv;
+        if (member) argv.push_back(expr.address);
+        for (auto& arg : args_) {
+            auto value = arg->toLLVMIR(context).value;
+            if (!value) return {};
+            argv.push_back(ownedValue(arg, value, context));
+        }
+        FunctionType* target;
+        if (member) {
+            // a.fun()
+            auto fnList = dynamic_cast<CompoundType*>(member->getLHSType())->getFunction(fn->getTypename());
+            target = findSuitableFunction(args_, fnList);
+        } else {
+            // func()
+            auto fnList = context->symbolTable().getFunction(fn->getTypename());
+            target = findSuitableFunction(args_, fnList);
+        }
+        type_ = target->returnType();
+        if (!dynamic_cast<CompoundType*>(type_)) return keepTemporary(cg.createCall(cg.getFunction(target), argv, nullptr));
+        // see CallExprAST::generateCode()
+        temporary_ = context->getNamelessVarCount();
+        auto name = ASTContext::namelessVarName(temporary_);
+        context->symbolTable().addNamelessVariable(type_, name);
+        auto slot = destination;
+        if (!slot) {
+            auto alloc = cg.createLocal(cg.getType(type_), name);
+            cg.symbol().setAlloc(name, alloc);
+            slot = alloc;
+        }
+        cg.createCall(cg.getFunction(target), argv, slot);
+        if (destination) return { destination };
+        return { builder.CreateLoad(slot), slot };
+    }
+    throw std::logic_error("No suitable unary operation.");
+}
+
+Parse::LoweredValue Parse::VariableDefStmt::toLLVMIR(ASTContext* context)
+{
+    auto& cg = *context->codeGenerator();
+    auto& builder = cg.builder();
+    std::string name(name_);
+    vartype_->toLLVMIR(context);
+    auto t = dynamic_cast<TypeStmt*>(vartype_);
+    if (t == nullptr)
+        throw std::logic_error("Invalid type.");
+    if (context->symbolTable().getVariable(name) != nullptr) {
+        throw std::logic_error("Duplicate variable name: " + name);
+    }
+    context->symbolTable().addVariable(t->getType(), name);
+    auto alloc = cg.createLocal(cg.getType(t->getType()), name);
+    if (init_val_ != nullptr) {
+        // a class temporary is built in the variable
+        auto destination = dynamic_cast<CompoundType*>(t->getType()) ? alloc : nullptr;
+        auto init = init_val_->lowerInto(context, destination).value;
+        if (!init) return {};
+        if (!destination || !context->takeTemporary(init_val_))
+            builder.CreateStore(ownedValue(init_val_, init, context), alloc);
+    } else if (asRefCounted(t->getType())) {
+        builder.CreateStore(llvm::Constant::getNullValue(alloc->getAllocatedType()), alloc);
+    }
+    cg.symbol().setAlloc(name, alloc);
+    return { llvm::Constant::getNullValue(llvm::Type::getDoubleTy(cg.context())) };
+}
+
+Parse::LoweredValue Parse::TypeStmt::toLLVMIR(ASTContext* context)
+{
+    // types emit nothing, toLLVMAST() only resolves them
+    toLLVMAST(context);
+    return {};
+}
+
+Parse::LoweredValue Parse::VariableStmt::toLLVMIR(ASTContext* context)
+{
+    auto& cg = *context->codeGenerator();
+    std::string name(name_);
+    auto v = context->symbolTable().getVariable(name);
+    if (v) {
+        type_ = v->type_;
+        auto alloc = cg.symbol().getAlloc(name);
+        if (alloc == nullptr) return lowerError("Unknown variable name: " + name + ".");
+        return { cg.builder().CreateLoad(alloc), alloc };
+    }
+    if (!context->symbolTable().getFunction(name))
+        throw std::logic_error("Unknown identifier: " + name);
+    return {};
+}
+
+Parse::LoweredValue Parse::IntegerStmt::toLLVMIR(ASTContext* context)
+{
+    type_ = context->symbolTable().getType("i32");
+    return { int32(*context->codeGenerator(), val_, true) };
+}
+
+Parse::LoweredValue Parse::FloatStmt::toLLVMIR(ASTContext* context)
+{
+    type_ = context->symbolTable().getType("float");
+    return { llvm::ConstantFP::get(context->codeGenerator()->context(), llvm::APFloat(val_)) };
+}
+
+void Parse::FunctionDecl::toLLVMIR(ASTContext* context)
+{
+    auto& cg = *context->codeGenerator();
+    auto& builder = cg.builder();
+    auto F = cg.getFunction(funcType_);
+    TimeReport::Function timer(cg.timeReport(), F->getName());
+    // member functions of a class template are lowered when the template
+    // is instantiated, in the middle of another body
+    llvm::IRBuilderBase::InsertPointGuard insertPoint(builder);
+    auto BB = llvm::BasicBlock::Create(cg.context(), "entry", F);
+    CG::SymbolTable::ScopeGuard sg(cg.symbol());
+    builder.SetInsertPoint(BB);
+    cg.beginFunction(F);
+    if (auto c = dynamic_cast<CompoundType*>(funcType_->classType())) {
+        llvm::Value* data = builder.CreateLoad(cg.symbol().getAlloc("this"));
+        int i = 0;
+        for (auto& m : c->getMemberVariables()) {
+            std::vector<llvm::Value*> indices{ int32(cg, 0, true), int32(cg, i++) };
+            auto ptr = builder.CreateGEP(data, indices, "memberptr");
+            cg.symbol().setAlloc(m.second, static_cast<llvm::AllocaInst*>(ptr));
+        }
+    }
+    // see FunctionAST::generateCode for the missing return
+    if (!body_->lowerBlock(context, false)) {
+        cg.callDestructors(context->destructiblesOfScope());
+        if (F->getReturnType()->isVoidTy()) builder.CreateRet(nullptr);
+        else builder.CreateUnreachable();
+    }
+    if (llvm::verifyFunction(*F, &llvm::errs())) {
+        std::cout << std::endl << "something bad happened ...\n";
+    }
+    cg.optimizeFunction(*F);
+}
@@ -0,0 +1,322 @@
+#include "ModuleInterface.h"
+#include <algorithm>
+#include <stdexcept>
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "ASTContext.h"
+#include "SymbolTable.h"
+
+using namespace Parse;
+
+// the format version is part of it
+static const llvm::StringRef magic = "RPI2";
+
+namespace
+{
+    enum class TypeTag : unsigned
+    {
+        Builtin, Literal, Compound
+    };
+
+    // Numbers are ULEB128, literals SLEB128, strings their length and bytes.
+    class Writer
+    {
+    public:
+        explicit Writer(llvm::raw_ostream& os): os_(os) {}
+
+        void number(uint64_t n) { llvm::encodeULEB128(n, os_); }
+        void string(llvm::StringRef s)
+        {
+            number(s.size());
+            os_ << s;
+        }
+
+        void type(Type* t)
+        {
+            if (auto literal = dynamic_cast<LiteralType*>(t)) {
+                number(static_cast<unsigned>(TypeTag::Literal));
+                llvm::encodeSLEB128(literal->value(), os_);
+            } else if (dynamic_cast<CompoundType*>(t)) {
+                number(static_cast<unsigned>(TypeTag::Compound));
+                // the namespaces from the outermost, the global one has no name
+                std::vector<NamespaceHelper*> path;
+                for (auto ns = t->getNamespaceHierarchy(); ns && ns->lastNS; ns = ns->lastNS) path.push_back(ns);
+                number(path.size());
+                for (auto it = path.rbegin(); it != path.rend(); ++it) string((*it)->name);
+                string(t->getTypename());
+            } else {
+                number(static_cast<unsigned>(TypeTag::Builtin));
+                string(t->getTypename());
+                number(t->getTemplateArgs().size());
+                for (auto arg : t->getTemplateArgs()) type(arg);
+            }
+        }
+
+        void function(FunctionType* f)
+        {
+            string(f->getTypename());
+            number(f->args().size());
+            for (auto& arg : f->args()) {
+                type(arg.first);
+                string(arg.second);
+            }
+            type(f->returnType());
+        }
+
+    private:
+        llvm::raw_ostream& os_;
+    };
+
+    class Reader
+    {
+    public:
+        Reader(llvm::StringRef data, std::string filename):
+            p_(data.bytes_begin()), end_(data.bytes_end()), filename_(std::move(filename)) {}
+
+        void header()
+        {
+            if (static_cast<size_t>(end_ - p_) < magic.size() ||
+                llvm::StringRef(reinterpret_cast<const char*>(p_), magic.size()) != magic)
+                throw std::logic_error(filename_ + " is not a module interface of this version.");
+            p_ += magic.size();
+        }
+
+        uint64_t number()
+        {
+            unsigned n;
+            const char* error = nullptr;
+            auto v = llvm::decodeULEB128(p_, &n, end_, &error);
+            if (error) corrupt();
+            p_ += n;
+            return v;
+        }
+
+        // a number of entries, each takes at least a byte
+        size_t count()
+        {
+            auto n = number();
+            if (n > static_cast<uint64_t>(end_ - p_)) corrupt();
+            return n;
+        }
+
+        // one of size entries plus one, 0 for none
+        size_t position(size_t size)
+        {
+            auto n = number();
+            if (n > size) corrupt();
+            return n;
+        }
+
+        std::string string()
+        {
+            auto n = count();
+            std::string s(reinterpret_cast<const char*>(p_), n);
+            p_ += n;
+            return s;
+        }
+
+        Type* type(ASTContext& context)
+        {
+            auto& st = context.symbolTable();
+            switch (static_cast<TypeTag>(number())) {
+            case TypeTag::Literal: {
+                unsigned n;
+                const char* error = nullptr;
+                auto v = llvm::decodeSLEB128(p_, &n, end_, &error);
+                if (error) corrupt();
+                p_ += n;
+                return context.addLiteralType(LiteralType::category::Integer, v);
+            }
+            case TypeTag::Builtin: {
+                auto name = string();
+                std::vector<Type*> args(count());
+                for (auto& arg : args) arg = type(context);
+                return found(st.getType(name, args), name);
+            }
+            case TypeTag::Compound: {
+                // imports happen in the global namespace
+                auto ns = st.currentNamespace();
+                for (auto n = count(); n--;) {
+                    auto name = string();
+                    if (ns) ns = st.getNestedNamespace(ns, name);
+                }
+                auto name = string();
+                Type* t = nullptr;
+                if (ns) {
+                    st.setSpecfiedNamespace(ns);
+                    t = st.getType(name);
+                    st.unsetSpecfiedNamespace();
+                }
+                return found(t, name);
+            }
+            }
+            corrupt();
+        }
+
+        // declares it in context, in the current class if any
+        FunctionType* function(ASTContext& context)
+        {
+            auto name = string();
+            std::vector<std::pair<Type*, std::string>> args(count());
+            for (auto& arg : args) {
+                arg.first = type(context);
+                arg.second = string();
+            }
+            auto returnType = type(context);
+            return context.addFuncPrototype(name, std::move(args), returnType);
+        }
+
+    private:
+        [[noreturn]] void corrupt()
+        {
+            throw std::logic_error(filename_ + " is corrupt.");
+        }
+
+        Type* found(Type* t, const std::string& name)
+        {
+            if (!t) throw std::logic_error(filename_ + " uses the unknown type " + name + ".");
+            return t;
+        }
+
+        const uint8_t* p_;
+        const uint8_t* end_;
+        std::string filename_;
+    };
+}
+
+// whether a client can look t up by name
+static bool exportable(Type* t)
+{
+    if (dynamic_cast<LiteralType*>(t)) return true;
+    if (auto c = dynamic_cast<CompoundType*>(t)) {
+        if (!c->getTemplateArgs().empty()) return false;
+        for (auto& member : c->getMemberVariables())
+            if (!exportable(member.first)) return false;
+        return true;
+    }
+    for (auto arg : t->getTemplateArgs())
+        if (!exportable(arg)) return false;
+    return true;
+}
+
+static bool exportable(FunctionType* f)
+{
+    bool ok = exportable(f->returnType());
+    for (auto& arg : f->args()) ok = ok && exportable(arg.first);
+    if (ok) return true;
+    llvm::errs() << "note: " << f->mangledName() << " is not exported, it uses a class template instance\n";
+    return false;
+}
+
+// external: functions are declared by each file that uses them
+static std::vector<FunctionType*> exported(std::vector<FunctionType*> functions)
+{
+    functions.erase(std::remove_if(functions.begin(), functions.end(),
+                                   [](FunctionType* f) { return f->isExternal() || !exportable(f); }),
+                    functions.end());
+    return functions;
+}
+
+void ModuleInterface::write(const std::string& filename, const std::vector<std::string>& imports,
+                            llvm::ArrayRef<CompoundType*> classes, llvm::ArrayRef<FunctionType*> functions)
+{
+    std::error_code EC;
+    llvm::raw_fd_ostream os(filename, EC, llvm::sys::fs::F_None);
+    if (EC) {
+        llvm::errs() << "Could not open file: " << EC.message() << "\n";
+        return;
+    }
+    Writer out(os);
+    os << magic;
+    out.number(imports.size());
+    for (auto& name : imports) out.string(name);
+
+    // all layouts come first, member functions may use any of the classes
+    std::vector<CompoundType*> types;
+    for (auto c : classes) {
+        if (exportable(c)) types.push_back(c);
+        else llvm::errs() << "note: class " << c->getTypename() << " is not exported, it uses a class template instance\n";
+    }
+    out.number(types.size());
+    for (auto c : types) {
+        out.string(c->getTypename());
+        out.number(c->getMemberVariables().size());
+        for (auto& member : c->getMemberVariables()) {
+            out.type(member.first);
+            out.string(member.second);
+        }
+    }
+    for (auto c : types) {
+        auto constructors = exported(*c->getConstructors());
+        out.number(constructors.size());
+        for (auto f : constructors) out.function(f);
+        auto move = std::find(constructors.begin(), constructors.end(), c->getMoveConstructor());
+        out.number(move == constructors.end() ? 0 : move - constructors.begin() + 1);
+        std::vector<FunctionType*> members;
+        for (auto& overloads : c->getMemberFunctions())
+            members.insert(members.end(), overloads.second.begin(), overloads.second.end());
+        members = exported(std::move(members));
+        out.number(members.size());
+        for (auto f : members) out.function(f);
+        auto destructor = c->getDestructor();
+        bool hasDestructor = destructor && exportable(destructor);
+        out.number(hasDestructor);
+        if (hasDestructor) out.function(destructor);
+    }
+
+    auto free = exported(functions);
+    out.number(free.size());
+    for (auto f : free) out.function(f);
+}
+
+void ModuleInterface::import(const std::string& name, ASTContext& context, const std::vector<std::string>& dirs)
+{
+    if (!context.addImport(name)) return;
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    std::string filename;
+    for (auto& dir : dirs) {
+        llvm::SmallString<128> path(dir);
+        llvm::sys::path::append(path, name + extension);
+        if (auto file = llvm::MemoryBuffer::getFile(path)) {
+            buffer = std::move(*file);
+            filename = path.str().str();
+            break;
+        }
+    }
+    if (!buffer) throw std::runtime_error("Cannot find module " + name + ".");
+
+    Reader in(buffer->getBuffer(), filename);
+    in.header();
+    for (auto n = in.count(); n--;) import(in.string(), context, dirs);
+
+    auto& st = context.symbolTable();
+    std::vector<CompoundType*> classes(in.count());
+    for (auto& c : classes) {
+        auto className = in.string();
+        std::vector<std::pair<Type*, std::string>> members(in.count());
+        for (auto& member : members) {
+            member.first = in.type(context);
+            member.second = in.string();
+        }
+        c = static_cast<CompoundType*>(context.addType(className, std::move(members)));
+        c->setImported();
+        // as ClassDecl::generateNewFunction() registers it
+        SymbolTable::NamespaceGuard guard(st, className);
+        auto ptrType = st.getType("__ptr", { c });
+        st.addFunction("new", {}, ptrType);
+        st.addFunction("delete", { { ptrType, "p" } }, st.getType("void"));
+    }
+    for (auto c : classes) {
+        ASTContext::ClassScopeGuard guard(context, c);
+        for (auto n = in.count(); n--;) c->addConstructor(in.function(context));
+        auto& constructors = *c->getConstructors();
+        if (auto move = in.position(constructors.size())) c->setMoveConstructor(constructors[move - 1]);
+        for (auto n = in.count(); n--;) c->addFunction(in.function(context));
+        if (in.number()) c->setDestructor(in.function(context));
+    }
+    for (auto n = in.count(); n--;) in.function(context);
+}
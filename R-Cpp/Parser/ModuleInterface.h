@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <llvm/ADT/ArrayRef.h>
+#include "Type.h"
+
+namespace Parse
+{
+    class ASTContext;
+
+    // The binary interface of a compiled source file, which `import name;`
+    // reads from name.rpi instead of parsing the source: the modules the
+    // source imports, its classes with their members, constructors (and
+    // which is the move constructor), member functions and destructor, and the prototypes of its
+    // functions. Types are written by kind, namespace and name and looked
+    // up again on import. The code stays in the source's object file, which
+    // the client is linked with.
+    //
+    // Class templates are not part of it, instantiating one needs its body.
+    class ModuleInterface
+    {
+    public:
+        static constexpr const char* extension = ".rpi";
+
+        // functions whose signature uses a class template instance are
+        // left out, with a note on stderr
+        static void write(const std::string& filename, const std::vector<std::string>& imports,
+                          llvm::ArrayRef<CompoundType*> classes, llvm::ArrayRef<FunctionType*> functions);
+        // Declares the module's classes and functions in context, after
+        // those of the modules it imports. A module is only imported once.
+        // name.rpi is looked for in dirs in order, "" is the working
+        // directory. Throws std::runtime_error if it isn't found and
+        // std::logic_error if it can't be read.
+        static void import(const std::string& name, ASTContext& context, const std::vector<std::string>& dirs);
+    };
+}
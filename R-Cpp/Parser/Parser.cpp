@@ -1,23 +1,28 @@
 #include "Parser.h"
+#include "ModuleInterface.h"
+#include <algorithm>
+#include <atomic>
 #include <stack>
 #include <iostream>
 #include <cassert>
+#include <thread>
+#include "llvm/Support/Path.h"
 
 using namespace Parse;
 
-std::unique_ptr<Stmt> Parse::Parser::ParseIntegerExpr() {
-    auto res = std::make_unique<IntegerStmt>(std::stoi(lexer_.curToken().content));
+Stmt* Parse::Parser::ParseIntegerExpr() {
+    auto res = context_.create<IntegerStmt>(std::stoi(std::string(lexer_.curContent())));
     getNextToken();
     return res;
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParseFloatExpr() {
-    auto res = std::make_unique<FloatStmt>(std::stof(lexer_.curToken().content));
+Stmt* Parse::Parser::ParseFloatExpr() {
+    auto res = context_.create<FloatStmt>(std::stof(std::string(lexer_.curContent())));
     getNextToken();
     return res;
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParseStatement() {
+Stmt* Parse::Parser::ParseStatement() {
     if (lexer_.curToken().type == TokenType::Return) {
         return ParseReturnExpr();
     }
@@ -36,11 +41,11 @@ std::unique_ptr<Stmt> Parse::Parser::ParseStatement() {
     return ParseExpression();
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParsePrimary() {
+Stmt* Parse::Parser::ParsePrimary() {
     if (lexer_.curToken().type == TokenType::Identifier) {
         auto e = ParseIdentifierExpr();
         while (isPostOperator()) {
-            e = ParsePostOperator(std::move(e));
+            e = ParsePostOperator(e);
         }
         return e;
     }
@@ -56,7 +61,7 @@ std::unique_ptr<Stmt> Parse::Parser::ParsePrimary() {
     auto op = getNextUnaryOperator();
     if (op != OperatorType::None) {
         auto expr = ParsePrimary();
-        return std::make_unique<UnaryOperatorStmt>(std::move(expr), op);
+        return context_.create<UnaryOperatorStmt>(expr, op);
     }
     error("Unexpected token.");
     return nullptr;
@@ -79,31 +84,31 @@ bool Parse::Parser::isPostOperator() {
     return false;
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParsePostOperator(std::unique_ptr<Stmt> e) {
+Stmt* Parse::Parser::ParsePostOperator(Stmt* e) {
     //auto type = e->getType();
     if (lexer_.curToken().type == TokenType::lSquare) {
         //if (type.typeName != "__arr") {
         //    error("No suitable [] operator for " + type.typeName + ".");
         //    return nullptr;
         //}
-        e = std::make_unique<UnaryOperatorStmt>(std::move(e),
-            OperatorType::Subscript, ParseSquareExprList());
+        e = context_.create<UnaryOperatorStmt>(e,
+            OperatorType::Subscript, context_.copyArray(ParseSquareExprList()));
     } else if (lexer_.curToken().type == TokenType::lParenthesis) {
-        e = std::make_unique<UnaryOperatorStmt>(std::move(e),
-            OperatorType::FunctionCall, ParseParenExprList());
+        e = context_.create<UnaryOperatorStmt>(e,
+            OperatorType::FunctionCall, context_.copyArray(ParseParenExprList()));
     } else if (lexer_.curToken().type == TokenType::Point) {
         getNextToken();
         if (lexer_.curToken().type != TokenType::Identifier) {
             error("Expected members of class.");
         }
-        auto name = lexer_.curToken().content;
+        auto name = context_.copyString(lexer_.curContent());
         getNextToken();
-        e = std::make_unique<BinaryOperatorStmt>(std::move(e), std::make_unique<VariableStmt>(name),
+        e = context_.create<BinaryOperatorStmt>(e, context_.create<VariableStmt>(name),
             OperatorType::MemberAccessP);
         //e = ParseMemberAccess(std::move(e), OperatorType::MemberAccessP);
     } else if (lexer_.curToken().type == TokenType::Plus) {
         assert(getNextUnaryOperator() == OperatorType::PreIncrement);
-        e = std::make_unique<UnaryOperatorStmt>(std::move(e), OperatorType::PostIncrement);
+        e = context_.create<UnaryOperatorStmt>(e, OperatorType::PostIncrement);
     } else if (lexer_.curToken().type == TokenType::Minus) {
         if (lexer_.viewNextToken().type == TokenType::rAngle) {
             assert(getNextBinOperator() == OperatorType::MemberAccessA);
@@ -112,20 +117,20 @@ std::unique_ptr<Stmt> Parse::Parser::ParsePostOperator(std::unique_ptr<Stmt> e)
             if (lexer_.curToken().type != TokenType::Identifier) {
                 error("Expected members of class.");
             }
-            auto name = lexer_.curToken().content;
+            auto name = context_.copyString(lexer_.curContent());
             getNextToken();
-            e = std::make_unique<BinaryOperatorStmt>(std::move(e), std::make_unique<VariableStmt>(name), OperatorType::MemberAccessA);
+            e = context_.create<BinaryOperatorStmt>(e, context_.create<VariableStmt>(name), OperatorType::MemberAccessA);
             //e = ParseMemberAccess(std::move(e), OperatorType::MemberAccessP);
         } else {
             assert(getNextUnaryOperator() == OperatorType::PreDecrement);
-            e = std::make_unique<UnaryOperatorStmt>(std::move(e), OperatorType::PostDecrement);
+            e = context_.create<UnaryOperatorStmt>(e, OperatorType::PostDecrement);
         }
 
     }
     else if(lexer_.curToken().type==TokenType::Colon)
     {
         assert(getNextBinOperator() == OperatorType::ScopeResolution);
-        e = std::make_unique<BinaryOperatorStmt>(std::move(e), ParsePrimary(), OperatorType::ScopeResolution);
+        e = context_.create<BinaryOperatorStmt>(e, ParsePrimary(), OperatorType::ScopeResolution);
         //auto p = dynamic_cast<NamespaceExprAST*>(e.get());
         //if(p==nullptr)
         //{
@@ -139,7 +144,7 @@ std::unique_ptr<Stmt> Parse::Parser::ParsePostOperator(std::unique_ptr<Stmt> e)
     return e;
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParseParenExpr() {
+Stmt* Parse::Parser::ParseParenExpr() {
     // ( expression )
     getNextToken(); //eat (
     auto expr = ParseExpression();
@@ -152,8 +157,8 @@ std::unique_ptr<Stmt> Parse::Parser::ParseParenExpr() {
     return expr;
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParseIdentifierExpr() {
-    auto idname = lexer_.curToken().content;
+Stmt* Parse::Parser::ParseIdentifierExpr() {
+    auto idname = context_.copyString(lexer_.curContent());
     getNextToken();
     // is defining a identifier
  //   if (lexer_.curToken().type_llvm == TokenType::Identifier||lexer_.curToken().type_llvm==TokenType::lAngle) {
@@ -179,10 +184,10 @@ std::unique_ptr<Stmt> Parse::Parser::ParseIdentifierExpr() {
         //    error("Unknown identifier.");
         //    return nullptr;
         //}
-    return std::make_unique<VariableStmt>(idname);;
+    return context_.create<VariableStmt>(idname);;
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParseForExpr() {
+Stmt* Parse::Parser::ParseForExpr() {
     getNextToken(); //eat for
     if (lexer_.curToken().type != TokenType::lParenthesis) {
         error("Expected ( after a for loop.");
@@ -209,17 +214,17 @@ std::unique_ptr<Stmt> Parse::Parser::ParseForExpr() {
     getNextToken(); //eat )
     auto body = ParseBlock();
     //sg.setBlock(body.get());
-    return std::make_unique<ForStmt>(std::move(start), std::move(cond), std::move(end), std::move(body));
+    return context_.create<ForStmt>(start, cond, end, body);
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParseVariableDefinition(const std::string& type_name) {
-    std::vector<std::unique_ptr<Stmt>> template_args;
+Stmt* Parse::Parser::ParseVariableDefinition(std::string_view type_name) {
+    std::vector<Stmt*> template_args;
     if (lexer_.curToken().type == TokenType::lAngle) {
         template_args = ParseAngleExprList();
     }
-    auto type = std::make_unique<TypeStmt>(type_name, std::move(template_args));
+    auto type = context_.create<TypeStmt>(type_name, context_.copyArray(template_args));
     if (lexer_.curToken().type == TokenType::Identifier) {   // like 'int p=0'
-        auto varname = lexer_.curToken().content;
+        auto varname = context_.copyString(lexer_.curContent());
         //if (type_name == "__arr") {
         //    if (template_args.size() != 2) {
         //        error("Invalid count of arguments for Arr.");
@@ -237,7 +242,7 @@ std::unique_ptr<Stmt> Parse::Parser::ParseVariableDefinition(const std::string&
         //}
         //symbol_->setValue(varname, Variable(varname, type));
         getNextToken();
-        auto expr = std::make_unique<VariableDefStmt>(std::move(type), varname);
+        auto expr = context_.create<VariableDefStmt>(type, varname);
         //if (type_name == "__arr" || type_name == "__ptr") {
         //    std::vector<std::string> tempargs;
         //    for (auto& v : type.templateArgs) {
@@ -249,7 +254,7 @@ std::unique_ptr<Stmt> Parse::Parser::ParseVariableDefinition(const std::string&
             // definition with initiate value
             getNextToken();   // eat =
             auto E = ParseExpression();
-            expr->setInitValue(std::move(E));
+            expr->setInitValue(E);
         } else if (lexer_.curToken().type != TokenType::Semicolon) {
             error("Expected initiate value or ;.");
             return nullptr;
@@ -262,13 +267,13 @@ std::unique_ptr<Stmt> Parse::Parser::ParseVariableDefinition(const std::string&
         }
         auto args = ParseParenExprList();
 
-        return std::make_unique<UnaryOperatorStmt>(std::move(type),OperatorType::FunctionCall, std::move(args));
+        return context_.create<UnaryOperatorStmt>(type,OperatorType::FunctionCall, context_.copyArray(args));
     }
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParseReturnExpr() {
+Stmt* Parse::Parser::ParseReturnExpr() {
     getNextToken();
-    std::unique_ptr<Stmt> retval = nullptr;
+    Stmt* retval = nullptr;
     if (lexer_.curToken().type != TokenType::Semicolon) {
         retval = ParseExpression();
         if (!retval) {
@@ -280,26 +285,26 @@ std::unique_ptr<Stmt> Parse::Parser::ParseReturnExpr() {
     symbolTable()->callNamelessVarDestructor(destructor);
     auto des2 = symbolTable()->callDestructor();
     destructor.insert(destructor.end(), std::make_move_iterator(des2.begin()), std::make_move_iterator(des2.end()));*/
-    return std::make_unique<ReturnStmt>(std::move(retval));
+    return context_.create<ReturnStmt>(retval);
 }
 
-std::unique_ptr<Stmt> Parse::Parser::MergeExpr(std::unique_ptr<Stmt> LHS, std::unique_ptr<Stmt> RHS, OperatorType Op) {
+Stmt* Parse::Parser::MergeExpr(Stmt* LHS, Stmt* RHS, OperatorType Op) {
     if (Op != OperatorType::MemberAccessP) {
-        return std::make_unique<BinaryOperatorStmt>(std::move(LHS),
-            std::move(RHS), Op);
+        return context_.create<BinaryOperatorStmt>(LHS,
+            RHS, Op);
     }
     error("Unexpected operator.");
     return nullptr;
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParseExpression() {
+Stmt* Parse::Parser::ParseExpression() {
     auto LHS = ParsePrimary();
     if (!LHS)
         return nullptr;
     std::stack<OperatorType> ops;
     ops.push(OperatorType::None);
-    std::stack<std::unique_ptr<Stmt>> expr;
-    expr.push(std::move(LHS));
+    std::stack<Stmt*> expr;
+    expr.push(LHS);
     while (true) {
         OperatorType op;
         if (lexer_.curToken().type == TokenType::Semicolon || lexer_.curToken().type == TokenType::rParenthesis
@@ -310,26 +315,26 @@ std::unique_ptr<Stmt> Parse::Parser::ParseExpression() {
             op = getNextBinOperator();
         while (getBinOperatorPrecedence(op) < getBinOperatorPrecedence(ops.top())) {
             std::stack<OperatorType> curLevelOps;
-            std::stack<std::unique_ptr<Stmt>> curLevelExprs;
-            curLevelExprs.push(std::move(expr.top()));
+            std::stack<Stmt*> curLevelExprs;
+            curLevelExprs.push(expr.top());
             expr.pop();
             auto curPrecedence = getBinOperatorPrecedence(ops.top());
             while (curPrecedence == getBinOperatorPrecedence(ops.top())) {
                 curLevelOps.push(ops.top());
                 ops.pop();
-                curLevelExprs.push(std::move(expr.top()));
+                curLevelExprs.push(expr.top());
                 expr.pop();
             }
             while (!curLevelOps.empty()) {
                 auto o = curLevelOps.top();
                 curLevelOps.pop();
-                auto l = std::move(curLevelExprs.top());
+                auto l = curLevelExprs.top();
                 curLevelExprs.pop();
-                auto r = std::move(curLevelExprs.top());
+                auto r = curLevelExprs.top();
                 curLevelExprs.pop();
-                curLevelExprs.push(MergeExpr(std::move(l), std::move(r), o));
+                curLevelExprs.push(MergeExpr(l, r, o));
             }
-            expr.push(std::move(curLevelExprs.top()));
+            expr.push(curLevelExprs.top());
             curLevelExprs.pop();
             assert(curLevelExprs.empty() == true);
         }
@@ -338,7 +343,7 @@ std::unique_ptr<Stmt> Parse::Parser::ParseExpression() {
             expr.push(ParsePrimary());
         }
     }
-    return std::move(expr.top());
+    return expr.top();
 }
 
 OperatorType Parse::Parser::getNextBinOperator() {
@@ -465,7 +470,7 @@ OperatorType Parse::Parser::getNextUnaryOperator() {
     return OperatorType::None;
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParseIfExpr() {
+Stmt* Parse::Parser::ParseIfExpr() {
     getNextToken();  // eat if
     auto cond = ParseParenExpr();
     if (!cond) return nullptr;
@@ -477,22 +482,22 @@ std::unique_ptr<Stmt> Parse::Parser::ParseIfExpr() {
         if (lexer_.curToken().type == TokenType::If) {
             auto elseif = ParseBlock();
             if (!elseif) return nullptr;
-            return std::make_unique<IfStmt>(std::move(cond), std::move(then), std::move(elseif));
+            return context_.create<IfStmt>(cond, then, elseif);
         }
         auto els = ParseBlock();
         if (!els) return nullptr;
-        return std::make_unique<IfStmt>(std::move(cond), std::move(then), std::move(els));
+        return context_.create<IfStmt>(cond, then, els);
     }
-    return std::make_unique<IfStmt>(std::move(cond), std::move(then));
+    return context_.create<IfStmt>(cond, then);
 }
 
-std::vector<std::pair<std::unique_ptr<Stmt>, std::string>> Parse::Parser::ParseFunctionArgList() {
-    std::vector<std::pair<std::unique_ptr<Stmt>, std::string>> ArgNames;
+std::vector<std::pair<Stmt*, std::string_view>> Parse::Parser::ParseFunctionArgList() {
+    std::vector<std::pair<Stmt*, std::string_view>> ArgNames;
     getNextToken();
     while (lexer_.curToken().type != TokenType::rParenthesis) {
         auto type = ParseType();
         // getNextToken();
-        ArgNames.emplace_back(std::make_pair(std::move(type), lexer_.curToken().content));
+        ArgNames.emplace_back(type, context_.copyString(lexer_.curContent()));
         getNextToken();
         if (lexer_.curToken().type == TokenType::rParenthesis) break;
         if (lexer_.curToken().type != TokenType::Comma) {
@@ -505,12 +510,12 @@ std::vector<std::pair<std::unique_ptr<Stmt>, std::string>> Parse::Parser::ParseF
 }
 
 
-std::unique_ptr<FunctionDecl> Parse::Parser::ParsePrototype() {
+FunctionDecl* Parse::Parser::ParsePrototype() {
     if (lexer_.curToken().type != TokenType::Identifier) {
         error("Expected function name in prototype");
         return nullptr;
     }
-    std::string FnName = lexer_.curToken().content;
+    auto FnName = context_.copyString(lexer_.curContent());
     getNextToken();
     if (lexer_.curToken().type != TokenType::lParenthesis) {
         error("Expected '(' in prototype");
@@ -525,7 +530,7 @@ std::unique_ptr<FunctionDecl> Parse::Parser::ParsePrototype() {
     }
 
     getNextToken(); // eat ')'.
-    std::unique_ptr<Stmt> retType = nullptr;
+    Stmt* retType = nullptr;
     if (lexer_.curToken().type == TokenType::Minus) {
         auto op = getNextBinOperator();
         if (op != OperatorType::MemberAccessA) {
@@ -541,7 +546,7 @@ std::unique_ptr<FunctionDecl> Parse::Parser::ParsePrototype() {
         error("Return value must be pointed out explicitly when declaring a function prototype.");
         return nullptr;
     } else {
-        retType = std::make_unique<TypeStmt>("void");
+        retType = context_.create<TypeStmt>("void");
     }
 
     //auto p = std::make_unique<PrototypeAST>(::Function::mangle(f),std::move(argList),::VarType::mangle(retType));
@@ -549,15 +554,15 @@ std::unique_ptr<FunctionDecl> Parse::Parser::ParsePrototype() {
     //    p->setClassType(::VarType::mangle(cur_class_));
     //proto_.emplace_back(std::move(p));
     //symbol_->addFunction(f);
-    return std::make_unique<FunctionDecl>(FnName, std::move(ArgNames), std::move(retType), nullptr, isExternal);
+    return context_.create<FunctionDecl>(FnName, context_.copyArray(ArgNames), retType, nullptr, isExternal);
 }
 
-std::unique_ptr<CompoundStmt> Parse::Parser::ParseBlock() {
-    std::vector<std::unique_ptr<Stmt>> body;
+CompoundStmt* Parse::Parser::ParseBlock() {
+    std::vector<Stmt*> body;
     bool hasReturn = false;
     if (lexer_.curToken().type != TokenType::lBrace) {   // with only one statement, {} can be omitted
         auto expr = ParseStatement();
-        if (expr != nullptr) body.emplace_back(std::move(expr));
+        if (expr != nullptr) body.emplace_back(expr);
         //if (dynamic_cast<ReturnStmt*>(expr.get()) != nullptr) hasReturn = true;
         if (lexer_.curToken().type == TokenType::Semicolon) {
             getNextToken();  //eat ;
@@ -569,7 +574,7 @@ std::unique_ptr<CompoundStmt> Parse::Parser::ParseBlock() {
             auto E = ParseStatement();
             if (!E) return nullptr;
             //if (dynamic_cast<ReturnAST*>(E.get()) != nullptr) hasReturn = true;
-            body.emplace_back(std::move(E));
+            body.emplace_back(E);
             if (lexer_.curToken().type == TokenType::Semicolon)
                 getNextToken();     // eat ;
             //symbolTable()->callNamelessVarDestructor(body);
@@ -580,17 +585,17 @@ std::unique_ptr<CompoundStmt> Parse::Parser::ParseBlock() {
         }
         getNextToken(); //eat }
     }
-    auto block = std::make_unique<CompoundStmt>(std::move(body));
+    auto block = context_.create<CompoundStmt>(context_.copyArray(body));
     //if(!hasReturn)
     //    guard.setBlock(block.get());
     return block;
 }
 
-std::unique_ptr<FunctionDecl> Parse::Parser::ParseFunction() {
+FunctionDecl* Parse::Parser::ParseFunction() {
     getNextToken(); // eat fn.
     auto f = ParsePrototype();
     if (!f) return {};
-    std::unique_ptr<CompoundStmt> body;
+    CompoundStmt* body;
 
     if (lexer_.curToken().type == TokenType::Semicolon) {
         getNextToken();
@@ -605,7 +610,7 @@ std::unique_ptr<FunctionDecl> Parse::Parser::ParseFunction() {
     if (!body) {
         return {};
     }
-    f->setBody(std::move(body));
+    f->setBody(body);
     //if(!body->hasReturn()&&dynamic_cast<ReturnAST*>(body->instructions().back().get())==nullptr)
     //{
     //    body->instructions().push_back(std::make_unique<ReturnAST>(nullptr, symbolTable()->callDestructor()));
@@ -620,8 +625,7 @@ std::unique_ptr<FunctionDecl> Parse::Parser::ParseFunction() {
 void Parse::Parser::HandleDefinition() {
     auto func = ParseFunction();
     if (func != nullptr) {
-        fprintf(stderr, "Parsed a function definition.\n");
-        functionDecls_.emplace_back(std::move(func));
+        functionDecls_.emplace_back(func);
         //expr_.emplace_back(std::move(func));
     } else {
         // Skip token for error recovery.
@@ -629,50 +633,66 @@ void Parse::Parser::HandleDefinition() {
     }
 }
 
-std::unique_ptr<ClassDecl> Parse::Parser::ParseClass() {
+ClassDecl* Parse::Parser::ParseClass() {
     getNextToken();  // eat class
     if (lexer_.curToken().type != TokenType::Identifier) {
         error("Expected class name.");
         return nullptr;
     }
-    auto classDecl = std::make_unique<ClassDecl>(lexer_.curToken().content);
+    auto className = context_.copyString(lexer_.curContent());
+    std::vector<std::pair<Stmt*, std::string_view>> memberVariables;
+    std::vector<FunctionDecl*> memberFunctions, constructors;
+    FunctionDecl* destructor = nullptr;
+    FunctionDecl* moveConstructor = nullptr;
     getNextToken();
     if (lexer_.curToken().type != TokenType::lBrace) {
         error("Expect class body.");
         return nullptr;
     }
     getNextToken(); // eat {
-    SymbolTable::NamespaceGuard guard(context().symbolTable(), classDecl->name());
+    SymbolTable::NamespaceGuard guard(context().symbolTable(), std::string(className));
     //std::unique_ptr<CompoundStmt> desturctorBlock = nullptr;
     while (lexer_.curToken().type != TokenType::rBrace) {
         if (lexer_.curToken().type == TokenType::Identifier) {
-            if (lexer_.curToken().content == classDecl->name() && lexer_.viewNextToken().type == TokenType::lParenthesis) {
+            // move Class(__ptr<Class> from) is the move constructor
+            auto next = lexer_.viewNextToken();
+            bool move = lexer_.curContent() == "move" && next.type == TokenType::Identifier &&
+                        lexer_.content(next) == className;
+            if (move) {
+                getNextToken(); // eat move
+                if (lexer_.viewNextToken().type != TokenType::lParenthesis) {
+                    error("Expected ( after the move constructor's name.");
+                    return nullptr;
+                }
+            }
+            if (lexer_.curContent() == className && lexer_.viewNextToken().type == TokenType::lParenthesis) {
                 // parsing constructor
                 getNextToken();
                 auto ArgNames = ParseFunctionArgList();
                 getNextToken();
-                std::unique_ptr<CompoundStmt> b = ParseBlock();
-                auto retType = std::make_unique<TypeStmt>("void");
-                auto F = std::make_unique<FunctionDecl>("__construct", std::move(ArgNames), std::move(retType), std::move(b));
-                classDecl->addConstructor(std::move(F));
+                CompoundStmt* b = ParseBlock();
+                auto retType = context_.create<TypeStmt>("void");
+                auto F = context_.create<FunctionDecl>("__construct", context_.copyArray(ArgNames), retType, b);
+                constructors.push_back(F);
+                if (move) moveConstructor = F;
             } else {   // parsing member variable
                 auto type = ParseType();
-                auto name = lexer_.curToken().content;
+                auto name = context_.copyString(lexer_.curContent());
                 getNextToken();
                 if (name == "") {
                     error("Invalid declaration.");
                     return nullptr;
                 }
                 //symbol_->setValue(name, Variable(name, type));
-                classDecl->addMemberVariable(std::move(type), name);
+                memberVariables.emplace_back(type, name);
                 //c.memberVariables.emplace_back(name, type);
             }
         } else if (lexer_.curToken().type == TokenType::Function) {
             auto f = ParseFunction();
-            classDecl->addMemberFunction(std::move(f));
+            memberFunctions.push_back(f);
         } else if (lexer_.curToken().type == TokenType::Tilde) {   // parsing destructor
             getNextToken(); //eat ~
-            if (lexer_.curToken().type != TokenType::Identifier || lexer_.curToken().content != classDecl->name()) {
+            if (lexer_.curToken().type != TokenType::Identifier || lexer_.curContent() != className) {
                 error("Expected classname to identify destructor.");
                 return nullptr;
             }
@@ -683,11 +703,10 @@ std::unique_ptr<ClassDecl> Parse::Parser::ParseClass() {
                 return nullptr;
             }
             auto b = ParseBlock();
-            auto retType = std::make_unique<TypeStmt>("void");
-            auto destructor = std::make_unique<FunctionDecl>("__destructor",
-                std::vector<std::pair<std::unique_ptr<Stmt>, std::string>>{},
-                std::move(retType), std::move(b));
-            classDecl->setDestructor(std::move(destructor));
+            auto retType = context_.create<TypeStmt>("void");
+            destructor = context_.create<FunctionDecl>("__destructor",
+                llvm::ArrayRef<std::pair<Stmt*, std::string_view>>{},
+                retType, b);
             //auto block = ParseBlock();
             //std::vector<Variable> args;
             //Function f("__destructor", args, VarType("void"), false);
@@ -707,14 +726,15 @@ std::unique_ptr<ClassDecl> Parse::Parser::ParseClass() {
         //cur_class_ = tmp;
     }
     getNextToken();
-    return classDecl;
+    return context_.create<ClassDecl>(className, context_.copyArray(memberVariables),
+                                      context_.copyArray(memberFunctions), context_.copyArray(constructors),
+                                      destructor, moveConstructor);
 }
 
 void Parse::Parser::HandleClass() {
     auto c = ParseClass();
     if (c) {
-        fprintf(stderr, "Parsed a class.\n");
-        classDecls_.push_back(std::move(c));
+        classDecls_.push_back(c);
     } else {
         getNextToken();
     }
@@ -740,6 +760,9 @@ void Parse::Parser::MainLoop() {
         case TokenType::Internal:
             ParseInternal();
             break;
+        case TokenType::Import:
+            ParseImport();
+            break;
             //case TokenType::Using:
             //    ParseUsing();
             //    break;
@@ -754,47 +777,49 @@ void Parse::Parser::MainLoop() {
     }
 }
 
-Token& Parse::Parser::getNextToken() {
-    return lexer_.curToken() = lexer_.nextToken();
+Token Parse::Parser::getNextToken() {
+    lexer_.nextToken();
+    return lexer_.curToken();
 }
 
 void Parse::Parser::error(const std::string& errmsg) {
-    std::cout << lexer_.curToken().lineNum << "." << lexer_.curToken().charNum << ":\t";
+    auto loc = lexer_.location(lexer_.curToken());
+    std::cout << loc.lineNum << "." << loc.charNum << ":\t";
     std::cout << errmsg << std::endl;
 }
 
-std::vector<std::unique_ptr<Stmt>> Parse::Parser::ParseExprList(TokenType endToken) {
-    std::vector<std::unique_ptr<Stmt>> exprs;
+std::vector<Stmt*> Parse::Parser::ParseExprList(TokenType endToken) {
+    std::vector<Stmt*> exprs;
     while (lexer_.curToken().type != endToken) {
         exprs.push_back(ParseExpression());
         if (lexer_.curToken().type == endToken) break;
         if (lexer_.curToken().type != TokenType::Comma) {
             error("Expect , to split expressions.");
-            return std::vector<std::unique_ptr<Stmt>>();
+            return std::vector<Stmt*>();
         }
         getNextToken();  // eat ,
     }
     return exprs;
 }
 
-std::vector<std::unique_ptr<Stmt>> Parse::Parser::ParseParenExprList() {
+std::vector<Stmt*> Parse::Parser::ParseParenExprList() {
     getNextToken(); // eat (
     auto exprs = ParseExprList(TokenType::rParenthesis);
     getNextToken();  // eat )
     return exprs;
 }
 
-std::vector<std::unique_ptr<Stmt>> Parse::Parser::ParseSquareExprList() {
+std::vector<Stmt*> Parse::Parser::ParseSquareExprList() {
     getNextToken(); // eat [
     auto exprs = ParseExprList(TokenType::rSquare);
     getNextToken();  // eat ]
     return exprs;
 }
 
-std::vector<std::unique_ptr<Stmt>> Parse::Parser::ParseAngleExprList() {
+std::vector<Stmt*> Parse::Parser::ParseAngleExprList() {
     getNextToken(); // eat <
     //auto exprs = ParseExprList(TokenType::rAngle);
-    std::vector<std::unique_ptr<Stmt>> exprs;
+    std::vector<Stmt*> exprs;
     while (lexer_.curToken().type != TokenType::rAngle) {
         if(lexer_.curToken().type==TokenType::Identifier)
         {
@@ -819,29 +844,29 @@ std::vector<std::unique_ptr<Stmt>> Parse::Parser::ParseAngleExprList() {
     return exprs;
 }
 
-std::unique_ptr<Stmt> Parse::Parser::ParseType() {
+Stmt* Parse::Parser::ParseType() {
     /*bool isconst = false;
-    if(lexer_.curToken().content=="const")
+    if(lexer_.curContent()=="const")
     {
         isconst = true;
     }*/
-    auto type = lexer_.curToken().content;
+    auto type = context_.copyString(lexer_.curContent());
     getNextToken();
     if (lexer_.curToken().type == TokenType::lAngle) {
         auto templateArgs = ParseAngleExprList();
-        return std::make_unique<TypeStmt>(type, std::move(templateArgs));
+        return context_.create<TypeStmt>(type, context_.copyArray(templateArgs));
     }
-    return std::make_unique<TypeStmt>(type);
+    return context_.create<TypeStmt>(type);
 }
 
-void Parse::Parser::print() {
+void Parse::Parser::print(llvm::raw_ostream& os) {
     for (auto& expr : classDecls_) {
-        expr->print("", true);
-        std::cout << std::endl;
+        expr->print(os, "", true);
+        os << '\n';
     }
     for (auto& expr : functionDecls_) {
-        expr->print("", true);
-        std::cout << std::endl;
+        expr->print(os, "", true);
+        os << '\n';
     }
 }
 
@@ -863,7 +888,11 @@ void Parser::dumpToXML(const std::string& filename) {
     std::cout << "The AST dump file had been written to " << filename << ".\n";
 }
 
-void Parse::Parser::convertToLLVM() {
+void Parse::Parser::convertToLLVM(unsigned threads) {
+    std::vector<std::string> dirs{ "", llvm::sys::path::parent_path(filename_).str() };
+    for (auto& name : imports_) {
+        ModuleInterface::import(name, context_, dirs);
+    }
     for (auto& clas : classDecls_) {
         clas->toLLVM(&context_);
     }
@@ -873,12 +902,59 @@ void Parse::Parser::convertToLLVM() {
     for (auto& func : functionDecls_) {
         func->registerPrototype(&context_);
     }
-    for(auto& func:functionDecls_)
-    {
+    // every body has its own scopes and temporaries, numbered from 1
+    auto lowerBody = [this](FunctionDecl* func) {
+        SymbolTable::BodyScope body;
+        SymbolTable::BodyGuard guard(body);
         func->toLLVM(&context_);
+    };
+    if (context_.codeGenerator()) {
+        // the IR builder is not shared, bodies are emitted one by one
+        for (auto func : functionDecls_) lowerBody(func);
+        return;
+    }
+
+    // All types and prototypes are known now. The bodies are checked in
+    // parallel against the frozen tables, those that need a new template
+    // instance or fail are checked again afterwards in order, so that the
+    // AST and the first error are the same as checking them one by one.
+    auto count = functionDecls_.size();
+    std::vector<std::unique_ptr<FunctionAST>> bodies(count);
+    std::vector<char> redo(count, 0);
+    std::atomic<size_t> next{ 0 };
+    auto worker = [&] {
+        for (size_t i; (i = next++) < count;) {
+            SymbolTable::BodyScope body;
+            SymbolTable::BodyGuard guard(body);
+            try {
+                bodies[i] = functionDecls_[i]->toFunctionAST(&context_);
+            }
+            catch (...) {
+                redo[i] = 1;
+            }
+        }
+    };
+    context_.symbolTable().freeze();
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < std::min<size_t>(threads, count); ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+    context_.symbolTable().unfreeze();
+
+    for (size_t i = 0; i < count; ++i) {
+        if (redo[i]) lowerBody(functionDecls_[i]);
+        else if (bodies[i]) context_.addFunctionAST(std::move(bodies[i]));
     }
 }
 
+void Parse::Parser::writeInterface(const std::string& filename) {
+    std::vector<CompoundType*> classes;
+    for (auto clas : classDecls_) classes.push_back(clas->type());
+    std::vector<FunctionType*> functions;
+    for (auto func : functionDecls_) functions.push_back(func->type());
+    ModuleInterface::write(filename, imports_, classes, functions);
+}
+
 ASTContext& Parse::Parser::context()
 {
     return context_;
@@ -941,6 +1017,20 @@ ASTContext& Parse::Parser::context()
 //    }
 //}
 
+void Parse::Parser::ParseImport() {
+    getNextToken(); // eat import
+    if (lexer_.curToken().type != TokenType::Identifier) {
+        error("Expected module name after import.");
+        return;
+    }
+    imports_.emplace_back(lexer_.curContent());
+    getNextToken();
+    if (lexer_.curToken().type != TokenType::Semicolon)
+        error("Expected ; after import.");
+    else
+        getNextToken();
+}
+
 void Parse::Parser::ParseExternal() {
     isExternal = true;
     getNextToken();
@@ -963,9 +1053,9 @@ void Parse::Parser::ParseTemplateClass()
     std::vector<std::pair<std::string, std::string>> typelist;
     while (lexer_.curToken().type!=TokenType::rAngle)
     {
-        auto type = lexer_.curToken().content;
+        std::string type(lexer_.curContent());
         getNextToken();
-        auto name = lexer_.curToken().content;
+        std::string name(lexer_.curContent());
         getNextToken();
         typelist.emplace_back(type, name);
         if (lexer_.curToken().type == TokenType::Comma) getNextToken();
@@ -978,7 +1068,7 @@ void Parse::Parser::ParseTemplateClass()
         {
             error("Parse class error.");
         }
-        context().addClassTemplate(std::move(typelist), std::move(c));
+        context().addClassTemplate(std::move(typelist), c);
         //templateClassDecls_.emplace_back(std::move(typelist), c);
     }else
     {
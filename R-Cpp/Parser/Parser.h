@@ -10,61 +10,74 @@ namespace Parse {
     class Parser
     {
     public:
-        Parser(const std::string& filename) :lexer_(filename),isExternal(false)//,
+        Parser(const std::string& filename)
+            :lexer_(filename, Lexer::Mode::Mapped, ScanKernel::scalar(), Lexer::Tokenize::OnDemand),filename_(filename),isExternal(false)//,
             /*,
             isExternal(false),nameless_var_count_(0)*/ {
         }
 
-        void print();
+        void print(llvm::raw_ostream& os);
         void dumpToXML(const std::string& filename = "ast.xml");
-        void convertToLLVM();
+        // Checks the declarations and builds the AST, or emits IR when the
+        // context has a code generator. Function bodies are checked on up
+        // to threads threads, the result does not depend on their number.
+        // The imported modules are declared first, their interfaces are
+        // looked for in the working directory and next to the source.
+        void convertToLLVM(unsigned threads = 1);
+        // the interface of this file for `import`, after convertToLLVM()
+        void writeInterface(const std::string& filename);
+        // the modules named by `import`, after MainLoop()
+        const std::vector<std::string>& imports() const { return imports_; }
         ASTContext& context();
         void MainLoop();
 
     private:
-        std::unique_ptr<Stmt> ParsePrimary();
-        std::unique_ptr<Stmt> ParseStatement();
-        std::unique_ptr<Stmt> ParseIntegerExpr();
-        std::unique_ptr<Stmt> ParseFloatExpr();
-        std::unique_ptr<Stmt> ParseParenExpr();
-        std::unique_ptr<Stmt> ParseIdentifierExpr();
-        std::unique_ptr<Stmt> ParseVariableDefinition(const std::string& type_name);
-        std::unique_ptr<Stmt> ParseReturnExpr();
-        std::unique_ptr<Stmt> ParseExpression();
-        std::unique_ptr<Stmt> ParseIfExpr();
-        std::unique_ptr<Stmt> ParseForExpr();
-        std::unique_ptr<Stmt> ParsePostOperator(std::unique_ptr<Stmt> lhs);
+        Stmt* ParsePrimary();
+        Stmt* ParseStatement();
+        Stmt* ParseIntegerExpr();
+        Stmt* ParseFloatExpr();
+        Stmt* ParseParenExpr();
+        Stmt* ParseIdentifierExpr();
+        Stmt* ParseVariableDefinition(std::string_view type_name);
+        Stmt* ParseReturnExpr();
+        Stmt* ParseExpression();
+        Stmt* ParseIfExpr();
+        Stmt* ParseForExpr();
+        Stmt* ParsePostOperator(Stmt* lhs);
         //std::unique_ptr<Stmt> ParseMemberAccess(std::unique_ptr<Stmt> lhs, OperatorType Op);
-        std::unique_ptr<FunctionDecl> ParsePrototype();
-        std::unique_ptr<FunctionDecl> ParseFunction();
-        std::unique_ptr<CompoundStmt> ParseBlock();
-        std::unique_ptr<ClassDecl> ParseClass();
-        std::vector<std::unique_ptr<Stmt>> ParseParenExprList();
-        std::vector<std::unique_ptr<Stmt>> ParseSquareExprList();
-        std::vector<std::unique_ptr<Stmt>> ParseAngleExprList();
-        std::vector<std::pair<std::unique_ptr<Stmt>, std::string>> ParseFunctionArgList();
+        FunctionDecl* ParsePrototype();
+        FunctionDecl* ParseFunction();
+        CompoundStmt* ParseBlock();
+        ClassDecl* ParseClass();
+        std::vector<Stmt*> ParseParenExprList();
+        std::vector<Stmt*> ParseSquareExprList();
+        std::vector<Stmt*> ParseAngleExprList();
+        std::vector<std::pair<Stmt*, std::string_view>> ParseFunctionArgList();
         void HandleDefinition();
         void HandleClass();
 
         void ParseExternal();
         void ParseInternal();
+        void ParseImport();
         //void ParseUsing();
         void ParseTemplateClass();
 
-        Token& getNextToken();
+        Token getNextToken();
         OperatorType getNextBinOperator();
         OperatorType getNextUnaryOperator();
         void error(const std::string& errmsg);
-        std::unique_ptr<Stmt> MergeExpr(std::unique_ptr<Stmt>, std::unique_ptr<Stmt>, OperatorType);
-        std::vector<std::unique_ptr<Stmt>> ParseExprList(TokenType endToken);
-        std::unique_ptr<Stmt> ParseType();
+        Stmt* MergeExpr(Stmt*, Stmt*, OperatorType);
+        std::vector<Stmt*> ParseExprList(TokenType endToken);
+        Stmt* ParseType();
         void generateNewForClass(Type* type); 
         //void generateDestructor(Class&c, std::unique_ptr<BlockExprAST> block);
         bool isPostOperator();
 
         Lexer lexer_;
-        std::vector<std::unique_ptr<FunctionDecl>> functionDecls_;
-        std::vector<std::unique_ptr<ClassDecl>> classDecls_;
+        std::string filename_;
+        std::vector<std::string> imports_;
+        std::vector<FunctionDecl*> functionDecls_;
+        std::vector<ClassDecl*> classDecls_;
         bool isExternal;
         ASTContext context_;
     };
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+#include "../Lexer/StringTable.h"
+
+// Open-addressing hash map from interned names (StringTable handles) to T.
+// The slots only hold the handle and an index, the values live in a deque
+// so pointers to them stay valid as the map grows. Nothing is ever erased.
+template <typename T>
+class SymbolMap
+{
+public:
+    using handle = StringTable::handle;
+
+    T* find(handle key)
+    {
+        if (slots_.empty()) return nullptr;
+        for (auto i = slotOf(key);; i = (i + 1) & mask()) {
+            if (slots_[i].key == StringTable::npos) return nullptr;
+            if (slots_[i].key == key) return &values_[slots_[i].index];
+        }
+    }
+
+    // like std::map::try_emplace, returns the existing value if there is one
+    template <typename... Args>
+    T& emplace(handle key, Args&&... args)
+    {
+        if (auto v = find(key)) return *v;
+        if ((values_.size() + 1) * 4 > slots_.size() * 3) grow();
+        auto i = slotOf(key);
+        while (slots_[i].key != StringTable::npos)
+            i = (i + 1) & mask();
+        slots_[i] = { key, static_cast<std::uint32_t>(values_.size()) };
+        values_.emplace_back(std::forward<Args>(args)...);
+        return values_.back();
+    }
+
+    T& operator[](handle key) { return emplace(key); }
+    size_t size() const { return values_.size(); }
+
+private:
+    struct Slot
+    {
+        handle key;
+        std::uint32_t index;
+    };
+
+    size_t mask() const { return slots_.size() - 1; }
+    // handles are handed out in sequence, an odd multiplier spreads them
+    // over the low bits without collisions
+    size_t slotOf(handle key) const { return (key * 2654435769u) & mask(); }
+
+    void grow()
+    {
+        std::vector<Slot> old(slots_.empty() ? 8 : slots_.size() * 2, Slot{ StringTable::npos, 0 });
+        old.swap(slots_);
+        for (auto& s : old) {
+            if (s.key == StringTable::npos) continue;
+            auto i = slotOf(s.key);
+            while (slots_[i].key != StringTable::npos)
+                i = (i + 1) & mask();
+            slots_[i] = s;
+        }
+    }
+
+    std::vector<Slot> slots_;
+    std::deque<T> values_;
+};
+
+// Bindings of names to T in nested scopes. Only the innermost binding of a
+// name is visible, a binding records the one it shadows so that leaving a
+// scope restores them without searching the outer scopes. Entering and
+// leaving a scope is O(1) plus the bindings made in it.
+template <typename T>
+class ScopedSymbolMap
+{
+public:
+    using handle = StringTable::handle;
+
+    void pushScope() { scopes_.push_back(bindings_.size()); }
+
+    void popScope()
+    {
+        auto begin = scopes_.back();
+        scopes_.pop_back();
+        while (bindings_.size() > begin) {
+            *visible_.find(bindings_.back().key) = bindings_.back().shadowed;
+            bindings_.pop_back();
+        }
+    }
+
+    template <typename... Args>
+    T& bind(handle key, Args&&... args)
+    {
+        auto& top = visible_[key];
+        bindings_.push_back({ key, top, T(std::forward<Args>(args)...) });
+        top = static_cast<std::uint32_t>(bindings_.size());
+        return bindings_.back().value;
+    }
+
+    T* find(handle key)
+    {
+        auto top = visible_.find(key);
+        if (top == nullptr || *top == 0) return nullptr;
+        return &bindings_[*top - 1].value;
+    }
+
+    // all bindings in the order they were made, the innermost scope's
+    // start at scopeBegin()
+    size_t size() const { return bindings_.size(); }
+    T& operator[](size_t i) { return bindings_[i].value; }
+    size_t scopeBegin() const { return scopes_.back(); }
+
+private:
+    struct Binding
+    {
+        handle key;
+        std::uint32_t shadowed;   // index + 1 of the shadowed binding, 0 if none
+        T value;
+    };
+
+    SymbolMap<std::uint32_t> visible_;   // index + 1 of the innermost binding
+    std::deque<Binding> bindings_;
+    std::vector<size_t> scopes_;
+};
@@ -1,11 +1,12 @@
 #include "SymbolTable.h"
 #include "../CodeGenerator/CodeGenerator.h"
+#include <algorithm>
 
 using namespace Parse;
 
 ClassTemplate::
-ClassTemplate(std::vector<std::pair<std::string, std::string>> typelist, std::unique_ptr<ClassDecl> decl):
-    name(decl->name()), typeList(std::move(typelist)), classDecl_(std::move(decl))
+ClassTemplate(std::vector<std::pair<std::string, std::string>> typelist, ClassDecl* decl):
+    name(decl->name()), typeList(std::move(typelist)), classDecl_(decl)
 {
     assert(classDecl_ != nullptr);
 }
@@ -17,7 +18,7 @@ ClassTemplate(const std::string& name, std::vector<std::pair<std::string, std::s
                                                                                                    classDecl_(nullptr)
 {
     // only for builtin type
-    assert(name == "__ptr" || name == "__arr");
+    assert(name == "__ptr" || name == "__arr" || name == "rc" || name == "arc");
 }
 
 Type* ClassTemplate::instantiate(const std::vector<Type*>& args,ASTContext* context)
@@ -62,37 +63,37 @@ Type* ClassTemplate::instantiate(const std::vector<Type*>& args,ASTContext* cont
 
 }
 
-SymbolTable::SymbolTable(ASTContext& context):context_(context), helper_("",nullptr),cur_namespace_(&helper_),specfied_namespace_(nullptr)
+thread_local SymbolTable::BodyScope* SymbolTable::cur_body_ = nullptr;
+
+SymbolTable::SymbolTable(ASTContext& context):context_(context), helper_("",nullptr),cur_namespace_(&helper_),frozen_(false)
 {
-    createScope();
     for(auto& s:BuiltinType::builtinTypeSet())
     {
-        helper_.namedType.emplace(s,std::make_unique<BuiltinType>(s));
+        helper_.namedType.emplace(symbols_.internCopy(s),std::make_unique<BuiltinType>(s));
     }
     std::vector<std::pair<std::string, std::string>> typelist;
     typelist.emplace_back("Any", "T");
-    helper_.classTemplate.emplace("__ptr",ClassTemplate("__ptr",typelist));
+    helper_.classTemplate.emplace(symbols_.internCopy("__ptr"),ClassTemplate("__ptr",typelist));
+    helper_.classTemplate.emplace(symbols_.internCopy("rc"), ClassTemplate("rc", typelist));
+    helper_.classTemplate.emplace(symbols_.internCopy("arc"), ClassTemplate("arc", typelist));
     typelist.emplace_back("Integer", "Size");
-    helper_.classTemplate.emplace("__arr", ClassTemplate("__arr", typelist));
+    helper_.classTemplate.emplace(symbols_.internCopy("__arr"), ClassTemplate("__arr", typelist));
 }
 
 void SymbolTable::createScope()
 {
-    named_values_.emplace_back();
-    named_values_seq_.emplace_back();
+    body().namedValues.pushScope();
 }
 
 void SymbolTable::destroyScope()
 {
-    named_values_.pop_back();
-    named_values_seq_.pop_back();
+    body().namedValues.popScope();
 }
 
 void SymbolTable::createNamespace(const std::string& name)
 {
-    cur_namespace_->createNewNS(name);
+    cur_namespace_ = cur_namespace_->createNewNS(symbols_.internCopy(name), name);
     ns_hierarchy_.push_back(name);
-    cur_namespace_ = cur_namespace_->nextNS[name].get();
 }
 
 void SymbolTable::destroyNamespace()
@@ -102,66 +103,65 @@ void SymbolTable::destroyNamespace()
 }
 
 
-Variable* SymbolTable::getVariable(const std::string& name)
+Variable* SymbolTable::getVariable(std::string_view name)
 {
-    for (auto it = named_values_.rbegin(); it != named_values_.rend(); ++it)
-    {
-        auto t = it->find(name);
-        if (t != it->end()) return t->second.get();
-    }
-    return nullptr;
+    auto& b = body();
+    return b.namedValues.find(b.names.find(name));
 }
 
 void SymbolTable::addVariable(Type* type, const std::string& name)
 {
-    named_values_.back()[name] = std::make_unique<Variable>(type,name);
-    named_values_seq_.back().push_back(name);
+    auto& b = body();
+    b.namedValues.bind(b.names.internCopy(name), type, name);
 }
 
 CompoundType* SymbolTable::addType(const std::string& name, std::vector<std::pair<Type*, std::string>> memberList)
 {
     auto type = std::make_unique<CompoundType>(name, std::move(memberList));
     type->setNamespaceHierarchy(cur_namespace_);
-    cur_namespace_->namedType[name] = std::move(type);
-    return dynamic_cast<CompoundType*>(cur_namespace_->namedType[name].get());
+    auto ret = type.get();
+    cur_namespace_->namedType[symbols_.internCopy(name)] = std::move(type);
+    return ret;
 }
 
-Type* SymbolTable::getType(const std::string& t, const std::vector<Type*>& args)
+static Type* instantiate(ClassTemplate& template_, const std::vector<Type*>& args, ASTContext& context)
 {
-    if(specfied_namespace_) {
-        auto type = specfied_namespace_->namedType.find(t);
-        if (type != specfied_namespace_->namedType.end()) return type->second.get();
-        auto func = specfied_namespace_->namedFunction.find(t);
-        if (func != specfied_namespace_->namedFunction.end()) return func->second[0].get();
-        auto template_ = specfied_namespace_->classTemplate.find(t);
-        if (template_ != specfied_namespace_->classTemplate.end()) {   //find by name
-            if (template_->second.typeList.size() == args.size()) {   // check if the arg size is same
-                for (auto& p : template_->second.instantiatedType) {   // check if has been instantiated
-                    if (p.first == args) {
-                        return p.second.get();
-                    }
-                }
-                //instantiate template
-                return template_->second.instantiate(args,&context_);
-            }
+    if (template_.typeList.size() != args.size()) return nullptr;   // check if the arg size is same
+    for (auto& p : template_.instantiatedType) {   // check if has been instantiated
+        if (p.first == args) {
+            return p.second.get();
+        }
+    }
+    if (context.symbolTable().frozen()) throw SymbolTable::FrozenError();
+    //instantiate template
+    return template_.instantiate(args, &context);
+}
+
+Type* SymbolTable::getType(std::string_view t, const std::vector<Type*>& args)
+{
+    auto key = symbols_.find(t);
+    if (key == StringTable::npos) return nullptr;
+    if(auto specified = body().specifiedNamespace) {
+        if (auto type = specified->namedType.find(key)) return type->get();
+        if (auto func = specified->namedFunction.find(key)) return (*func)[0].get();
+        if (auto template_ = specified->classTemplate.find(key)) {   //find by name
+            if (auto type = instantiate(*template_, args, context_)) return type;
         }
     }
     NamespaceHelper* ns = cur_namespace_;
     if(args.size()==0)
     {
         while (ns != nullptr) {
-            auto alias = ns->alias.find(t);
-            if (alias != ns->alias.end()) return alias->second;
+            auto alias = ns->alias.find(key);
+            if (alias != nullptr && *alias != nullptr) return *alias;
 
-            auto it = ns->namedType.find(t);
-            if (it != ns->namedType.end()) return it->second.get();
+            if (auto type = ns->namedType.find(key)) return type->get();
             ns = ns->lastNS;
         }
         ns = cur_namespace_;
         while (ns != nullptr) {
-            auto it = ns->namedFunction.find(t);
-            if (it != ns->namedFunction.end()) {   //find by name
-                return it->second[0].get();
+            if (auto func = ns->namedFunction.find(key)) {   //find by name
+                return (*func)[0].get();
             }
             ns = ns->lastNS;
         }
@@ -169,21 +169,10 @@ Type* SymbolTable::getType(const std::string& t, const std::vector<Type*>& args)
     else
     {
         while (ns != nullptr) {
-            auto it = ns->classTemplate.find(t);
-            if (it != ns->classTemplate.end()) 
+            if (auto template_ = ns->classTemplate.find(key))
             {   //find by name
-                if(it->second.typeList.size()==args.size())
-                {   // check if the arg size is same
-                    for(auto&p:it->second.instantiatedType)
-                    {   // check if has been instantiated
-                        if(p.first==args)
-                        {
-                            return p.second.get();
-                        }
-                    }
-                    //instantiate template
-                    return it->second.instantiate(args,&context_);
-                }
+                if (template_->typeList.size() == args.size())
+                    return instantiate(*template_, args, context_);
             }
             ns = ns->lastNS;
         }
@@ -196,19 +185,20 @@ FunctionType* SymbolTable::addFunction(const std::string& name, std::vector<std:
     auto fn = std::make_unique<FunctionType>(name, std::move(argList), returnType, context_.currentClass(), isExternal);
     fn->setNamespaceHierarchy(cur_namespace_);
     auto ret = fn.get();
-    cur_namespace_->namedFunction[name].push_back(std::move(fn));
+    cur_namespace_->namedFunction[symbols_.internCopy(name)].push_back(std::move(fn));
     return ret;
 }
 
-const std::vector<std::unique_ptr<FunctionType>>* SymbolTable::getFunction(const std::string& name, const std::vector<std::string>& ns_hierarchy)
+const std::vector<std::unique_ptr<FunctionType>>* SymbolTable::getFunction(std::string_view name, const std::vector<std::string>& ns_hierarchy)
 {
-    if(specfied_namespace_) {
-        return getRawFunction_(name, ns_hierarchy, specfied_namespace_);
+    auto key = symbols_.find(name);
+    if(auto specified = body().specifiedNamespace) {
+        return getRawFunction_(key, ns_hierarchy, specified);
     }
     auto cur = cur_namespace_;
     while (cur!=nullptr)
     {
-        auto flist = getRawFunction_(name, ns_hierarchy, cur);
+        auto flist = getRawFunction_(key, ns_hierarchy, cur);
         if (flist->size() != 0) return flist;
         cur = cur->lastNS;
     }
@@ -220,36 +210,42 @@ const std::vector<std::string>& SymbolTable::getNamespaceHierarchy()
     return ns_hierarchy_;
 }
 
-NamespaceHelper* SymbolTable::getNamespace(const std::string& name) const {
-    if(specfied_namespace_) {
-        auto it = specfied_namespace_->nextNS.find(name);
-        if (it != specfied_namespace_->nextNS.end()) return it->second.get();
-        return nullptr;
+NamespaceHelper* SymbolTable::getNamespace(std::string_view name) const {
+    auto key = symbols_.find(name);
+    if(auto specified = body().specifiedNamespace) {
+        auto ns = specified->nextNS.find(key);
+        return ns ? ns->get() : nullptr;
     }
     auto cur = cur_namespace_;
     while (cur != nullptr) {
-        auto it = cur->nextNS.find(name);
-        if (it!=cur->nextNS.end()) return it->second.get();
+        if (auto ns = cur->nextNS.find(key)) return ns->get();
         cur = cur->lastNS;
     }
     return nullptr;
 }
 
-const std::vector<std::unique_ptr<FunctionType>>* SymbolTable::getRawFunction_(const std::string& name, const std::vector<std::string>& ns_hier,NamespaceHelper* ns)
+NamespaceHelper* SymbolTable::getNestedNamespace(NamespaceHelper* ns, std::string_view name) const {
+    auto next = ns->nextNS.find(symbols_.find(name));
+    return next ? next->get() : nullptr;
+}
+
+const std::vector<std::unique_ptr<FunctionType>>* SymbolTable::getRawFunction_(StringTable::handle name, const std::vector<std::string>& ns_hier,NamespaceHelper* ns)
 {
+    static const std::vector<std::unique_ptr<FunctionType>> none;
     for(size_t i=0;i<ns_hier.size();++i)
     {
-        ns = ns->nextNS[ns_hier[i]].get();
-        if (ns == nullptr) return {};
+        ns = getNestedNamespace(ns, ns_hier[i]);
+        if (ns == nullptr) return &none;
     }
-    return &(ns->namedFunction[name]);
+    auto fns = ns->namedFunction.find(name);
+    return fns ? fns : &none;
 }
 
 void SymbolTable::addClassTemplate(
-    std::vector<std::pair<std::string, std::string>> arglist, std::unique_ptr<ClassDecl> decl)
+    std::vector<std::pair<std::string, std::string>> arglist, ClassDecl* decl)
 {
     auto name = decl->name();
-    cur_namespace_->classTemplate.emplace(std::make_pair(name, ClassTemplate(std::move(arglist), std::move(decl))));
+    cur_namespace_->classTemplate.emplace(symbols_.internCopy(name), ClassTemplate(std::move(arglist), decl));
 //    cur_namespace_->classTemplate[decl->name()] = ClassTemplate(std::move(arglist),std::move(decl));
 }
 
@@ -272,12 +268,12 @@ void SymbolTable::addClassTemplate(
 
 void SymbolTable::setAlias(const std::string& newName, Type* oldType)
 {
-    cur_namespace_->alias[newName] = oldType;
+    cur_namespace_->alias[symbols_.internCopy(newName)] = oldType;
 }
 
 void SymbolTable::unsetAlias(const std::string& name)
 {
-    cur_namespace_->alias.erase(cur_namespace_->alias.find(name));
+    *cur_namespace_->alias.find(symbols_.find(name)) = nullptr;
 }
 
 //
@@ -332,11 +328,41 @@ void SymbolTable::callDestructorForCurScope(BlockExprAST* block)
 
 
 void SymbolTable::setSpecfiedNamespace(NamespaceHelper* ns) {
-    specfied_namespace_ = ns;
+    body().specifiedNamespace = ns;
 }
 
 void SymbolTable::unsetSpecfiedNamespace() {
-    specfied_namespace_ = nullptr;
+    body().specifiedNamespace = nullptr;
+}
+
+SymbolTable::BodyScope& SymbolTable::body() {
+    return cur_body_ ? *cur_body_ : shared_body_;
+}
+
+const SymbolTable::BodyScope& SymbolTable::body() const {
+    return cur_body_ ? *cur_body_ : shared_body_;
+}
+
+void SymbolTable::freeze() {
+    frozen_ = true;
+}
+
+void SymbolTable::unfreeze() {
+    frozen_ = false;
+}
+
+bool SymbolTable::frozen() const {
+    return frozen_;
+}
+
+SymbolTable::BodyGuard::BodyGuard(BodyScope& scope): last_(cur_body_)
+{
+    cur_body_ = &scope;
+}
+
+SymbolTable::BodyGuard::~BodyGuard()
+{
+    cur_body_ = last_;
 }
 
 SymbolTable::ScopeGuard::ScopeGuard(SymbolTable& st): st_(st), block_(nullptr)
@@ -356,6 +382,16 @@ void SymbolTable::ScopeGuard::setBlock(BlockExprAST* block)
     block_ = block;
 }
 
+SymbolTable::FunctionGuard::FunctionGuard(SymbolTable& st): st_(st), last_(st.body().functionBegin)
+{
+    st_.body().functionBegin = st_.variableCount();
+}
+
+SymbolTable::FunctionGuard::~FunctionGuard()
+{
+    st_.body().functionBegin = last_;
+}
+
 SymbolTable::NamespaceGuard::NamespaceGuard(SymbolTable& st, const std::string& name): st_(st)
 {
     st_.createNamespace(name);
@@ -366,18 +402,33 @@ SymbolTable::NamespaceGuard::~NamespaceGuard()
     st_.destroyNamespace();
 }
 
-std::vector<std::string> SymbolTable::getVariableListOfScope() {
-    return named_values_seq_.back();
+size_t SymbolTable::variableCount() const {
+    return body().namedValues.size();
+}
+
+Variable* SymbolTable::variableAt(size_t index) {
+    return &body().namedValues[index];
+}
+
+size_t SymbolTable::scopeBegin() const {
+    return body().namedValues.scopeBegin();
 }
 
 const std::vector<std::unique_ptr<Variable>>& SymbolTable::getNamelessVariableList() {
-    return nameless_values_;
+    return body().namelessValues;
 }
 
 void SymbolTable::clearNamelessVariable() {
-    nameless_values_.clear();
+    body().namelessValues.clear();
+}
+
+
+void SymbolTable::takeNamelessVariable(const std::string& name) {
+    auto& values = body().namelessValues;
+    auto it = std::find_if(values.begin(), values.end(), [&](auto& v) { return v->name_ == name; });
+    if (it != values.end()) values.erase(it);
 }
 
-const std::vector<std::vector<std::string>>& SymbolTable::getVariableListOfAll() {
-    return named_values_seq_;
+size_t SymbolTable::functionBegin() const {
+    return body().functionBegin;
 }
@@ -1,8 +1,11 @@
 #pragma once
 #include "Type.h"
+#include "SymbolMap.h"
 #include "../Util/Token.h"
+#include <cstdint>
+#include <exception>
+#include <string_view>
 #include <vector>
-#include <map>
 
 class BlockExprAST;
 class ExprAST;
@@ -23,60 +26,92 @@ namespace Parse {
     struct ClassTemplate
     {
       //  ClassTemplate(){}
-        ClassTemplate(std::vector<std::pair<std::string, std::string>> typelist, std::unique_ptr<ClassDecl> decl);
+        ClassTemplate(std::vector<std::pair<std::string, std::string>> typelist, ClassDecl* decl);
         ClassTemplate(const std::string& name, std::vector<std::pair<std::string, std::string>> typelist);
 
         std::string name;
         std::vector<std::pair<std::string, std::string>> typeList;
-        std::unique_ptr<ClassDecl> classDecl_;
+        ClassDecl* classDecl_;
         std::vector<std::pair<std::vector<Type*>, std::unique_ptr<Type>>> instantiatedType;
 
         Type* instantiate(const std::vector<Type*>& args, ASTContext* context);
     };
 
+    // the maps are keyed by the names interned in the SymbolTable
     struct NamespaceHelper
     {
         NamespaceHelper(const std::string& nsName, NamespaceHelper* last)
             :name(nsName), lastNS(last) {
         }
 
-        void createNewNS(const std::string& name) {
-            nextNS[name] = std::make_unique<NamespaceHelper>(name, this);
+        NamespaceHelper* createNewNS(StringTable::handle key, const std::string& name) {
+            auto& ns = nextNS[key];
+            ns = std::make_unique<NamespaceHelper>(name, this);
+            return ns.get();
         }
 
         std::string name;
-        std::map<std::string, std::unique_ptr<NamespaceHelper>> nextNS;
+        SymbolMap<std::unique_ptr<NamespaceHelper>> nextNS;
         std::vector<NamespaceHelper*> insertedNS;
-        std::map<std::string, std::vector<std::unique_ptr<FunctionType>>> namedFunction;
-        std::map<std::string, std::unique_ptr<Type>> namedType;
-        std::map<std::string, ClassTemplate> classTemplate;
-        std::map<std::string, Type*> alias;
+        SymbolMap<std::vector<std::unique_ptr<FunctionType>>> namedFunction;
+        SymbolMap<std::unique_ptr<Type>> namedType;
+        SymbolMap<ClassTemplate> classTemplate;
+        // nullptr once unset
+        SymbolMap<Type*> alias;
         NamespaceHelper* lastNS;
     };
 
     class SymbolTable
     {
     public:
+        // What lowering a function body changes: the variables in scope,
+        // whose names are interned here rather than in the shared table,
+        // the nameless temporaries, the namespace of a qualified name and
+        // the counter naming the temporaries. Bodies lowered in parallel
+        // each have their own, see BodyGuard.
+        struct BodyScope
+        {
+            BodyScope() { namedValues.pushScope(); }
+
+            StringTable names;
+            ScopedSymbolMap<Variable> namedValues;
+            std::vector<std::unique_ptr<Variable>> namelessValues;
+            NamespaceHelper* specifiedNamespace = nullptr;
+            int64_t namelessVarCount = 1;
+            // the first variable of the function being lowered, its
+            // arguments come first
+            size_t functionBegin = 0;
+        };
+
+        // Thrown by lookups that would have to add to the tables while they
+        // are frozen, i.e. instantiate a template or a literal type.
+        struct FrozenError: std::exception
+        {
+            const char* what() const noexcept override { return "symbol table is frozen"; }
+        };
+
         SymbolTable(ASTContext& context);
         void createScope();
         void destroyScope();
         void createNamespace(const std::string& name);
         void destroyNamespace();
 
-        Variable* getVariable(const std::string& name);
+        Variable* getVariable(std::string_view name);
         void addVariable(Type*type, const std::string& name);
         CompoundType* addType(const std::string& name, std::vector<std::pair<Type*, std::string>> memberList);
-        Type* getType(const std::string& name,const std::vector<Type*>& args={});
+        Type* getType(std::string_view name,const std::vector<Type*>& args={});
         FunctionType* addFunction(const std::string& name, std::vector<std::pair<Type*, std::string>> argList,Type* returnType,Type* classType=nullptr,bool isExternal=false);
-        const std::vector<std::unique_ptr<FunctionType>>* getFunction(const std::string& name, const std::vector<std::string>& ns_hierarchy={});
+        const std::vector<std::unique_ptr<FunctionType>>* getFunction(std::string_view name, const std::vector<std::string>& ns_hierarchy={});
         const std::vector<std::string>& getNamespaceHierarchy();
-        NamespaceHelper* getNamespace(const std::string& name) const;
+        NamespaceHelper* getNamespace(std::string_view name) const;
+        // the namespace called name directly inside ns, nullptr if none
+        NamespaceHelper* getNestedNamespace(NamespaceHelper* ns, std::string_view name) const;
         NamespaceHelper* currentNamespace() const
         {
             return cur_namespace_;
         }
         //void addClassTemplate(ClassTemplate template_);
-        void addClassTemplate(std::vector<std::pair<std::string, std::string>> arglist, std::unique_ptr<ClassDecl> decl);
+        void addClassTemplate(std::vector<std::pair<std::string, std::string>> arglist, ClassDecl* decl);
         //ClassTemplate getClassTemplate(std::string name);
         //std::string getMangledClassName(VarType type);
         void setAlias(const std::string& newName, Type* oldType);
@@ -85,14 +120,32 @@ namespace Parse {
        // void callNamelessVarDestructor(std::vector<std::unique_ptr<ExprAST>>& exprs);
         void addNamelessVariable(Type* type,const std::string name)
         {
-            nameless_values_.push_back(std::make_unique<Variable>(type,name));
+            body().namelessValues.push_back(std::make_unique<Variable>(type,name));
         }
         void setSpecfiedNamespace(NamespaceHelper* ns);
         void unsetSpecfiedNamespace();
-        std::vector<std::string> getVariableListOfScope();
-        const std::vector<std::vector<std::string>>& getVariableListOfAll();
+        // named variables in declaration order, those of the innermost
+        // scope start at scopeBegin()
+        size_t variableCount() const;
+        Variable* variableAt(size_t index);
+        size_t scopeBegin() const;
         const std::vector<std::unique_ptr<Variable>>& getNamelessVariableList();
         void clearNamelessVariable();
+        // removes the temporary called name, which its consumer took over
+        void takeNamelessVariable(const std::string& name);
+        // the variables of the function being lowered start here, those
+        // before are the members of its class or belong to the function
+        // whose body instantiated the class
+        size_t functionBegin() const;
+        // the body being lowered on this thread
+        BodyScope& body();
+        const BodyScope& body() const;
+
+        // Once frozen, types, prototypes and namespaces may only be looked
+        // up, so that function bodies can be lowered concurrently.
+        void freeze();
+        void unfreeze();
+        bool frozen() const;
 
         class ScopeGuard
         {
@@ -106,6 +159,31 @@ namespace Parse {
             BlockExprAST* block_;
         };
 
+        // Lowers the bodies on this thread in scope until the guard is
+        // destroyed, instead of the shared one.
+        class BodyGuard
+        {
+        public:
+            BodyGuard(BodyScope& scope);
+            ~BodyGuard();
+
+        private:
+            BodyScope* last_;
+        };
+
+        // Marks the variables declared until the guard is destroyed as
+        // those of a function.
+        class FunctionGuard
+        {
+        public:
+            FunctionGuard(SymbolTable& st);
+            ~FunctionGuard();
+
+        private:
+            SymbolTable& st_;
+            size_t last_;
+        };
+
         class NamespaceGuard
         {
         public:
@@ -117,17 +195,21 @@ namespace Parse {
         };
 
     private:
-        const std::vector<std::unique_ptr<FunctionType>>* getRawFunction_(const std::string& name, const std::vector<std::string>& ns_hierarchy, NamespaceHelper* ns);
+        const std::vector<std::unique_ptr<FunctionType>>* getRawFunction_(StringTable::handle name, const std::vector<std::string>& ns_hierarchy, NamespaceHelper* ns);
         //ClassTemplate getClassTemplate_(std::string name, NamespaceHelper* ns);
         void callDestructorForCurScope(BlockExprAST* block);
 
         ASTContext& context_;
-        std::vector<std::map<std::string, std::unique_ptr<Variable>>> named_values_;
-        std::vector<std::vector<std::string>> named_values_seq_;
-        std::vector<std::unique_ptr<Variable>> nameless_values_;
+        // names are interned once, lookups of names never interned fail
+        // without touching the maps
+        StringTable symbols_;
+        // bodies lowered outside a BodyGuard: member functions and the
+        // template instances they need
+        BodyScope shared_body_;
+        static thread_local BodyScope* cur_body_;
         NamespaceHelper helper_;
         NamespaceHelper* cur_namespace_;
-        NamespaceHelper* specfied_namespace_;
         std::vector<std::string> ns_hierarchy_;
+        bool frozen_;
     };
 }
\ No newline at end of file
@@ -10,7 +10,7 @@ const std::string& Parse::Type::getTypename() const {
 }
 
 Parse::Type::Type(const std::string& name, std::vector<Type*> typelist): name_(name), typelist_(std::move(typelist)),
-                                                                         namespaceHierarchy_(nullptr) {
+                                                                         namespaceHierarchy_(nullptr), llvmType_(nullptr) {
 }
 
 void Parse::Type::setNamespaceHierarchy(NamespaceHelper* hierarchy) {
@@ -26,6 +26,14 @@ const std::vector<Parse::Type*>& Parse::Type::getTemplateArgs() const
     return typelist_;
 }
 
+llvm::Type* Parse::Type::llvmType() const {
+    return llvmType_;
+}
+
+void Parse::Type::setLLVMType(llvm::Type* type) {
+    llvmType_ = type;
+}
+
 std::string Parse::Type::mangledNameNamespacePrefix() const {
     std::stack<NamespaceHelper*> s;
     auto ns = namespaceHierarchy_;
@@ -43,6 +51,13 @@ std::string Parse::Type::mangledNameNamespacePrefix() const {
 
 Parse::BuiltinType::BuiltinType(const std::string& typeName, std::vector<Type*> typelist): Type(
     typeName, std::move(typelist)) {
+    static const std::map<std::string, category> categories = {
+        { "i32", category::i32 }, { "i64", category::i64 }, { "u32", category::u32 }, { "u64", category::u64 },
+        { "bool", category::Bool }, { "float", category::Float }, { "double", category::Double },
+        { "void", category::Void }, { "__ptr", category::Pointer }, { "__arr", category::Array },
+        { "rc", category::Rc }, { "arc", category::Arc }
+    };
+    category_ = categories.at(typeName);
     //if (builtinTypeSet_.find(typeName) == builtinTypeSet_.end())
     //    throw std::logic_error(typeName+ " is not builtin type.");
 }
@@ -106,9 +121,15 @@ Parse::Type* Parse::FunctionType::classType() const {
     return classType_;
 }
 
+bool Parse::FunctionType::isExternal() const {
+    return isExternal_;
+}
+
 Parse::CompoundType::CompoundType(const std::string& typeName, std::vector<std::pair<Type*, std::string>> memberList,
                                   std::vector<Type*> typelist): Type(typeName, typelist),
-                                                                memberList_(std::move(memberList)) {
+                                                                memberList_(std::move(memberList)),
+                                                                moveConstructor_(nullptr), destructor_(nullptr),
+                                                                imported_(false) {
 }
 
 std::string Parse::CompoundType::mangledName() {
@@ -145,6 +166,10 @@ const std::vector<Parse::FunctionType*>* Parse::CompoundType::getConstructors()
     return &constructors_;
 }
 
+Parse::FunctionType* Parse::CompoundType::getMoveConstructor() const {
+    return moveConstructor_;
+}
+
 Parse::FunctionType* Parse::CompoundType::getDestructor() const {
     return destructor_;
 }
@@ -163,6 +188,10 @@ const std::vector<Parse::FunctionType*>* Parse::CompoundType::getFunction(const
     return &(it->second);
 }
 
+const std::map<std::string, std::vector<Parse::FunctionType*>>& Parse::CompoundType::getMemberFunctions() const {
+    return memberFunctions_;
+}
+
 void Parse::CompoundType::addFunction(FunctionType* func) {
     memberFunctions_[func->getTypename()].push_back(func);
 }
@@ -171,6 +200,18 @@ void Parse::CompoundType::addConstructor(FunctionType* func) {
     constructors_.push_back(func);
 }
 
+void Parse::CompoundType::setMoveConstructor(FunctionType* func) {
+    moveConstructor_ = func;
+}
+
 void Parse::CompoundType::setDestructor(FunctionType* func) {
     destructor_ = func;
 }
+
+bool Parse::CompoundType::isImported() const {
+    return imported_;
+}
+
+void Parse::CompoundType::setImported() {
+    imported_ = true;
+}
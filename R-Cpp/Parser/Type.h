@@ -30,24 +30,46 @@ namespace Parse
         const std::vector<Type*>& getTemplateArgs() const;
         std::string mangledNameNamespacePrefix() const;
 
+        // set by CG::CodeGenerator::getType() the first time the type is
+        // lowered, types are unique per ASTContext so this is the only copy
+        llvm::Type* llvmType() const;
+        void setLLVMType(llvm::Type* type);
+
     protected:
         std::string name_;
         std::vector<Type*> typelist_;
         NamespaceHelper* namespaceHierarchy_;
+        llvm::Type* llvmType_;
     };
 
     class BuiltinType : public Type
     {
     public:
+        enum class category
+        {
+            i32, i64, u32, u64, Bool, Float, Double, Void, Pointer, Array, Rc, Arc
+        };
+
         BuiltinType(const std::string& typeName, std::vector<Type*> typelist = {});
 
         std::string mangledName() override;
+        category getCategory() const { return category_; }
+        // rc<T> or arc<T>
+        bool isRefCounted() const { return category_ == category::Rc || category_ == category::Arc; }
         static const std::set<std::string>& builtinTypeSet();
 
     private:
         static const std::set<std::string> builtinTypeSet_;
+        category category_;
     };
 
+    // t if it is an rc<T> or arc<T>, nullptr otherwise
+    inline BuiltinType* asRefCounted(Type* t)
+    {
+        auto b = dynamic_cast<BuiltinType*>(t);
+        return b && b->isRefCounted() ? b : nullptr;
+    }
+
     class FunctionType : public Type
     {
     public:
@@ -58,6 +80,7 @@ namespace Parse
         const std::vector<std::pair<Type*, std::string>>& args();
         Type* returnType();
         Type* classType() const;
+        bool isExternal() const;
 
     private:
         std::vector<std::pair<Type*,std::string>> argTypeList_;
@@ -76,19 +99,30 @@ namespace Parse
         Type* getMemberType(const std::string& name);
         int getMemberIndex(const std::string& name);
         const std::vector<FunctionType*>* getConstructors() const;
+        // the constructor declared with move, nullptr if there is none: it
+        // takes over what the object its __ptr points to holds
+        FunctionType* getMoveConstructor() const;
         FunctionType* getDestructor() const;
         const std::vector<std::pair<Type*, std::string>>& getMemberVariables() const;
         bool hasFunction(const std::string& funcName);
         const std::vector<FunctionType*>* getFunction(const std::string& funcName);
+        const std::map<std::string, std::vector<FunctionType*>>& getMemberFunctions() const;
         void addFunction(FunctionType* func);
         void addConstructor(FunctionType* func);
+        // one of the constructors
+        void setMoveConstructor(FunctionType* func);
         void setDestructor(FunctionType* func);
+        // declared by `import`, its code is in the imported module's object
+        bool isImported() const;
+        void setImported();
 
     private:
         std::vector<std::pair<Type*, std::string>> memberList_;
         std::map<std::string, std::vector<FunctionType*>> memberFunctions_;
         std::vector<FunctionType*> constructors_;
+        FunctionType* moveConstructor_;
         FunctionType* destructor_;
+        bool imported_;
     };
 
     class LiteralType: public Type
@@ -104,6 +138,7 @@ namespace Parse
         {
             return std::to_string(val_);
         }
+        std::int64_t value() const { return val_; }
     private:
         category type_;
         std::int64_t val_;
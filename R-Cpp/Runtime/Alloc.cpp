@@ -0,0 +1,155 @@
+// Kept free of the C++ library, programs are linked by cc.
+#include "Alloc.h"
+#include <atomic>
+#include <cstdlib>
+#include <pthread.h>
+
+using namespace Runtime;
+
+namespace
+{
+    constexpr int32_t granularity = 16;
+    constexpr int classes = maxPooledSize / granularity;
+    // objects a thread takes from or gives back to the depot at once
+    constexpr uint32_t batch = 64;
+    // a thread's cache of a class never holds more than this
+    constexpr uint32_t cacheLimit = 4 * batch;
+    constexpr size_t chunkSize = 64 * 1024;
+
+    struct FreeObject
+    {
+        FreeObject* next;
+    };
+
+    struct FreeList
+    {
+        FreeObject* head;
+        uint32_t count;
+    };
+
+    // zero initialized, so there is nothing to construct per thread
+    struct Cache
+    {
+        FreeList lists[classes];
+        bool registered;
+    };
+
+    struct Depot
+    {
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+        FreeList list{ nullptr, 0 };
+        // the rest of the last chunk, carved on demand
+        char* chunk = nullptr;
+        char* chunkEnd = nullptr;
+    };
+
+    class DepotLock
+    {
+    public:
+        explicit DepotLock(Depot& depot): depot_(depot)
+        {
+            while (depot_.lock.test_and_set(std::memory_order_acquire)) {}
+        }
+        ~DepotLock() { depot_.lock.clear(std::memory_order_release); }
+
+    private:
+        Depot& depot_;
+    };
+}
+
+static thread_local Cache cache;
+static Depot depots[classes];
+static pthread_key_t exitKey;
+static pthread_once_t exitKeyOnce = PTHREAD_ONCE_INIT;
+
+static int sizeClass(int32_t size)
+{
+    return size <= 0 ? 0 : (size - 1) / granularity;
+}
+
+// moves up to n objects from the front of from to to
+static void moveObjects(FreeList& from, FreeList& to, uint32_t n)
+{
+    while (n-- && from.head) {
+        auto object = from.head;
+        from.head = object->next;
+        --from.count;
+        object->next = to.head;
+        to.head = object;
+        ++to.count;
+    }
+}
+
+// gives everything the thread has cached back when it exits
+static void flushCache(void* data)
+{
+    auto& threadCache = *static_cast<Cache*>(data);
+    for (int c = 0; c < classes; ++c) {
+        auto& list = threadCache.lists[c];
+        DepotLock lock(depots[c]);
+        moveObjects(list, depots[c].list, list.count);
+    }
+}
+
+static void createExitKey()
+{
+    pthread_key_create(&exitKey, flushCache);
+}
+
+// a batch for the thread's cache, false if malloc failed
+static bool refill(int c)
+{
+    if (!cache.registered) {
+        pthread_once(&exitKeyOnce, createExitKey);
+        pthread_setspecific(exitKey, &cache);
+        cache.registered = true;
+    }
+    auto& list = cache.lists[c];
+    auto& depot = depots[c];
+    size_t objectSize = static_cast<size_t>(c + 1) * granularity;
+    DepotLock lock(depot);
+    moveObjects(depot.list, list, batch);
+    while (list.count < batch) {
+        if (depot.chunk == depot.chunkEnd) {
+            auto chunk = static_cast<char*>(std::malloc(chunkSize));
+            if (!chunk) return list.head != nullptr;
+            depot.chunk = chunk;
+            depot.chunkEnd = chunk + chunkSize / objectSize * objectSize;
+        }
+        auto object = reinterpret_cast<FreeObject*>(depot.chunk);
+        depot.chunk += objectSize;
+        object->next = list.head;
+        list.head = object;
+        ++list.count;
+    }
+    return true;
+}
+
+void* __rcpp_alloc(int32_t size)
+{
+    if (size > maxPooledSize) return std::malloc(size);
+    auto c = sizeClass(size);
+    auto& list = cache.lists[c];
+    if (!list.head && !refill(c)) return nullptr;
+    auto object = list.head;
+    list.head = object->next;
+    --list.count;
+    return object;
+}
+
+void __rcpp_free(void* p, int32_t size)
+{
+    if (!p) return;
+    if (size > maxPooledSize) {
+        std::free(p);
+        return;
+    }
+    auto c = sizeClass(size);
+    auto& list = cache.lists[c];
+    auto object = static_cast<FreeObject*>(p);
+    object->next = list.head;
+    list.head = object;
+    if (++list.count <= cacheLimit) return;
+    DepotLock lock(depots[c]);
+    moveObjects(list, depots[c].list, batch);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+
+// The allocator behind Class::new() and Class::delete(), in the runtime
+// library the driver links into every program. Objects of up to
+// maxPooledSize bytes come from free lists per 16-byte size class: each
+// thread has a cache of its own and takes or returns batches of objects
+// from a shared depot, which carves new ones out of chunks from malloc.
+// Pooled memory is reused but never given back to the system. Bigger
+// objects go straight to malloc and free. delete has to pass the size new
+// was called with.
+extern "C" {
+void* __rcpp_alloc(int32_t size);
+void __rcpp_free(void* p, int32_t size);
+}
+
+namespace Runtime {
+    constexpr int32_t maxPooledSize = 256;
+}
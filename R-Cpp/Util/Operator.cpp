@@ -219,18 +219,28 @@ llvm::Value* builtinTypeOperator_i32(llvm::Value* LHS, llvm::Value* RHS, Operato
     }
 }
 
-llvm::Value* builtinTypeOperate(llvm::Value* LHS, const std::string& ltype,
-    llvm::Value* RHS, const std::string& rtype, OperatorType op
+static bool isFloatCategory(Parse::BuiltinType::category c)
+{
+    return c == Parse::BuiltinType::category::Float || c == Parse::BuiltinType::category::Double;
+}
+
+llvm::Value* builtinTypeOperate(llvm::Value* LHS, Parse::Type* ltype,
+    llvm::Value* RHS, Parse::Type* rtype, OperatorType op
     , CG::CodeGenerator& cg) {
-    if (ltype == "i32") {
-        if (rtype == "i32") return builtinTypeOperator_i32(LHS, RHS, op, cg);
-    }
-    else if(ltype=="float"||ltype=="double")
-    {
-        if (rtype == "float" || rtype == "double") return builtinTypeOperator_float(LHS, RHS, op, cg);
+    auto l = dynamic_cast<Parse::BuiltinType*>(ltype);
+    auto r = dynamic_cast<Parse::BuiltinType*>(rtype);
+    if (l && r) {
+        if (l->getCategory() == Parse::BuiltinType::category::i32) {
+            if (r->getCategory() == Parse::BuiltinType::category::i32)
+                return builtinTypeOperator_i32(LHS, RHS, op, cg);
+        }
+        else if (isFloatCategory(l->getCategory()))
+        {
+            if (isFloatCategory(r->getCategory())) return builtinTypeOperator_float(LHS, RHS, op, cg);
+        }
     }
-    std::cout << "No suitable operator between " << ltype
-        << " and " << rtype << "." << std::endl;
+    std::cout << "No suitable operator between " << (ltype ? ltype->mangledName() : "")
+        << " and " << (rtype ? rtype->mangledName() : "") << "." << std::endl;
     return nullptr;
 }
 
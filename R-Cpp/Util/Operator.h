@@ -6,6 +6,10 @@ namespace CG {
     class CodeGenerator;
 }
 
+namespace Parse {
+    class Type;
+}
+
 enum class OperatorType
 {
     ScopeResolution,  // ::
@@ -63,8 +67,8 @@ bool isCompoundAssignOperator(OperatorType t);
 bool isCompareOperator(OperatorType t);
 OperatorType compoundAssignToOperator(OperatorType t);
 
-llvm::Value* builtinTypeOperate(llvm::Value* LHS, const std::string& ltype,
-    llvm::Value* RHS, const std::string& rtype, OperatorType op
+llvm::Value* builtinTypeOperate(llvm::Value* LHS, Parse::Type* ltype,
+    llvm::Value* RHS, Parse::Type* rtype, OperatorType op
     , CG::CodeGenerator& cg);
 std::string builtinOperatorReturnType(const std::string& ltype, const std::string& rtype, OperatorType op);
 
@@ -0,0 +1,176 @@
+#include "TimeReport.h"
+#include <algorithm>
+#include <chrono>
+#include "llvm/Pass.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Process.h"
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// the functions timed at the moment on this thread, innermost first
+static thread_local TimeReport::Function* currentFunction = nullptr;
+
+// functions print() lists, printJSON() has all of them
+static const size_t slowestFunctions = 20;
+
+static uint64_t peakRSS()
+{
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    // in kilobytes
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static double seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TimeReport::TimeReport(bool timePasses): timedPasses_(timePasses)
+{
+    if (!timePasses) return;
+    PIC_ = std::make_unique<llvm::PassInstrumentationCallbacks>();
+    timePasses_ = std::make_unique<llvm::TimePassesHandler>(true);
+    timePasses_->registerCallbacks(*PIC_);
+    // the legacy pass manager that emits the object code
+    llvm::TimePassesIsEnabled = true;
+}
+
+TimeReport::~TimeReport()
+{
+    if (timedPasses_) llvm::TimePassesIsEnabled = false;
+}
+
+TimeReport::Phase::Phase(TimeReport* report, std::string name):
+    report_(report), name_(std::move(name)), startMalloc_(0)
+{
+    if (!report_) return;
+    // TimeRecord only tracks memory with LLVM's -track-memory
+    startMalloc_ = llvm::sys::Process::GetMallocUsage();
+    start_ = llvm::TimeRecord::getCurrentTime(true);
+}
+
+TimeReport::Phase::~Phase()
+{
+    if (!report_) return;
+    auto time = llvm::TimeRecord::getCurrentTime(false);
+    time -= start_;
+    auto mallocd = static_cast<int64_t>(llvm::sys::Process::GetMallocUsage()) - static_cast<int64_t>(startMalloc_);
+    PhaseTime phase{ std::move(name_), time.getWallTime(), time.getUserTime(), time.getSystemTime(), mallocd, peakRSS() };
+    std::lock_guard<std::mutex> lock(report_->mutex_);
+    report_->phases_.push_back(std::move(phase));
+}
+
+TimeReport::Function::Function(TimeReport* report, llvm::StringRef name):
+    report_(report), start_(0), outer_(nullptr)
+{
+    if (!report_) return;
+    name_ = name.str();
+    outer_ = currentFunction;
+    currentFunction = this;
+    start_ = seconds();
+}
+
+TimeReport::Function::~Function()
+{
+    if (!report_) return;
+    auto time = seconds() - start_;
+    currentFunction = outer_;
+    if (outer_) outer_->nested_ += time;
+    std::lock_guard<std::mutex> lock(report_->mutex_);
+    report_->functions_.emplace_back(std::move(name_), time - nested_);
+}
+
+void TimeReport::counter(std::string name, uint64_t value)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters_.emplace_back(std::move(name), value);
+}
+
+llvm::PassInstrumentationCallbacks* TimeReport::passInstrumentation()
+{
+    return PIC_.get();
+}
+
+void TimeReport::sortFunctions()
+{
+    std::stable_sort(functions_.begin(), functions_.end(),
+                     [](const std::pair<std::string, double>& a, const std::pair<std::string, double>& b) {
+                         return a.second > b.second;
+                     });
+}
+
+static double mebibytes(double bytes)
+{
+    return bytes / (1024 * 1024);
+}
+
+void TimeReport::print(llvm::raw_ostream& os)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    os << "===----- Phases -----===\n";
+    os << "      Wall      User    System  Malloc'd (MiB)  Peak RSS (MiB)  Phase\n";
+    for (auto& p : phases_) {
+        os << llvm::format("%10.4f%10.4f%10.4f%16.2f%16.2f  ", p.wall, p.user, p.system,
+                           mebibytes(static_cast<double>(p.mallocd)), mebibytes(static_cast<double>(p.peakRSS)))
+           << p.name << "\n";
+    }
+    if (!counters_.empty()) {
+        os << "===----- Counters -----===\n";
+        for (auto& c : counters_) os << llvm::format("%16llu  ", static_cast<unsigned long long>(c.second)) << c.first << "\n";
+    }
+    if (!functions_.empty()) {
+        sortFunctions();
+        double total = 0;
+        for (auto& f : functions_) total += f.second;
+        os << "===----- Functions, IR emission and cleanup passes -----===\n";
+        os << llvm::format("%10.4f  total of %zu functions\n", total, functions_.size());
+        for (size_t i = 0; i < std::min(functions_.size(), slowestFunctions); ++i)
+            os << llvm::format("%10.4f  ", functions_[i].second) << functions_[i].first << "\n";
+    }
+    if (timedPasses_) llvm::TimerGroup::printAll(os);
+    os.flush();
+}
+
+void TimeReport::printJSON(llvm::raw_ostream& os)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // strings go through json::Value to be escaped
+    os << "{\n  \"phases\": [";
+    const char* delim = "\n";
+    for (auto& p : phases_) {
+        os << delim << "    { \"name\": " << llvm::json::Value(p.name)
+           << llvm::format(", \"wall\": %.6f, \"user\": %.6f, \"system\": %.6f", p.wall, p.user, p.system)
+           << ", \"malloc\": " << p.mallocd << ", \"peak_rss\": " << p.peakRSS << " }";
+        delim = ",\n";
+    }
+    os << "\n  ],\n  \"counters\": {";
+    delim = "\n";
+    for (auto& c : counters_) {
+        os << delim << "    " << llvm::json::Value(c.first) << ": " << c.second;
+        delim = ",\n";
+    }
+    os << "\n  },\n  \"functions\": [";
+    sortFunctions();
+    delim = "\n";
+    for (auto& f : functions_) {
+        os << delim << "    { \"name\": " << llvm::json::Value(f.first)
+           << llvm::format(", \"wall\": %.6f }", f.second);
+        delim = ",\n";
+    }
+    // "time.<group>.<pass>.wall" and so on, as LLVM prints them
+    os << "\n  ],\n  \"passes\": {\n";
+    if (timedPasses_) llvm::TimerGroup::printAllJSONValues(os, "");
+    os << "\n  }\n}\n";
+    os.flush();
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+// -ftime-report: wall and CPU time, malloc'd bytes and peak RSS of each
+// phase of the compiler, the time the code generator spends on each
+// function, counters such as the AST arena size and, if timePasses, the
+// time of each LLVM pass. CPU times are those of the whole process, so
+// phases that run at once on different threads overlap. Phases and
+// functions may be recorded from any thread, pass timing only works while
+// a single thread runs passes.
+class TimeReport
+{
+public:
+    explicit TimeReport(bool timePasses);
+    ~TimeReport();
+
+    // Times the scope as the phase name. Does nothing if report is null.
+    class Phase
+    {
+    public:
+        Phase(TimeReport* report, std::string name);
+        ~Phase();
+
+    private:
+        TimeReport* report_;
+        std::string name_;
+        llvm::TimeRecord start_;
+        size_t startMalloc_;
+    };
+
+    // Times the scope as the cost of emitting and cleaning up function
+    // name, without the functions emitted in the middle of it (class
+    // template members). Does nothing if report is null.
+    class Function
+    {
+    public:
+        Function(TimeReport* report, llvm::StringRef name);
+        ~Function();
+
+    private:
+        TimeReport* report_;
+        std::string name_;
+        double start_;
+        double nested_ = 0;
+        Function* outer_;
+    };
+
+    void counter(std::string name, uint64_t value);
+    // the callbacks pass builders register with, null unless passes are timed
+    llvm::PassInstrumentationCallbacks* passInstrumentation();
+
+    // A table of the phases, the counters, the slowest functions and the
+    // pass timers, resets the pass timers.
+    void print(llvm::raw_ostream& os);
+    // The same as one JSON object, with all functions sorted by cost.
+    // Goes before print(), which resets the pass timers.
+    void printJSON(llvm::raw_ostream& os);
+
+private:
+    struct PhaseTime
+    {
+        std::string name;
+        double wall, user, system;
+        int64_t mallocd;
+        uint64_t peakRSS;
+    };
+
+    void sortFunctions();
+
+    std::mutex mutex_;
+    std::vector<PhaseTime> phases_;
+    std::vector<std::pair<std::string, double>> functions_;
+    std::vector<std::pair<std::string, uint64_t>> counters_;
+    std::unique_ptr<llvm::PassInstrumentationCallbacks> PIC_;
+    std::unique_ptr<llvm::TimePassesHandler> timePasses_;
+    bool timedPasses_;
+};
@@ -1,24 +1,33 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 
-enum class TokenType
+// All keywords of the language. Both the TokenType entries and the
+// keyword lookup table below are generated from this list.
+#define RCPP_KEYWORDS(X)        \
+    X(Function, "fn")           \
+    X(Import, "import")         \
+    X(Trait, "trait")           \
+    X(Export, "export")         \
+    X(Namespace, "namespace")   \
+    X(Class, "class")           \
+    X(Return, "return")         \
+    X(If, "if")                 \
+    X(Else, "else")             \
+    X(For, "for")               \
+    X(External, "external")     \
+    X(Internal, "internal")     \
+    X(Using, "using")
+
+enum class TokenType : signed char
 {
-    Function,
-    Import,
-    Trait,
-    Export,
-    Namespace,
-    Class,
-    Return,
-    If,
-    Else,
-    For,
+#define RCPP_KEYWORD_TOKEN(name, spelling) name,
+    RCPP_KEYWORDS(RCPP_KEYWORD_TOKEN)
+#undef RCPP_KEYWORD_TOKEN
     Identifier,
     Integer,
     Float,
-    External,
-    Internal,
-    Using,
     lParenthesis = '(',
     rParenthesis = ')',
     lSquare = '[',
@@ -59,19 +68,20 @@ struct TokenHash
     }
 };
 
+// Packed token: the content lives in the Lexer's StringTable and the
+// line/column are recovered from the offset when needed.
 struct Token
 {
-    Token(TokenType t, const std::string& s,int lineNum,int charNum) :type(t), content(s), lineNum(lineNum),charNum(charNum) {}
-    Token(TokenType t, int lineNum, int charNum) :type(t), content(), lineNum(lineNum), charNum(charNum) {}
-    Token(const Token& other)
-    { 
-        type = other.type;
-        content = other.content;
-        lineNum = other.lineNum;
-        charNum = other.charNum;
-    }
+    Token(TokenType t, std::uint32_t offset, std::uint32_t handle = 0)
+        :type(t), offset(offset), handle(handle) {}
+
     TokenType type;
-    std::string content;
+    std::uint32_t offset;   // of the first character in the source
+    std::uint32_t handle;   // of the content in the StringTable, 0 if none
+};
+
+struct SourceLocation
+{
     int lineNum, charNum;
 };
 
@@ -139,4 +149,78 @@ constexpr TokenType charToToken(char c)
     default:
         return TokenType::Unknown;
     }
-}
\ No newline at end of file
+}
+
+// Perfect hash over RCPP_KEYWORDS: the seed is searched at compile time
+// so that every keyword gets its own slot, and a lookup is one hash and at
+// most one string comparison.
+namespace keyword
+{
+struct Entry
+{
+    std::string_view spelling;
+    TokenType type;
+};
+
+constexpr Entry list[] = {
+#define RCPP_KEYWORD_ENTRY(name, spelling) { spelling, TokenType::name },
+    RCPP_KEYWORDS(RCPP_KEYWORD_ENTRY)
+#undef RCPP_KEYWORD_ENTRY
+};
+
+constexpr size_t tableSize = 64;
+
+constexpr size_t hash(std::string_view s, unsigned seed)
+{
+    return (static_cast<unsigned char>(s.front()) * seed + static_cast<unsigned char>(s.back()) + s.size()) % tableSize;
+}
+
+constexpr unsigned findSeed()
+{
+    for (unsigned seed = 1; seed < 4096; ++seed) {
+        bool used[tableSize] = {};
+        bool collision = false;
+        for (auto& k : list) {
+            auto h = hash(k.spelling, seed);
+            collision = collision || used[h];
+            used[h] = true;
+        }
+        if (!collision) return seed;
+    }
+    return 0;
+}
+
+constexpr size_t findMaxLength()
+{
+    size_t len = 0;
+    for (auto& k : list)
+        if (k.spelling.size() > len) len = k.spelling.size();
+    return len;
+}
+
+struct Table
+{
+    Entry slot[tableSize];
+};
+
+constexpr Table buildTable(unsigned seed)
+{
+    Table table{};
+    for (auto& k : list)
+        table.slot[hash(k.spelling, seed)] = k;
+    return table;
+}
+
+constexpr unsigned seed = findSeed();
+static_assert(seed != 0, "No perfect hash for RCPP_KEYWORDS, enlarge keyword::tableSize.");
+constexpr size_t maxLength = findMaxLength();
+constexpr Table table = buildTable(seed);
+}
+
+constexpr TokenType keywordToToken(std::string_view s)
+{
+    if (s.empty() || s.size() > keyword::maxLength)
+        return TokenType::Identifier;
+    auto& k = keyword::table.slot[keyword::hash(s, keyword::seed)];
+    return k.spelling == s ? k.type : TokenType::Identifier;
+}
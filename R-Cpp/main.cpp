@@ -1,22 +1,123 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include "llvm/Support/Path.h"
 #include "Parser/Parser.h"
 #include "CodeGenerator/CodeGenerator.h"
+#include "Driver.h"
 
 using namespace std;
 
 int main(int argc,char **argv)
 {
-    if(argc==1) {
+    // R-Cpp [options] source...: compiles the sources and links them with cc
+    // -c: only compile, each source to <stem>.o
+    // -o <file>: the executable, or the object with -c and a single source
+    // -j N: compile N sources at once
+    // --dump-ast, --dump-ir: print the parse tree or the IR being compiled
+    // --emit-llvm, --emit-asm: also write <stem>.ll or <stem>.s
+    // -ftime-report: print where the time went to stderr
+    // -ftime-report-json=FILE: write it to FILE as JSON
+    // --direct-lowering: emit IR straight from the Parse:: tree
+    // --jit[=entry]: run entry (default main) of a single source in memory instead
+    // --lazy-jit[=entry]: the same, compiling functions on first call and hot ones at -O
+    // --codegen-partitions=N: optimize and compile N parts of each module in parallel
+    // --sema-threads=N: check function bodies on N threads
+    // --cache-dir=DIR: reuse the object code of unchanged functions from DIR
+    // -O0 (default), -O1, -O2, -O3, -Os: optimization level
+    // -mcpu=<cpu>|native (-march= is the same), -mattr=<+feature,-feature>,
+    // -ffast-math, -fPIC/-fno-pic, -mcmodel=small|kernel|medium|large
+    DriverOptions options;
+    const char* jitEntry = nullptr;
+    bool tiered = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-c") options.compileOnly = true;
+        else if (arg == "-o" || arg == "-j") {
+            if (i + 1 == argc) {
+                cout << "Missing argument to " << arg << endl;
+                return -1;
+            }
+            if (arg == "-o") options.output = argv[++i];
+            else options.jobs = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg.rfind("-o", 0) == 0) options.output = arg.substr(2);
+        else if (arg.rfind("-j", 0) == 0) options.jobs = std::max(1, std::atoi(argv[i] + 2));
+        else if (arg == "--dump-ast") options.dumpAST = true;
+        else if (arg == "--dump-ir") options.dumpIR = true;
+        else if (arg == "--emit-llvm") options.emitLLVM = true;
+        else if (arg == "--emit-asm") options.emitAsm = true;
+        else if (arg == "-ftime-report") options.timeReport = true;
+        else if (arg.rfind("-ftime-report-json=", 0) == 0) options.timeReportJSON = arg.substr(19);
+        else if (arg == "--direct-lowering") options.directLowering = true;
+        else if (arg == "--jit") jitEntry = "main";
+        else if (arg.rfind("--jit=", 0) == 0) jitEntry = argv[i] + 6;
+        else if (arg == "--lazy-jit") {
+            jitEntry = "main";
+            tiered = true;
+        }
+        else if (arg.rfind("--lazy-jit=", 0) == 0) {
+            jitEntry = argv[i] + 11;
+            tiered = true;
+        }
+        else if (arg.rfind("--codegen-partitions=", 0) == 0) options.partitions = std::max(1, std::atoi(argv[i] + 21));
+        else if (arg.rfind("--cache-dir=", 0) == 0) options.cacheDir = arg.substr(12);
+        else if (arg.rfind("--sema-threads=", 0) == 0) options.semaThreads = std::max(1, std::atoi(argv[i] + 15));
+        else if (arg == "-O0") options.optLevel = CG::OptLevel::O0;
+        else if (arg == "-O1") options.optLevel = CG::OptLevel::O1;
+        else if (arg == "-O2") options.optLevel = CG::OptLevel::O2;
+        else if (arg == "-O3") options.optLevel = CG::OptLevel::O3;
+        else if (arg == "-Os") options.optLevel = CG::OptLevel::Os;
+        else if (arg.rfind("-mcpu=", 0) == 0) options.target.cpu = arg.substr(6);
+        else if (arg.rfind("-march=", 0) == 0) options.target.cpu = arg.substr(7);
+        else if (arg.rfind("-mattr=", 0) == 0) options.target.features = arg.substr(7);
+        else if (arg == "-ffast-math") options.target.fastMath = true;
+        else if (arg == "-fPIC" || arg == "-fpic") options.target.relocModel = llvm::Reloc::PIC_;
+        else if (arg == "-fno-pic") options.target.relocModel = llvm::Reloc::Static;
+        else if (arg.rfind("-mcmodel=", 0) == 0) {
+            auto model = arg.substr(9);
+            if (model == "small") options.target.codeModel = llvm::CodeModel::Small;
+            else if (model == "kernel") options.target.codeModel = llvm::CodeModel::Kernel;
+            else if (model == "medium") options.target.codeModel = llvm::CodeModel::Medium;
+            else if (model == "large") options.target.codeModel = llvm::CodeModel::Large;
+            else {
+                cout << "Unknown code model: " << model << endl;
+                return -1;
+            }
+        }
+        else options.sources.push_back(arg);
+    }
+    if (options.sources.empty()) {
         cout << "Please input the source file." << endl;
         return -1;
     }
-    Parse::Parser l(argv[1]); 
-//    Parse::Parser l("/home/zinglix/example.txt");
+    if (!jitEntry) return compileSources(std::move(options));
+
+    if (options.sources.size() != 1) {
+        cout << "--jit runs a single source file." << endl;
+        return -1;
+    }
+    // with --lazy-jit the report counts the functions that tiered up
+    std::unique_ptr<TimeReport> report;
+    if (options.timeReport || !options.timeReportJSON.empty()) report = std::make_unique<TimeReport>(true);
+    auto module = llvm::sys::path::stem(options.sources.front()).str();
+    Parse::Parser l(options.sources.front());
     l.MainLoop();
-    l.print();
+    if (options.dumpAST) l.print(llvm::outs());
     //l.dumpToXML();
-    l.convertToLLVM();
     CG::CodeGenerator cg(l);
-    cg.generate();
-    return 0;
+    if (options.dumpIR) cg.setIRStream(&llvm::outs());
+    cg.setOptimizationLevel(options.optLevel);
+    cg.setTargetConfig(options.target);
+    if (options.directLowering) cg.enableDirectLowering();
+    if (tiered) cg.enableTieredJIT();
+    cg.setTimeReport(report.get(), module);
+    {
+        TimeReport::Phase phase(report.get(), module + ": check and lower");
+        l.convertToLLVM(options.semaThreads);
+    }
+    int result = cg.run(jitEntry);
+    if (report && !printTimeReport(*report, options)) return -1;
+    return result;
 }
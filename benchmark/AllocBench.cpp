@@ -0,0 +1,42 @@
+// Runtime of the benchmark/alloc.rpp kernels, linked against the output.o
+// the compiler writes and either allocator, see alloc_bench.sh:
+//
+//   AllocBench [repeat factor] [threads]
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "BenchUtil.h"
+
+extern "C" {
+int _R5churnI3i32(int);
+int _R5batchI3i32(int);
+int _R8batchBigI3i32(int);
+}
+
+// keeps the results alive
+static volatile int sink;
+
+// every thread calls kernel(iterations) at once
+template <typename F>
+static void run(const char* name, int threads, int iterations, int objects, F kernel)
+{
+    auto time = bestOf(5, [&] {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+            workers.emplace_back([&] { sink = kernel(iterations); });
+        for (auto& w : workers) w.join();
+    });
+    std::printf("  %-12s %2d threads %8.2f ns/object\n", name, threads,
+                time / (static_cast<double>(iterations) * objects) * 1e9);
+}
+
+int main(int argc, char** argv)
+{
+    int n = argc > 1 ? std::atoi(argv[1]) : 1;
+    int threads = argc > 2 ? std::atoi(argv[2]) : 1;
+    run("churn", threads, 2000000 * n, 1, _R5churnI3i32);
+    run("batch", threads, 30000 * n, 64, _R5batchI3i32);
+    run("batchBig", threads, 30000 * n, 64, _R8batchBigI3i32);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+// Helpers shared by the benchmarks.
+#include <chrono>
+#include <string>
+
+// The generated source mimics test/src.rpp: classes, functions with loops,
+// arithmetic and comments, repeated with fresh names until the requested
+// size is reached.
+inline std::string generateSource(size_t bytes)
+{
+    std::string src;
+    for (size_t i = 0; src.size() < bytes; ++i) {
+        auto n = std::to_string(i);
+        src += "// Class " + n + "\n"
+            "class c" + n + "\n{\n"
+            "\tc" + n + "(i32 x, i32 y)\n\t{\n\t\ta = x;\n\t\tb = y;\n\t}\n\n"
+            "\tfn add() -> i32\n\t{\n\t\treturn a + b;\n\t}\n\n"
+            "\t~c" + n + "()\n\t{\n\n\t}\n\n"
+            "\ti32 a;\n\ti32 b;\n}\n\n"
+            "fn sum" + n + "(i32 a, double scale) -> i32\n{\n"
+            "\ti32 count = 0;\n"
+            "\tfor(i32 i = 0; a > i; i = i + 1)\n\t{\n"
+            "\t\tcount = count + i * 3 - 1024; // accumulate\n\t}\n"
+            "\tc" + n + " tmp = c" + n + "(count, a);\n"
+            "\treturn tmp.add();\n}\n\n";
+    }
+    return src;
+}
+
+template <typename F>
+double bestOf(int runs, F&& f)
+{
+    double best = 1e300;
+    for (int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+        if (d.count() < best) best = d.count();
+    }
+    return best;
+}
@@ -0,0 +1,158 @@
+// Lexer benchmark on large synthetic .rpp inputs.
+//
+//   LexerBench [size in MB] [scratch file]
+//
+// The generated source mimics test/src.rpp: classes, functions with loops,
+// arithmetic and comments, repeated with fresh names until the requested
+// size is reached. A second benchmark times keyword lookup alone on the
+// identifiers of that input.
+//
+// Before timing anything, on-demand tokenizing is checked against upfront
+// tokenizing with parser-like backtracking. The scan kernels are checked
+// against each other by test/lexer.cpp.
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "BenchUtil.h"
+#include "Lexer/Lexer.h"
+
+static void benchLexer(const std::string& file, size_t bytes)
+{
+    std::vector<size_t> tokens;
+    auto report = [&](const std::string& name, Lexer::Mode mode, const ScanKernel& kernel) {
+        size_t count = 0;
+        auto t = bestOf(5, [&] {
+            Lexer lexer(file, mode, kernel);
+            count = lexer.tokenCount();
+        });
+        tokens.push_back(count);
+        std::printf("%-12s %10zu tokens %9.2f ms %9.2f MB/s\n", name.c_str(), count, t * 1e3,
+                    bytes / t / (1 << 20));
+    };
+    report("fstream", Lexer::Mode::Stream, ScanKernel::scalar());
+    for (auto kernel : ScanKernel::available())
+        report(std::string("mmap ") + kernel->name, Lexer::Mode::Mapped, *kernel);
+    std::printf("token storage: %zu bytes/token, %.2f MB\n", sizeof(Token),
+                tokens.back() * sizeof(Token) / double(1 << 20));
+
+    // consuming the tokens, which is what the parser does
+    const char* names[2] = { "upfront", "on demand" };
+    Lexer::Tokenize tokenize[2] = { Lexer::Tokenize::Upfront, Lexer::Tokenize::OnDemand };
+    for (int m = 0; m < 2; ++m) {
+        size_t count = 0, capacity = 0;
+        auto t = bestOf(5, [&] {
+            Lexer lexer(file, Lexer::Mode::Mapped, ScanKernel::scalar(), tokenize[m]);
+            count = 0;
+            while (lexer.nextToken().type != TokenType::Eof)
+                ++count;
+            ++count;
+            capacity = lexer.tokenCapacity();
+        });
+        tokens.push_back(count);
+        std::printf("%-12s %10zu tokens %9.2f ms %9.2f MB/s %9.2f KB token buffer\n", names[m], count, t * 1e3,
+                    bytes / t / (1 << 20), capacity * sizeof(Token) / 1024.0);
+    }
+    for (auto n : tokens) {
+        if (n != tokens.front()) {
+            std::printf("token count mismatch between lexers!\n");
+            break;
+        }
+    }
+}
+
+// the keyword lookup used before the perfect hash, for comparison
+static TokenType linearKeywordToToken(std::string_view s)
+{
+#define RCPP_KEYWORD_COMPARE(name, spelling) if (s == spelling) return TokenType::name;
+    RCPP_KEYWORDS(RCPP_KEYWORD_COMPARE)
+#undef RCPP_KEYWORD_COMPARE
+    return TokenType::Identifier;
+}
+
+static void benchKeywords(const std::string& src)
+{
+    std::vector<std::string_view> words;
+    for (size_t i = 0; i < src.size();) {
+        if (isalpha(static_cast<unsigned char>(src[i])) || src[i] == '_') {
+            auto start = i;
+            while (i < src.size() && (isalnum(static_cast<unsigned char>(src[i])) || src[i] == '_'))
+                ++i;
+            words.emplace_back(src.data() + start, i - start);
+        } else {
+            ++i;
+        }
+    }
+    size_t keywords[2] = { 0, 0 };
+    const char* names[2] = { "linear", "perfect" };
+    for (int m = 0; m < 2; ++m) {
+        auto t = bestOf(5, [&] {
+            size_t n = 0;
+            for (auto w : words)
+                n += (m == 0 ? linearKeywordToToken(w) : keywordToToken(w)) != TokenType::Identifier;
+            keywords[m] = n;
+        });
+        std::printf("%-10s %10zu words %10zu keywords %9.2f ms %9.2f ns/word\n", names[m], words.size(),
+                    keywords[m], t * 1e3, t * 1e9 / words.size());
+    }
+    if (keywords[0] != keywords[1])
+        std::printf("keyword count mismatch between linear and perfect hash lookup!\n");
+}
+
+// walks an upfront and an on-demand lexer in lockstep, backtracking like
+// Parser::ParseIdentifierExpr does, and compares every token
+static bool checkOnDemand(const std::string& file)
+{
+    Lexer upfront(file, Lexer::Mode::Mapped, ScanKernel::scalar(), Lexer::Tokenize::Upfront);
+    Lexer onDemand(file, Lexer::Mode::Mapped, ScanKernel::scalar(), Lexer::Tokenize::OnDemand);
+    std::mt19937 rng(2020);
+    std::uniform_int_distribution<int> chance(0, 99), distance(1, 600);
+    auto same = [&](const Token& a, const Token& b) {
+        return a.type == b.type && a.offset == b.offset && upfront.content(a) == onDemand.content(b);
+    };
+    for (;;) {
+        if (!same(upfront.curToken(), onDemand.curToken()) || !same(upfront.viewNextToken(), onDemand.viewNextToken())) {
+            std::printf("on-demand lexer differs from upfront lexer at offset %u\n", upfront.curToken().offset);
+            return false;
+        }
+        if (upfront.curToken().type == TokenType::Eof)
+            break;
+        if (chance(rng) == 0) {
+            auto a = upfront.getIterator();
+            auto b = onDemand.getIterator();
+            for (int n = distance(rng); n > 0; --n) {
+                upfront.nextToken();
+                onDemand.nextToken();
+            }
+            upfront.setIterator(a);
+            onDemand.setIterator(b);
+        }
+        upfront.nextToken();
+        onDemand.nextToken();
+    }
+    std::printf("on-demand tokenizing: ok, %.2f KB token buffer\n", onDemand.tokenCapacity() * sizeof(Token) / 1024.0);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 16;
+    std::string file = argc > 2 ? argv[2] : "lexer_bench.rpp";
+    auto src = generateSource(megabytes << 20);
+    {
+        std::ofstream fs(file, std::ios::binary);
+        fs << src;
+    }
+    std::printf("input: %s, %.2f MB\n", file.c_str(), src.size() / double(1 << 20));
+    if (!checkOnDemand(file)) {
+        std::remove(file.c_str());
+        return 1;
+    }
+    benchLexer(file, src.size());
+    benchKeywords(src);
+    std::remove(file.c_str());
+    return 0;
+}
@@ -0,0 +1,16 @@
+// Runtime/Alloc.h on plain malloc and free, the baseline alloc_bench.sh
+// compares the pooled allocator against.
+#include <cstdint>
+#include <cstdlib>
+
+extern "C" {
+void* __rcpp_alloc(int32_t size)
+{
+    return std::malloc(size);
+}
+
+void __rcpp_free(void* p, int32_t)
+{
+    std::free(p);
+}
+}
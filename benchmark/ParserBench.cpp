@@ -0,0 +1,169 @@
+// Parser benchmark on large synthetic .rpp inputs.
+//
+//   ParserBench [size in MB] [scratch file] 2>/dev/null
+//
+// Times parsing the generated source into the Parse:: AST and tearing the
+// AST down again, and counts the heap allocations made on the way. Then
+// times lowering the AST to IR (convertToLLVM() and generateIR()) through
+// the ExprAST tree and directly, and checks both give the same module.
+// Last, times symbol table lookups with thousands of functions and types
+// declared and variables spread over deeply nested scopes. The parser and code generator report everything on stderr, so send that
+// elsewhere.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "BenchUtil.h"
+#include "CodeGenerator/CodeGenerator.h"
+#include "Parser/Parser.h"
+
+static size_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    if (auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// Lowers a fresh parse of file, returns the time taken and the module.
+static double lower(const std::string& file, bool direct, size_t& lowerAllocations, std::string& ir)
+{
+    Parse::Parser parser(file);
+    parser.MainLoop();
+    CG::CodeGenerator cg(parser);
+    if (direct) cg.enableDirectLowering();
+    auto before = allocations;
+    auto time = bestOf(1, [&] {
+        parser.convertToLLVM();
+        cg.generateIR();
+    });
+    lowerAllocations = allocations - before;
+    ir.clear();
+    llvm::raw_string_ostream os(ir);
+    cg.getModule().print(os, nullptr);
+    os.flush();
+    return time;
+}
+
+// Lookups as convertToLLVM() makes them: every variable, function and type
+// name is looked up once per round. Also times entering and leaving the
+// nested scopes.
+static void symbols()
+{
+    const int functions = 4096, types = 1024, depth = 64, perScope = 4, rounds = 100;
+    Parse::ASTContext context;
+    auto& st = context.symbolTable();
+    auto i32 = st.getType("i32");
+    std::vector<std::string> functionNames, typeNames, variableNames;
+    for (int i = 0; i < functions; ++i) {
+        functionNames.push_back("fn" + std::to_string(i));
+        st.addFunction(functionNames.back(), {}, i32);
+    }
+    for (int i = 0; i < types; ++i) {
+        typeNames.push_back("class" + std::to_string(i));
+        st.addType(typeNames.back(), {});
+    }
+    for (int d = 0; d < depth; ++d) {
+        st.createScope();
+        for (int k = 0; k < perScope; ++k) {
+            variableNames.push_back("v" + std::to_string(d) + "_" + std::to_string(k));
+            st.addVariable(i32, variableNames.back());
+        }
+    }
+    size_t found = 0;
+    auto variables = bestOf(3, [&] {
+        for (int r = 0; r < rounds; ++r)
+            for (auto& n : variableNames) found += st.getVariable(n) != nullptr;
+    });
+    auto fns = bestOf(3, [&] {
+        for (int r = 0; r < rounds; ++r)
+            for (auto& n : functionNames) found += st.getFunction(n) != nullptr;
+    });
+    auto tys = bestOf(3, [&] {
+        for (int r = 0; r < rounds; ++r)
+            for (auto& n : typeNames) found += st.getType(n) != nullptr;
+    });
+    for (int d = 0; d < depth; ++d) st.destroyScope();
+    auto scopes = bestOf(3, [&] {
+        for (int r = 0; r < rounds; ++r) {
+            size_t v = 0;
+            for (int d = 0; d < depth; ++d) {
+                st.createScope();
+                for (int k = 0; k < perScope; ++k) st.addVariable(i32, variableNames[v++]);
+            }
+            for (int d = 0; d < depth; ++d) st.destroyScope();
+        }
+    });
+    auto expected = 3 * rounds * (variableNames.size() + functionNames.size() + typeNames.size());
+    if (found != expected) std::printf("mismatch: %zu of %zu symbols found\n", found, expected);
+    auto perLookup = [&](double t, size_t n) { return t / (rounds * n) * 1e9; };
+    std::printf("lookup variable %6.1f ns (%d scopes), function %6.1f ns (%d), type %6.1f ns (%d)\n",
+                perLookup(variables, variableNames.size()), depth, perLookup(fns, functionNames.size()), functions,
+                perLookup(tys, typeNames.size()), types);
+    std::printf("scopes %9.2f ms for %d x %d nested scopes of %d variables\n", scopes * 1e3, rounds, depth,
+                perScope);
+}
+
+int main(int argc, char** argv)
+{
+    // the code generator also writes to std::cout
+    std::cout.setstate(std::ios::badbit);
+    size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 4;
+    std::string file = argc > 2 ? argv[2] : "parser_bench.rpp";
+    auto src = generateSource(megabytes << 20);
+    {
+        std::ofstream fs(file, std::ios::binary);
+        fs << src;
+    }
+    std::printf("input: %s, %.2f MB\n", file.c_str(), src.size() / double(1 << 20));
+
+    size_t parseAllocations = 0, arena = 0;
+    double parse = 1e300, teardown = 1e300;
+    for (int i = 0; i < 5; ++i) {
+        std::unique_ptr<Parse::Parser> parser;
+        auto before = allocations;
+        parse = std::min(parse, bestOf(1, [&] {
+            parser = std::make_unique<Parse::Parser>(file);
+            parser->MainLoop();
+        }));
+        parseAllocations = allocations - before;
+        arena = parser->context().arenaBytes();
+        teardown = std::min(teardown, bestOf(1, [&] { parser.reset(); }));
+    }
+    std::printf("parse    %9.2f ms %9.2f MB/s %10zu allocations %9.2f MB arena\n", parse * 1e3,
+                src.size() / parse / (1 << 20), parseAllocations, arena / double(1 << 20));
+    std::printf("teardown %9.2f ms\n", teardown * 1e3);
+
+    const char* names[] = { "ExprAST", "direct" };
+    std::string ir[2];
+    for (int direct = 0; direct < 2; ++direct) {
+        size_t lowerAllocations = 0;
+        double time = 1e300;
+        for (int i = 0; i < 3; ++i) {
+            time = std::min(time, lower(file, direct, lowerAllocations, ir[direct]));
+        }
+        std::printf("lower %-8s %9.2f ms %9.2f MB/s %10zu allocations\n", names[direct], time * 1e3,
+                    src.size() / time / (1 << 20), lowerAllocations);
+    }
+    if (ir[0] != ir[1]) std::printf("mismatch: the lowering paths give different modules\n");
+    symbols();
+    std::remove(file.c_str());
+    return 0;
+}
@@ -0,0 +1,47 @@
+// Runtime of the test/src.rpp kernels, linked against the output.o the
+// compiler writes, see runtime_bench.sh which builds and runs it once per
+// optimization level:
+//
+//   RuntimeBench [repeat factor]
+#include <cstdio>
+#include <cstdlib>
+#include "BenchUtil.h"
+
+extern "C" {
+int _R9fibonacciI3i32(int);
+int _R3sumI3i32(int);
+int _R10precedence();
+int _R19classMemberFunctionI3i32(int);
+int _R5arrayI3i32(int);
+int _R3ptrI3i32I3i32(int, int);
+int _R9TemplateA();
+int _R17classConstructor2I3i32I3i32(int, int);
+}
+
+// keeps the calls and their results alive
+static volatile int sink;
+
+template <typename F>
+static void run(const char* name, int calls, F&& kernel)
+{
+    auto time = bestOf(5, [&] {
+        int acc = 0;
+        for (int i = 0; i < calls; ++i) acc += kernel(i);
+        sink = acc;
+    });
+    std::printf("  %-20s %10.2f ns/call\n", name, time / calls * 1e9);
+}
+
+int main(int argc, char** argv)
+{
+    int n = argc > 1 ? std::atoi(argv[1]) : 1;
+    run("fibonacci(24)", 20 * n, [](int) { return _R9fibonacciI3i32(24); });
+    run("sum(10000)", 2000 * n, [](int i) { return _R3sumI3i32(10000 + (i & 1)); });
+    run("precedence()", 1000000 * n, [](int) { return _R10precedence(); });
+    run("classMemberFunction", 1000000 * n, [](int i) { return _R19classMemberFunctionI3i32(i & 7); });
+    run("classConstructor2", 1000000 * n, [](int i) { return _R17classConstructor2I3i32I3i32(i, 5); });
+    run("array", 200000 * n, [](int i) { return _R5arrayI3i32(i & 7); });
+    run("ptr", 1000000 * n, [](int i) { return _R3ptrI3i32I3i32(i, 3); });
+    run("TemplateA()", 1000000 * n, [](int) { return _R9TemplateA(); });
+    return 0;
+}
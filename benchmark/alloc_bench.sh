@@ -0,0 +1,16 @@
+#!/bin/sh
+# Compiles benchmark/alloc.rpp and times its kernels with AllocBench.cpp,
+# once with the runtime's pooled allocator and once with plain malloc
+# (MallocRuntime.cpp). Run from the build directory:
+#
+#   ../benchmark/alloc_bench.sh [compiler] [repeat factor] [threads]
+set -e
+bench=$(cd "$(dirname "$0")" && pwd)
+compiler=${1:-./R-Cpp/R-Cpp}
+"$compiler" -c "$bench/alloc.rpp" -o alloc.o -O2 > /dev/null 2>&1
+${CXX:-clang++} -O2 -c "$bench/MallocRuntime.cpp" -o malloc_runtime.o
+for runtime in R-Cpp/Runtime/libRuntime.a malloc_runtime.o; do
+    ${CXX:-clang++} -O2 -I"$bench" "$bench/AllocBench.cpp" alloc.o $runtime -lpthread -o alloc_bench
+    echo "$runtime"
+    ./alloc_bench ${2:-1} ${3:-1}
+done
@@ -0,0 +1,14 @@
+#!/bin/sh
+# Compiles test/src.rpp at each optimization level and times its kernels
+# with RuntimeBench.cpp. Run from the build directory:
+#
+#   ../benchmark/runtime_bench.sh [compiler] [repeat factor]
+set -e
+bench=$(cd "$(dirname "$0")" && pwd)
+compiler=${1:-./R-Cpp/R-Cpp}
+for level in -O0 -O1 -O2 -O3 -Os; do
+    "$compiler" -c "$bench/../test/src.rpp" -o output.o $level > /dev/null 2>&1
+    ${CXX:-clang++} -O2 -I"$bench" "$bench/RuntimeBench.cpp" output.o R-Cpp/Runtime/libRuntime.a -o runtime_bench
+    echo "$level"
+    ./runtime_bench ${2:-1}
+done
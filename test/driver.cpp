@@ -1,16 +1,44 @@
 #include "gtest/gtest.h"
 
+// the classes c and big of src.rpp
+struct C{
+    int a,b;
+};
+
+struct Big{
+    int p,q,r,s,t;
+};
+
+// tally of src.rpp
+struct Tally{
+    int n;
+};
+
 extern "C"{
     int _R9fibonacciI3i32(int);
     int _R3sumI3i32(int);
+    int _R6hotSum();
     int _R10precedence();
     int _R19classMemberFunctionI3i32(int);
     int _R5arrayI3i32(int);
     int _R3ptrI3i32I3i32(int,int);
+    int _R7rcShareI3i32I3i32(int,int);
+    int _R8arcShareI3i32I3i32(int,int);
+    int _R9rcReleaseI13__ptr_T5tally(Tally*);
+    int _R10rcReturnedI13__ptr_T5tally(Tally*);
+    int _R10arcReleaseI13__ptr_T5tally(Tally*);
     int _R9TemplateA();
     int _R9TemplateB();
     int _R17classConstructor1();
     int _R17classConstructor2I3i32I3i32(int,int);
+    int _R12classElisionI3i32I3i32(int,int);
+    int _R9classMoveI3i32(int);
+    int _R19plainPtrConstructorI3i32(int);
+    int _R12importedAreaI3i32I3i32(int,int);
+    C _R5makeCI3i32I3i32(int,int);
+    int _R4sumCI1c(C);
+    Big _R7makeBigI3i32(int);
+    int _R6sumBigI3big(Big);
 }
 
 int fibonacci(int i){
@@ -21,6 +49,10 @@ int sum(int i){
     return _R3sumI3i32(i);
 }
 
+int hotSum(){
+    return _R6hotSum();
+}
+
 int precedence(){
     return _R10precedence();
 }
@@ -37,6 +69,38 @@ int classConstructor2(int a,int b){
     return _R17classConstructor2I3i32I3i32(a,b);
 }
 
+int classElision(int a,int b){
+    return _R12classElisionI3i32I3i32(a,b);
+}
+
+int classMove(int i){
+    return _R9classMoveI3i32(i);
+}
+
+C makeC(int a,int b){
+    return _R5makeCI3i32I3i32(a,b);
+}
+
+int sumC(C c){
+    return _R4sumCI1c(c);
+}
+
+Big makeBig(int x){
+    return _R7makeBigI3i32(x);
+}
+
+int sumBig(Big big){
+    return _R6sumBigI3big(big);
+}
+
+int plainPtrConstructor(int i){
+    return _R19plainPtrConstructorI3i32(i);
+}
+
+int importedArea(int w,int h){
+    return _R12importedAreaI3i32I3i32(w,h);
+}
+
 int array(int i){
     return _R5arrayI3i32(i);
 }
@@ -45,6 +109,26 @@ int ptr(int a,int b){
     return _R3ptrI3i32I3i32(a,b);
 }
 
+int rcShare(int a,int b){
+    return _R7rcShareI3i32I3i32(a,b);
+}
+
+int arcShare(int a,int b){
+    return _R8arcShareI3i32I3i32(a,b);
+}
+
+int rcRelease(Tally* t){
+    return _R9rcReleaseI13__ptr_T5tally(t);
+}
+
+int rcReturned(Tally* t){
+    return _R10rcReturnedI13__ptr_T5tally(t);
+}
+
+int arcRelease(Tally* t){
+    return _R10arcReleaseI13__ptr_T5tally(t);
+}
+
 int templateA(){
     return _R9TemplateA();
 }
@@ -90,6 +174,14 @@ TEST(Basic, for){
     }
 }
 
+TEST(Basic, hotSum){
+    int total=0;
+    for(int i=0;i<2000;++i){
+        total+=Sum(i);
+    }
+    EXPECT_EQ(hotSum(),total);
+}
+
 TEST(BASIC, precedence){
     EXPECT_EQ(precedence(),62);
 }
@@ -106,6 +198,34 @@ TEST(CLASS,constructor){
     EXPECT_EQ(classConstructor2(12,35),47);
 }
 
+TEST(CLASS,copyElision){
+    EXPECT_EQ(classElision(3,4),3+1+4);
+    EXPECT_EQ(classElision(12,35),12+1+35);
+    // built in place, then moved once by return
+    EXPECT_EQ(classMove(5),5+100);
+    // node(__ptr<node>) isn't declared with move, return doesn't call it
+    EXPECT_EQ(plainPtrConstructor(5),5+1);
+}
+
+TEST(CLASS,cABI){
+    // c comes back in registers, big through memory
+    C c=makeC(3,4);
+    EXPECT_EQ(c.a,3);
+    EXPECT_EQ(c.b,4);
+    EXPECT_EQ(sumC(c),7);
+    EXPECT_EQ(sumC(makeC(12,35)),47);
+    Big big=makeBig(10);
+    EXPECT_EQ(big.p,10);
+    EXPECT_EQ(big.t,14);
+    EXPECT_EQ(sumBig(big),60);
+}
+
+TEST(MODULE, import){
+    // area.rpp builds a rect of shapes.rpp and calls its square()
+    EXPECT_EQ(importedArea(3,4),3*4+2*2);
+    EXPECT_EQ(importedArea(5,7),5*7+2*2);
+}
+
 TEST(ARRAY, basic){
     for(int i=2;i<10;++i){
         EXPECT_EQ(array(i),Array(i));
@@ -118,6 +238,26 @@ TEST(POINTER, basic){
     EXPECT_EQ(ptr(68,3),68+3);
 }
 
+TEST(POINTER, refCounted){
+    EXPECT_EQ(rcShare(33,55),33+55+1);
+    EXPECT_EQ(rcShare(82,255),82+255+1);
+    EXPECT_EQ(arcShare(68,3),68+3);
+}
+
+TEST(POINTER, refCountedRelease){
+    // alive while a copy is, destroyed exactly once by the last one
+    Tally t{0};
+    EXPECT_EQ(rcRelease(&t),0);
+    EXPECT_EQ(t.n,1);
+    // returning the rc moves it, nothing is released on the way
+    t.n=0;
+    EXPECT_EQ(rcReturned(&t),0);
+    EXPECT_EQ(t.n,1);
+    t.n=0;
+    EXPECT_EQ(arcRelease(&t),0);
+    EXPECT_EQ(t.n,1);
+}
+
 TEST(TEMPLATE, basic){
     EXPECT_EQ(templateA(),1);
     EXPECT_EQ(templateB(),2);
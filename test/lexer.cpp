@@ -0,0 +1,69 @@
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include "gtest/gtest.h"
+#include "../R-Cpp/Lexer/Lexer.h"
+
+// random input biased towards the bytes the scan kernels care about
+static std::string randomSource(std::mt19937& rng, size_t length){
+    static const char alphabet[] = " \t\n\r\v\f//__azAZ09.5(;{\\@`[{\x80\xff";
+    std::uniform_int_distribution<size_t> pick(0, sizeof(alphabet) - 2);
+    std::uniform_int_distribution<int> run(1, 40);
+    std::string s;
+    while (s.size() < length)
+        s.append(run(rng), alphabet[pick(rng)]);
+    s.resize(length);
+    return s;
+}
+
+static std::string lexAll(const std::string& file, const ScanKernel& kernel){
+    std::string dump;
+    try {
+        Lexer lexer(file, Lexer::Mode::Mapped, kernel);
+        for (auto t = lexer.nextToken(); t.type != TokenType::Eof; t = lexer.nextToken()) {
+            dump += std::to_string(static_cast<int>(t.type)) + ':' + std::to_string(t.offset) + ':';
+            dump += lexer.content(t);
+            dump += '\n';
+        }
+    } catch (std::invalid_argument& e) {
+        dump += e.what();
+    }
+    return dump;
+}
+
+// every kernel the CPU has stops where the scalar one does, from every
+// offset of random byte soup
+TEST(LEXER, scanKernels){
+    auto& scalar = ScanKernel::scalar();
+    std::mt19937 rng(2020);
+    for (int round = 0; round < 2000; ++round) {
+        auto src = randomSource(rng, std::uniform_int_distribution<size_t>(0, 300)(rng));
+        auto begin = src.data(), end = begin + src.size();
+        for (auto kernel : ScanKernel::available()) {
+            for (auto p = begin; p <= end; ++p) {
+                ASSERT_EQ(kernel->skipSpace(p, end), scalar.skipSpace(p, end)) << kernel->name << " round " << round;
+                ASSERT_EQ(kernel->skipLine(p, end), scalar.skipLine(p, end)) << kernel->name << " round " << round;
+                ASSERT_EQ(kernel->skipIdentifier(p, end), scalar.skipIdentifier(p, end)) << kernel->name << " round " << round;
+                ASSERT_EQ(kernel->skipDigits(p, end), scalar.skipDigits(p, end)) << kernel->name << " round " << round;
+            }
+        }
+    }
+}
+
+// and the lexer gives the same tokens with each of them
+TEST(LEXER, kernelsLexAlike){
+    const std::string file = "lexer_fuzz.rpp";
+    std::mt19937 rng(2020);
+    for (int round = 0; round < 128; ++round) {
+        {
+            std::ofstream fs(file, std::ios::binary);
+            fs << randomSource(rng, std::uniform_int_distribution<size_t>(0, 300)(rng));
+        }
+        auto expected = lexAll(file, ScanKernel::scalar());
+        for (auto kernel : ScanKernel::available())
+            EXPECT_EQ(lexAll(file, *kernel), expected) << kernel->name << " round " << round;
+    }
+    std::remove(file.c_str());
+}
@@ -1,6 +1,60 @@
 cmake .. &&
 make &&
 cp R-Cpp/R-Cpp ./compiler &&
-./compiler src.rpp &&
-clang++ driver.cpp output.o -lgtest -lpthread -o out &&
-./out 
\ No newline at end of file
+./compiler -c src.rpp -o output.o &&
+# area.rpp imports shapes.rpp, through shapes.rpi
+./compiler -c shapes.rpp area.rpp &&
+clang++ -std=c++17 driver.cpp lexer.cpp ../R-Cpp/Lexer/*.cpp output.o shapes.o area.o R-Cpp/Runtime/libRuntime.a -lgtest -lpthread -o out &&
+./out &&
+# at -O2, with the per-function pipeline and lifetime markers, the same tests pass
+./compiler -O2 -c src.rpp -o output.O2.o &&
+clang++ -std=c++17 driver.cpp lexer.cpp ../R-Cpp/Lexer/*.cpp output.O2.o shapes.o area.o R-Cpp/Runtime/libRuntime.a -lgtest -lpthread -o out.O2 &&
+./out.O2 &&
+# at -O2 in 4 partitions optimized and compiled in parallel, the same tests pass
+./compiler -O2 --codegen-partitions=4 -c src.rpp -o output.parts.o &&
+clang++ -std=c++17 driver.cpp lexer.cpp ../R-Cpp/Lexer/*.cpp output.parts.o shapes.o area.o R-Cpp/Runtime/libRuntime.a -lgtest -lpthread -o out.parts &&
+./out.parts &&
+# --cache-dir: the second build takes every function from the cache
+rm -rf cache edited && mkdir edited &&
+./compiler -c src.rpp --cache-dir=cache -o output.cached.o &&
+clang++ -std=c++17 driver.cpp lexer.cpp ../R-Cpp/Lexer/*.cpp output.cached.o shapes.o area.o R-Cpp/Runtime/libRuntime.a -lgtest -lpthread -o out.cached &&
+./out.cached &&
+./compiler -c src.rpp --cache-dir=cache -o output.cached.o -ftime-report 2> cache.log &&
+clang++ -std=c++17 driver.cpp lexer.cpp ../R-Cpp/Lexer/*.cpp output.cached.o shapes.o area.o R-Cpp/Runtime/libRuntime.a -lgtest -lpthread -o out.cached &&
+./out.cached &&
+functions=$(sed -n 's/^ *\([0-9]*\)  src: functions$/\1/p' cache.log) &&
+cached=$(sed -n 's/^ *\([0-9]*\)  src: functions from the cache$/\1/p' cache.log) &&
+[ "$functions" -gt 0 ] && [ "$cached" -eq "$functions" ] &&
+# an edited body is compiled again, precedence() now returns 63
+sed 's/return 3 \* 4 + 8 \* 5 + 10;/return 3 * 4 + 8 * 5 + 11;/' src.rpp > edited/src.rpp &&
+./compiler -c edited/src.rpp --cache-dir=cache -o output.cached.o &&
+clang++ -std=c++17 driver.cpp lexer.cpp ../R-Cpp/Lexer/*.cpp output.cached.o shapes.o area.o R-Cpp/Runtime/libRuntime.a -lgtest -lpthread -o out.cached &&
+./out.cached --gtest_filter=-BASIC.precedence &&
+{ ./out.cached --gtest_filter=BASIC.precedence | grep -q "Which is: 63"; } &&
+# the chunks an edit doesn't touch are reused, 300 functions make several
+for i in $(seq 300); do printf 'fn f%d() -> i32\n{\n\treturn %d;\n}\n' $i $i; done > many.rpp &&
+./compiler -c many.rpp --cache-dir=cache &&
+sed 's/return 1;/return 0;/' many.rpp > edited/many.rpp &&
+./compiler -c edited/many.rpp --cache-dir=cache -ftime-report 2> cache.log &&
+grep -Eq '^ *[1-9][0-9]*  many: functions from the cache$' cache.log &&
+# an interface from elsewhere or cut short is rejected
+printf 'import bad;\n' > importbad.rpp &&
+printf 'ELF!' > bad.rpi &&
+{ ./compiler -c importbad.rpp 2>&1 | grep -q "bad.rpi is not a module interface of this version"; } &&
+head -c 12 shapes.rpi > bad.rpi &&
+{ ./compiler -c importbad.rpp 2>&1 | grep -q "bad.rpi is corrupt"; } &&
+# two sources compiled at once and linked, main() returns square(3).area()
+./compiler -j 2 shapes.rpp program.rpp -o program &&
+{ ./program; [ $? -eq 9 ]; } &&
+# checking function bodies on several threads gives the same output
+./compiler -c src.rpp --dump-ast --dump-ir > sema.1.log 2>&1 && ./compiler -c src.rpp --dump-ast --dump-ir --sema-threads=4 > sema.4.log 2>&1 && cmp sema.1.log sema.4.log &&
+# lowering straight from the Parse:: tree gives the same IR as going through ExprAST
+./compiler -c src.rpp --dump-ir > lower.ast.log 2>&1 && ./compiler -c src.rpp --dump-ir --direct-lowering > lower.direct.log 2>&1 && cmp lower.ast.log lower.direct.log &&
+# the same source run in memory, precedence() returns 62
+{ ./compiler src.rpp --jit=precedence > /dev/null 2>&1; [ $? -eq 62 ]; }  &&
+# compiled lazily, precedence() is called once and stays in tier 0
+{ ./compiler src.rpp --lazy-jit=precedence > /dev/null 2>&1; [ $? -eq 62 ]; } &&
+# hotSum() calls sum() 2000 times, sum() tiers up and gives the same
+# result, 1331334000 & 255 as the exit status
+{ ./compiler src.rpp --lazy-jit=hotSum -ftime-report > /dev/null 2> tier.log; [ $? -eq 112 ]; } &&
+grep -Eq '^ *[1-9][0-9]*  src: functions tiered up$' tier.log